@@ -3,7 +3,10 @@
 #include <boost/container/static_vector.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #define CHESSPOS(name) const Chai::Chess::Position name = {#name[0], #name[1]}
 
@@ -93,6 +96,7 @@ class IMachine {
     virtual bool Move(const std::string& notation) = 0; // Standard algebraic notation (SAN) is the notation
                                                         // standardized by FIDE. It omits the starting file and rank of
                                                         // the piece, unless it is necessary to disambiguate the move.
+    virtual bool NullMove() = 0; // Passes the move to the opponent, used by the search only. Impossible in check.
     virtual void Undo() = 0;
 
     virtual Set CurrentPlayer() const = 0;
@@ -100,22 +104,121 @@ class IMachine {
     virtual PieceMoves EnumMoves(Position from) const = 0; // Sorted vector of piece moves;
     virtual Status CheckStatus() const = 0;
     virtual std::string LastMoveNotation() const = 0;
+    virtual uint64_t PositionKey() const = 0; // Zobrist hash of the pieces, the player, castling and en passant rights.
+    // Static exchange evaluation of the move in centipawns: the material it wins or loses when both sides go on
+    // capturing on the target square with their least valuable pieces. Quiet moves give the risk of the moved piece.
+    virtual int SEE(Position from, Position to, Type promotion = Type::bad) const = 0;
+    virtual bool SEEAtLeast(Position from, Position to, int threshold, Type promotion = Type::bad) const = 0; // SEE >= threshold, cheaper
 
     virtual boost::shared_ptr<IMachine> SlightClone() const = 0;
 
     virtual ~IMachine() {}
 };
 
+// A position copied out of the machine, so that many positions can be evaluated together without it.
+struct PositionSnapshot {
+    Pieces white;
+    Pieces black;
+    Set player = Set::unknown;
+    Status status = Status::invalid;
+    int whitemoves = 0; // moves of all the white pieces, whoever is to move
+    int blackmoves = 0;
+};
+
+inline PositionSnapshot TakeSnapshot(const IMachine& position) {
+    PositionSnapshot snapshot;
+    snapshot.white = position.GetSet(Set::white);
+    snapshot.black = position.GetSet(Set::black);
+    snapshot.player = position.CurrentPlayer();
+    snapshot.status = position.CheckStatus();
+    for (const auto& piece : snapshot.white) {
+        snapshot.whitemoves += static_cast<int>(position.EnumMoves(piece.position).size());
+    }
+    for (const auto& piece : snapshot.black) {
+        snapshot.blackmoves += static_cast<int>(position.EnumMoves(piece.position).size());
+    }
+    return snapshot;
+}
+
+// What the search did, sent once when it is over. An engine fills the counters it keeps and leaves the others zero.
+struct SearchStatistics {
+    size_t nodes = 0;            // positions searched, the quiescence ones included
+    size_t evaluations = 0;      // static evaluations of the leaves and of the pruning decisions
+    size_t betacutoffs = 0;      // nodes left early because a move failed high
+    size_t firstmovecutoffs = 0; // the cutoffs by the first move searched
+    size_t ttprobes = 0;         // lookups in the transposition table
+    size_t tthits = 0;           // the lookups finding the position
+    size_t clones = 0;           // positions copied to make a move on
+    size_t movesgenerated = 0;   // moves listed at the nodes
+    size_t checks = 0;           // nodes found in check
+    size_t checkmates = 0;
+    size_t stalemates = 0;
+    size_t aborts = 0;           // nodes and moves given up when the search was stopped
+
+    // How often the selective search techniques triggered.
+    size_t nullmoves = 0;         // null move searches
+    size_t nullverifications = 0; // null move fail highs verified by a reduced search
+    size_t nullcutoffs = 0;       // null move cutoffs
+    size_t lmrreductions = 0;     // reduced late moves
+    size_t lmrresearches = 0;     // reduced late moves re-searched at full depth
+    size_t pvsresearches = 0;     // zero window fail highs re-searched with the full window
+    size_t futility = 0;          // quiet moves pruned at the frontier
+    size_t reversefutility = 0;   // nodes cut by the reverse futility pruning
+    size_t seepruned = 0;         // moves losing the exchange pruned at the frontier
+    size_t ttcutoffs = 0;         // nodes cut by a bound found in the transposition table
+    size_t bitbasehits = 0;       // nodes decided by the endgame bitbases
+
+    // Responsiveness of the engine threads.
+    std::chrono::microseconds startlatency{0}; // from the Start call to the first node searched
+    std::chrono::microseconds stoplatency{0};  // from the Stop call to the end of the search, 0 if it was not stopped
+
+    // The share of the cutoffs made by the first move, the quality of the move ordering.
+    double FirstMoveCutoffRate() const {
+        return betacutoffs > 0 ? static_cast<double>(firstmovecutoffs) / betacutoffs : 0.0;
+    }
+};
+
 class IInfoCall {
  public:
     // Messages sent during the search
     virtual void NodesSearched(size_t nodes) = 0;
     virtual void NodesPerSecond(int nps) = 0;
+    virtual void SearchDepth(int depth, int seldepth) = 0; // seldepth - the deepest ply reached by selective search
+    virtual void HashFull(int permill) = 0;
+    virtual void CurrentMove(const std::string& notation, int number) = 0; // The root move under search.
+    // line - number of the line in the multi-PV analysis, 1 is the best one.
+    virtual void PrincipalVariation(int depth, float score, const std::vector<std::string>& notations, int line) = 0;
 
     // Messages sent after the search
     virtual void ReadyOk() = 0;
     virtual void BestMove(std::string notation) = 0;
     virtual void BestScore(float score) = 0; // in pawns
+    virtual void SearchStats(const SearchStatistics& stats) = 0; // before ReadyOk
+};
+
+// Ignores every message, so a listener overrides only the messages it takes.
+class InfoCallAdapter : public IInfoCall {
+ public:
+    void NodesSearched(size_t /*nodes*/) override {
+    }
+    void NodesPerSecond(int /*nps*/) override {
+    }
+    void SearchDepth(int /*depth*/, int /*seldepth*/) override {
+    }
+    void HashFull(int /*permill*/) override {
+    }
+    void CurrentMove(const std::string& /*notation*/, int /*number*/) override {
+    }
+    void PrincipalVariation(int /*depth*/, float /*score*/, const std::vector<std::string>& /*notations*/, int /*line*/) override {
+    }
+    void ReadyOk() override {
+    }
+    void BestMove(std::string /*notation*/) override {
+    }
+    void BestScore(float /*score*/) override {
+    }
+    void SearchStats(const SearchStatistics& /*stats*/) override {
+    }
 };
 
 class IEngine {
@@ -128,9 +231,22 @@ class IEngine {
     */
     virtual bool Start(const IMachine& position, int depth) = 0;
     virtual void Stop() = 0;
+    /**
+      Search on the opponent's time.
+
+      position - the position after the expected reply of the opponent. The search goes on as started by Start, but
+      the best move and ReadyOk are held back until PonderHit, when the opponent made the expected move and the search
+      becomes the real one with all it has found. If the opponent made another move, Stop drops the search and its
+      results.
+    */
+    virtual bool Ponder(const IMachine& position, int depth) = 0;
+    virtual void PonderHit() = 0;
     virtual void ProcessInfo(IInfoCall* cb) = 0;
+    virtual bool WaitInfo(int milliseconds) = 0; // Blocks until there are messages for ProcessInfo or the timeout expires.
     virtual float
     EvalPosition(const IMachine& position) const = 0; // Evaluation of the current position for current player.
+    virtual void EvalPositions(const PositionSnapshot* positions, size_t count,
+                               float* scores) const = 0; // The same evaluation of many positions at once.
 
     virtual ~IEngine() {}
 };
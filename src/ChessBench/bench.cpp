@@ -0,0 +1,97 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <numeric>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+std::string Escape(const std::string& text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+}
+
+void Bench::Add(const std::string& name, size_t operations, std::vector<double>& times) {
+  BenchResult result;
+  result.name = name;
+  result.operations = operations;
+  result.repetitions = static_cast<int>(times.size());
+  if (!times.empty()) {
+    std::sort(times.begin(), times.end());
+    const size_t n = times.size();
+    result.mean = std::accumulate(times.begin(), times.end(), 0.0) / n;
+    result.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    result.min = times.front();
+    result.max = times.back();
+    double squares = 0;
+    for (double t : times) {
+      squares += (t - result.mean) * (t - result.mean);
+    }
+    result.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0;
+  }
+  results.push_back(result);
+}
+
+void Bench::WriteTable(std::ostream& out) const {
+  out << std::left << std::setw(34) << "benchmark" << std::right << std::setw(10) << "ops" << std::setw(12) << "mean ns"
+      << std::setw(12) << "median ns" << std::setw(12) << "min ns" << std::setw(12) << "max ns" << std::setw(10) << "stddev" << "\n";
+  out << std::fixed << std::setprecision(1);
+  for (const auto& r : results) {
+    out << std::left << std::setw(34) << r.name << std::right << std::setw(10) << r.operations << std::setw(12) << r.mean
+        << std::setw(12) << r.median << std::setw(12) << r.min << std::setw(12) << r.max << std::setw(10) << r.stddev << "\n";
+  }
+  out << std::defaultfloat;
+}
+
+void Bench::WriteJson(std::ostream& out, size_t positions) const {
+  char date[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+#if defined(__VERSION__)
+  const std::string compiler = __VERSION__;
+#elif defined(_MSC_FULL_VER)
+  const std::string compiler = "MSVC " + std::to_string(_MSC_FULL_VER);
+#else
+  const std::string compiler = "unknown";
+#endif
+#if defined(NDEBUG)
+  const char* build = "release";
+#else
+  const char* build = "debug";
+#endif
+  out << "{\n"
+      << "  \"context\": {\n"
+      << "    \"date\": \"" << date << "\",\n"
+      << "    \"compiler\": \"" << Escape(compiler) << "\",\n"
+      << "    \"build\": \"" << build << "\",\n"
+      << "    \"positions\": " << positions << ",\n"
+      << "    \"warmup\": " << warmup << ",\n"
+      << "    \"repetitions\": " << repetitions << "\n"
+      << "  },\n"
+      << "  \"benchmarks\": [";
+  out << std::setprecision(6);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << Escape(r.name) << "\", \"operations\": " << r.operations
+        << ", \"repetitions\": " << r.repetitions << ", \"mean_ns\": " << r.mean << ", \"median_ns\": " << r.median
+        << ", \"min_ns\": " << r.min << ", \"max_ns\": " << r.max << ", \"stddev_ns\": " << r.stddev
+        << ", \"ops_per_second\": " << (r.mean > 0 ? 1e9 / r.mean : 0) << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+// Nanoseconds per operation over the repetitions of a benchmark.
+struct BenchResult {
+    std::string name;
+    size_t operations = 0; // per repetition
+    int repetitions = 0;
+    double mean = 0;
+    double median = 0;
+    double min = 0;
+    double max = 0;
+    double stddev = 0;
+};
+
+// Keeps the compiler from dropping the computation of the value.
+template <typename T>
+inline void KeepValue(const T& value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+/**
+  Runs the benchmarks: the warmup passes first, then the timed repetitions. A pass runs the function once, which does
+  its operations over the whole corpus and returns their number, so every repetition gives the time of an operation.
+*/
+class Bench {
+ public:
+    Bench(int warmup, int repetitions, const std::string& filter) : warmup(warmup), repetitions(repetitions), filter(filter) {}
+
+    template <typename Fun>
+    void Run(const std::string& name, Fun fun) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) {
+            return;
+        }
+        for (int i = 0; i < warmup; ++i) {
+            fun();
+        }
+        std::vector<double> times;
+        size_t operations = 0;
+        for (int i = 0; i < repetitions; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            operations = fun();
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            times.push_back(elapsed.count() / std::max<size_t>(1, operations));
+        }
+        Add(name, operations, times);
+    }
+
+    const std::vector<BenchResult>& Results() const {
+        return results;
+    }
+    void WriteTable(std::ostream& out) const;
+    void WriteJson(std::ostream& out, size_t positions) const;
+
+ private:
+    void Add(const std::string& name, size_t operations, std::vector<double>& times);
+
+    const int warmup;
+    const int repetitions;
+    const std::string filter;
+    std::vector<BenchResult> results;
+};
+
+} // namespace Chess
+} // namespace Chai
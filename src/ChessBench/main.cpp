@@ -0,0 +1,259 @@
+#include "bench.h"
+#include "searchbench.h"
+
+#include <ChessEngineGreedy/engine.h>
+#include <ChessMachine/machine.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace Chai::Chess;
+
+namespace {
+
+const int MaxPlies = 120;
+const uint32_t CorpusSeed = 1;
+
+// A position of the corpus: the state and the machine before the move, the move and its notation.
+struct CorpusEntry {
+    ChessState state;
+    boost::shared_ptr<IMachine> machine;
+    StateMove move;
+    std::string notation;
+};
+
+/**
+  Plays random games from the start, the same ones on every run. Every position after the first move goes into the
+  corpus, so the openings, the middle games and the endings of the random games are all there.
+*/
+std::vector<CorpusEntry> MakeCorpus(int games) {
+  std::vector<CorpusEntry> corpus;
+  for (int game = 0; game < games; ++game) {
+    std::mt19937 random(CorpusSeed + game);
+    ChessMachine machine;
+    machine.Start();
+    ChessState state;
+    for (int ply = 0; ply < MaxPlies; ++ply) {
+      std::vector<StateMove> moves;
+      for (const auto& piece : machine.GetSet(machine.CurrentPlayer())) {
+        for (const auto& to : machine.EnumMoves(piece.position)) {
+          const bool promotion = piece.type == Type::pawn && (to.rank() == '1' || to.rank() == '8');
+          moves.push_back({ piece.type, piece.position, to, promotion ? Type::queen : Type::bad });
+        }
+      }
+      if (moves.empty()) {
+        break;
+      }
+      const StateMove move = moves[std::uniform_int_distribution<size_t>(0, moves.size() - 1)(random)];
+      boost::shared_ptr<IMachine> before = machine.SlightClone();
+      machine.Move(move.type, move.from, move.to, move.promotion);
+      if (ply > 0) {
+        corpus.push_back({ state, before, move, machine.LastMoveNotation() });
+      }
+      state = state.MakeMove(move);
+    }
+  }
+  return corpus;
+}
+
+SearchOptions EvalOptions() {
+  SearchOptions options;
+  options.evalcache = 0; // every call evaluates
+  options.transpositions = 0;
+  options.threads = 1;
+  return options;
+}
+
+const char* KernelName(EvalKernel kernel) {
+  switch (kernel) {
+  case EvalKernel::scalar: return "scalar";
+  case EvalKernel::sse:    return "sse";
+  case EvalKernel::avx2:   return "avx2";
+  }
+  return "unknown";
+}
+
+void Usage() {
+  std::cerr << "Usage: ChessBench [--repetitions N] [--warmup N] [--games N] [--filter TEXT] [--json FILE]\n"
+               "       ChessBench search [--depth N]\n"
+               "Times the move generation, the notation, the evaluation and the batch evaluation with every kernel the\n"
+               "processor runs over a fixed corpus of positions.\n"
+               "The times are nanoseconds per operation, --json - writes the JSON to the standard output.\n"
+               "The search command searches the built-in positions on a single thread to their depths, or all to the\n"
+               "given one, and prints the total nodes: the signature that changes only with the search itself.\n";
+}
+
+int SearchCommand(int argc, char* argv[]) {
+  int depth = 0;
+  for (int i = 2; i < argc; i += 2) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--depth") == 0) {
+      depth = std::atoi(argv[i + 1]);
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  size_t count = 0;
+  const size_t total = SearchBenchPositions().size();
+  const auto results = RunSearchBench(depth, SearchOptions(), [&](const SearchBenchResult& r) {
+    std::cout << "Position " << ++count << "/" << total << " " << r.name << ": depth " << r.depth << ", "
+              << r.nodes << " nodes, best move " << r.bestmove << ", " << static_cast<int>(r.seconds * 1000) << " ms\n";
+  });
+  size_t nodes = 0;
+  double seconds = 0;
+  for (const auto& r : results) {
+    nodes += r.nodes;
+    seconds += r.seconds;
+  }
+  std::cout << "===========================\n"
+            << "Total time (ms) : " << static_cast<long long>(seconds * 1000) << "\n"
+            << "Nodes searched  : " << nodes << "\n"
+            << "Nodes/second    : " << static_cast<long long>(seconds > 0 ? nodes / seconds : 0) << "\n";
+  return 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::strcmp(argv[1], "search") == 0) {
+    return SearchCommand(argc, argv);
+  }
+  int repetitions = 10;
+  int warmup = 2;
+  int games = 32;
+  std::string filter;
+  std::string json;
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 == argc) {
+      Usage();
+      return 1;
+    }
+    const char* arg = argv[i];
+    const char* value = argv[i + 1];
+    if (std::strcmp(arg, "--repetitions") == 0) {
+      repetitions = std::max(1, std::atoi(value));
+    } else if (std::strcmp(arg, "--warmup") == 0) {
+      warmup = std::max(0, std::atoi(value));
+    } else if (std::strcmp(arg, "--games") == 0) {
+      games = std::max(1, std::atoi(value));
+    } else if (std::strcmp(arg, "--filter") == 0) {
+      filter = value;
+    } else if (std::strcmp(arg, "--json") == 0) {
+      json = value;
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+
+  const std::vector<CorpusEntry> corpus = MakeCorpus(games);
+  std::cout << corpus.size() << " positions from " << games << " games\n";
+  const GreedyEngine engine(EvalOptions());
+
+  Bench bench(warmup, repetitions, filter);
+  bench.Run("ChessState::MakeMove", [&] {
+    size_t count = 0;
+    for (const auto& entry : corpus) {
+      for (const auto& square : entry.state.pieces) {
+        if (square.second.set != entry.state.activeSet) {
+          continue;
+        }
+        for (const auto& to : square.second.moves) {
+          const bool promotion = square.second.type == Type::pawn && (to.rank() == '1' || to.rank() == '8');
+          const ChessState next = entry.state.MakeMove(
+              { square.second.type, square.first, to, promotion ? Type::queen : Type::bad });
+          KeepValue(next.hash);
+          ++count;
+        }
+      }
+    }
+    return count;
+  });
+  // The move generation is private to the state, the null move is a copy of the board with the moves generated anew.
+  bench.Run("ChessState::evalMoves", [&] {
+    for (const auto& entry : corpus) {
+      const ChessState next = entry.state.MakeNullMove();
+      KeepValue(next.hash);
+    }
+    return corpus.size();
+  });
+  bench.Run("ChessMachine::Move(notation)", [&] {
+    for (const auto& entry : corpus) {
+      const bool moved = entry.machine->Move(entry.notation);
+      KeepValue(moved);
+      entry.machine->Undo();
+    }
+    return corpus.size();
+  });
+  bench.Run("ChessMachine::LastMoveNotation", [&] {
+    for (const auto& entry : corpus) {
+      const std::string notation = entry.machine->LastMoveNotation();
+      KeepValue(notation);
+    }
+    return corpus.size();
+  });
+  bench.Run("ChessMachine::SlightClone", [&] {
+    for (const auto& entry : corpus) {
+      const boost::shared_ptr<IMachine> clone = entry.machine->SlightClone();
+      KeepValue(clone);
+    }
+    return corpus.size();
+  });
+  bench.Run("ChessMachine::CheckStatus", [&] {
+    for (const auto& entry : corpus) {
+      const Status status = entry.machine->CheckStatus();
+      KeepValue(status);
+    }
+    return corpus.size();
+  });
+  bench.Run("ChessMachine::GetSet+EnumMoves", [&] {
+    for (const auto& entry : corpus) {
+      size_t moves = 0;
+      for (const auto& piece : entry.machine->GetSet(entry.machine->CurrentPlayer())) {
+        moves += entry.machine->EnumMoves(piece.position).size();
+      }
+      KeepValue(moves);
+    }
+    return corpus.size();
+  });
+  bench.Run("GreedyEngine::EvalPosition", [&] {
+    for (const auto& entry : corpus) {
+      const float score = engine.EvalPosition(*entry.machine);
+      KeepValue(score);
+    }
+    return corpus.size();
+  });
+  // The batch evaluation over snapshots of the whole corpus, once per kernel the processor runs.
+  std::vector<PositionSnapshot> snapshots;
+  snapshots.reserve(corpus.size());
+  for (const auto& entry : corpus) {
+    snapshots.push_back(TakeSnapshot(*entry.machine));
+  }
+  std::vector<float> scores(snapshots.size());
+  for (auto kernel : { EvalKernel::scalar, EvalKernel::sse, EvalKernel::avx2 }) {
+    if (!KernelSupported(kernel)) {
+      continue;
+    }
+    bench.Run(std::string("GreedyEngine::EvalPositions(") + KernelName(kernel) + ")", [&] {
+      engine.EvalPositions(snapshots.data(), snapshots.size(), scores.data(), kernel);
+      KeepValue(scores.back());
+      return snapshots.size();
+    });
+  }
+
+  bench.WriteTable(std::cout);
+  if (json == "-") {
+    bench.WriteJson(std::cout, corpus.size());
+  } else if (!json.empty()) {
+    std::ofstream file(json);
+    bench.WriteJson(file, corpus.size());
+    if (!file) {
+      std::cerr << "Cannot write " << json << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
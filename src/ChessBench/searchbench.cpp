@@ -0,0 +1,94 @@
+#include "searchbench.h"
+
+#include <ChessMachine/machine.h>
+
+#include <cassert>
+#include <chrono>
+#include <sstream>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+class SearchListener : public InfoCallAdapter {
+ public:
+    bool ready = false;
+    size_t nodes = 0;
+    std::string bestmove;
+
+    void NodesSearched(size_t n) override {
+        nodes = n;
+    }
+    void ReadyOk() override {
+        ready = true;
+    }
+    void BestMove(std::string notation) override {
+        bestmove = notation;
+    }
+};
+
+}
+
+const std::vector<SearchBenchPosition>& SearchBenchPositions() {
+  static const std::vector<SearchBenchPosition> positions = {
+    { "Start", "", 6 },
+    { "Ruy Lopez", "e4 e5 Nf3 Nc6 Bb5 a6 Ba4 Nf6 O-O Be7 Re1 b5 Bb3 d6 c3 O-O", 6 },
+    { "Sicilian Najdorf", "e4 c5 Nf3 d6 d4 cxd4 Nxd4 Nf6 Nc3 a6 Be3 e5 Nb3 Be6 f3 Be7", 6 },
+    { "Queen's Gambit Declined", "d4 d5 c4 e6 Nc3 Nf6 Bg5 Be7 e3 O-O Nf3 Nbd7 Rc1 c6 Bd3 dxc4 Bxc4", 6 },
+    { "King's Indian", "d4 Nf6 c4 g6 Nc3 Bg7 e4 d6 Nf3 O-O Be2 e5 O-O Nc6 d5 Ne7", 6 },
+    { "French Winawer", "e4 e6 d4 d5 Nc3 Bb4 e5 c5 a3 Bxc3 bxc3 Ne7 Qg4 Qc7", 6 },
+    { "Caro-Kann", "e4 c6 d4 d5 Nc3 dxe4 Nxe4 Bf5 Ng3 Bg6 h4 h6 Nf3 Nd7 h5 Bh7", 6 },
+    { "Italian", "e4 e5 Nf3 Nc6 Bc4 Bc5 c3 Nf6 d4 exd4 cxd4 Bb4 Bd2 Bxd2 Nbxd2 d5", 6 },
+    { "Scandinavian", "e4 d5 exd5 Qxd5 Nc3 Qa5 d4 Nf6 Nf3 Bf5 Bc4 e6 Bd2 c6", 6 },
+    { "English", "c4 e5 Nc3 Nf6 g3 d5 cxd5 Nxd5 Bg2 Nb6 Nf3 Nc6 O-O Be7", 6 },
+    { "Queenless", "d4 d5 c4 dxc4 e4 e5 Nf3 exd4 Qxd4 Qxd4 Nxd4 Bc5 Nb5 Na6 Bxc4", 6 },
+    { "Scotch exchanges", "e4 e5 Nf3 Nc6 d4 exd4 Nxd4 Nxd4 Qxd4 Qf6 Qxf6 Nxf6 Nc3 Bb4 Bd2 Bxc3 Bxc3 Nxe4 Bxg7 Rg8", 6 },
+  };
+  return positions;
+}
+
+std::vector<SearchBenchResult> RunSearchBench(int depth, SearchOptions options,
+                                              const std::function<void(const SearchBenchResult&)>& progress) {
+  options.threads = 1;
+  options.book.clear();
+  options.bitbases.clear();
+  std::vector<SearchBenchResult> results;
+  for (const auto& position : SearchBenchPositions()) {
+    SearchBenchResult result;
+    result.name = position.name;
+    result.depth = depth > 0 ? depth : position.depth;
+    ChessMachine machine;
+    machine.Start();
+    std::istringstream moves(position.moves);
+    for (std::string move; moves >> move; ) {
+      if (!machine.Move(move)) {
+        assert(!"Bad move in the benchmark positions");
+        break;
+      }
+    }
+    {
+      GreedyEngine engine(options);
+      SearchListener listener;
+      const auto start = std::chrono::steady_clock::now();
+      if (engine.Start(machine, result.depth)) {
+        while (!listener.ready) {
+          engine.WaitInfo(100);
+          engine.ProcessInfo(&listener);
+        }
+      }
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      result.seconds = elapsed.count();
+      result.nodes = listener.nodes;
+      result.bestmove = listener.bestmove;
+    }
+    if (progress) {
+      progress(result);
+    }
+    results.push_back(result);
+  }
+  return results;
+}
+
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ChessEngineGreedy/engine.h>
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+// A position of the search benchmark: the moves from the start in the standard algebraic notation.
+struct SearchBenchPosition {
+    const char* name;
+    const char* moves;
+    int depth;
+};
+
+struct SearchBenchResult {
+    std::string name;
+    int depth = 0;
+    size_t nodes = 0;
+    double seconds = 0;
+    std::string bestmove;
+};
+
+// The positions searched by RunSearchBench, the same on every run.
+const std::vector<SearchBenchPosition>& SearchBenchPositions();
+
+/**
+  Searches every benchmark position to its depth, or to the given depth if it is above zero, by a new engine on a
+  single thread. The engine starts with empty tables and makes the moves itself, so the nodes of a position depend on
+  the search only. Their total is the signature of the search: it changes only if the search visits other nodes.
+*/
+std::vector<SearchBenchResult> RunSearchBench(int depth, SearchOptions options,
+                                              const std::function<void(const SearchBenchResult&)>& progress);
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,864 @@
+#include "bitbase.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const char BaseMagic[8] = { 'C', 'h', 'a', 'i', 'B', 'a', 's', 'e' };
+const uint32_t BaseVersion = 1;
+const int MaxPieces = 2; // besides the kings
+
+// The values while the table is generated, the positions not known at the end are draws.
+const uint8_t Unknown = 4;
+
+const int KingSteps[8][2] = { {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1} };
+const int KnightSteps[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+const int Promotions[4] = { static_cast<int>(Type::queen), static_cast<int>(Type::rook), static_cast<int>(Type::bishop),
+                            static_cast<int>(Type::knight) };
+
+char Letter(Type type) {
+  switch (type) {
+  case Type::queen:  return 'Q';
+  case Type::rook:   return 'R';
+  case Type::bishop: return 'B';
+  case Type::knight: return 'N';
+  case Type::pawn:   return 'P';
+  default:           return '?';
+  }
+}
+
+Type PieceOf(char letter) {
+  switch (letter) {
+  case 'Q': return Type::queen;
+  case 'R': return Type::rook;
+  case 'B': return Type::bishop;
+  case 'N': return Type::knight;
+  case 'P': return Type::pawn;
+  default:  return Type::bad;
+  }
+}
+
+// Squares are numbered as Position::pos, the file in the upper three bits and the rank in the lower ones.
+int File(int square) {
+  return square >> 3;
+}
+int Rank(int square) {
+  return square & 7;
+}
+bool OnBoard(int file, int rank) {
+  return file >= 0 && file < 8 && rank >= 0 && rank < 8;
+}
+
+/*
+  A position of the endgame: the kings by color (0 white, 1 black) and up to two other pieces. The pieces are kept in
+  the order of the index: white first, the more valuable first, equal pieces by the square.
+*/
+struct Board {
+  int player = 0;
+  std::array<int, 2> kings{};
+  int count = 0;
+  std::array<int, MaxPieces> squares{};
+  std::array<Type, MaxPieces> types{};
+  std::array<int, MaxPieces> colors{};
+
+  int PieceAt(int square) const { // -1 empty, 0 and 1 the kings, 2 and on the pieces
+    if (kings[0] == square || kings[1] == square) {
+      return kings[0] == square ? 0 : 1;
+    }
+    for (int i = 0; i < count; ++i) {
+      if (squares[i] == square) {
+        return 2 + i;
+      }
+    }
+    return -1;
+  }
+  int ColorAt(int square) const {
+    const int piece = PieceAt(square);
+    return piece < 0 ? -1 : piece < 2 ? piece : colors[piece - 2];
+  }
+  void Remove(int i) {
+    for (int j = i + 1; j < count; ++j) {
+      squares[j - 1] = squares[j];
+      types[j - 1] = types[j];
+      colors[j - 1] = colors[j];
+    }
+    --count;
+  }
+};
+
+std::string BoardName(const Board& board) {
+  std::string sides[2] = { "K", "K" };
+  for (int i = 0; i < board.count; ++i) {
+    sides[board.colors[i]] += Letter(board.types[i]);
+  }
+  for (auto& side : sides) {
+    std::sort(side.begin() + 1, side.end(), [](char a, char b) { return PieceOf(a) > PieceOf(b); });
+  }
+  return sides[0] + sides[1];
+}
+
+Board Flip(const Board& board) {
+  Board flipped = board;
+  flipped.player = 1 - board.player;
+  flipped.kings = { board.kings[1] ^ 7, board.kings[0] ^ 7 };
+  for (int i = 0; i < board.count; ++i) {
+    flipped.squares[i] = board.squares[i] ^ 7;
+    flipped.colors[i] = 1 - board.colors[i];
+  }
+  return flipped;
+}
+
+// The white king goes to the files a-d, the pieces to the order of the index.
+void Normalize(Board& board) {
+  if (File(board.kings[0]) >= 4) {
+    board.kings[0] ^= 56;
+    board.kings[1] ^= 56;
+    for (int i = 0; i < board.count; ++i) {
+      board.squares[i] ^= 56;
+    }
+  }
+  std::array<int, MaxPieces> order{};
+  for (int i = 0; i < board.count; ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.begin() + board.count, [&](int a, int b) {
+    if (board.colors[a] != board.colors[b]) {
+      return board.colors[a] < board.colors[b];
+    }
+    if (board.types[a] != board.types[b]) {
+      return board.types[a] > board.types[b];
+    }
+    return board.squares[a] < board.squares[b];
+  });
+  const Board copy = board;
+  for (int i = 0; i < board.count; ++i) {
+    board.squares[i] = copy.squares[order[i]];
+    board.types[i] = copy.types[order[i]];
+    board.colors[i] = copy.colors[order[i]];
+  }
+}
+
+size_t TableSize(int pieces) {
+  size_t size = 2 * 32 * 64;
+  for (int i = 0; i < pieces; ++i) {
+    size *= 64;
+  }
+  return size;
+}
+
+size_t Index(const Board& board) { // of the normalized board
+  size_t index = (static_cast<size_t>(board.player) * 32 + board.kings[0]) * 64 + board.kings[1];
+  for (int i = 0; i < board.count; ++i) {
+    index = index * 64 + board.squares[i];
+  }
+  return index;
+}
+
+// The layout of the pieces of an endgame, in the order of the index.
+struct Layout {
+  int count = 0;
+  std::array<Type, MaxPieces> types{};
+  std::array<int, MaxPieces> colors{};
+};
+
+bool ParseName(const std::string& name, Layout& layout) {
+  const size_t second = name.find('K', 1);
+  if (name.empty() || name[0] != 'K' || second == std::string::npos ||
+      static_cast<int>(name.size()) - 2 > MaxPieces) {
+    return false;
+  }
+  layout = Layout();
+  for (size_t i = 1; i < name.size(); ++i) {
+    if (i == second) {
+      continue;
+    }
+    const Type type = PieceOf(name[i]);
+    if (type == Type::bad) {
+      return false;
+    }
+    layout.types[layout.count] = type;
+    layout.colors[layout.count] = i < second ? 0 : 1;
+    ++layout.count;
+  }
+  return true;
+}
+
+Board Decode(const Layout& layout, size_t index) {
+  Board board;
+  board.count = layout.count;
+  for (int i = layout.count - 1; i >= 0; --i) {
+    board.squares[i] = static_cast<int>(index % 64);
+    board.types[i] = layout.types[i];
+    board.colors[i] = layout.colors[i];
+    index /= 64;
+  }
+  board.kings[1] = static_cast<int>(index % 64);
+  index /= 64;
+  board.kings[0] = static_cast<int>(index % 32);
+  board.player = static_cast<int>(index / 32);
+  return board;
+}
+
+bool Attacks(const Board& board, int color, int target) {
+  const int tf = File(target), tr = Rank(target);
+  const int king = board.kings[color];
+  if (std::max(std::abs(File(king) - tf), std::abs(Rank(king) - tr)) == 1) {
+    return true;
+  }
+  for (int i = 0; i < board.count; ++i) {
+    if (board.colors[i] != color) {
+      continue;
+    }
+    const int f = File(board.squares[i]), r = Rank(board.squares[i]);
+    const int df = tf - f, dr = tr - r;
+    switch (board.types[i]) {
+    case Type::pawn:
+      if (std::abs(df) == 1 && dr == (color == 0 ? 1 : -1)) {
+        return true;
+      }
+      break;
+    case Type::knight:
+      if ((std::abs(df) == 1 && std::abs(dr) == 2) || (std::abs(df) == 2 && std::abs(dr) == 1)) {
+        return true;
+      }
+      break;
+    default: {
+      const bool straight = df == 0 || dr == 0;
+      const bool diagonal = std::abs(df) == std::abs(dr);
+      if ((df == 0 && dr == 0) || (!straight && !diagonal) ||
+          (straight && board.types[i] == Type::bishop) || (diagonal && board.types[i] == Type::rook)) {
+        break;
+      }
+      const int sf = (df > 0) - (df < 0), sr = (dr > 0) - (dr < 0);
+      bool blocked = false;
+      for (int x = f + sf, y = r + sr; x != tf || y != tr; x += sf, y += sr) {
+        if (board.PieceAt(x * 8 + y) >= 0) {
+          blocked = true;
+          break;
+        }
+      }
+      if (!blocked) {
+        return true;
+      }
+    }
+    }
+  }
+  return false;
+}
+
+// Both kings and all the pieces on their own squares, no pawn on the last ranks, the side not to move is not in check.
+bool Legal(const Board& board) {
+  if (board.kings[0] == board.kings[1]) {
+    return false;
+  }
+  for (int i = 0; i < board.count; ++i) {
+    const int s = board.squares[i];
+    if (s == board.kings[0] || s == board.kings[1] || (board.types[i] == Type::pawn && (Rank(s) == 0 || Rank(s) == 7))) {
+      return false;
+    }
+    for (int j = 0; j < i; ++j) {
+      if (board.squares[j] == s) {
+        return false;
+      }
+    }
+  }
+  return !Attacks(board, board.player, board.kings[1 - board.player]);
+}
+
+// The index of a normalized board has only one of the orders of the equal pieces.
+bool Ordered(const Board& board) {
+  return board.count < 2 || board.types[0] != board.types[1] || board.colors[0] != board.colors[1] ||
+         board.squares[0] < board.squares[1];
+}
+
+// Calls f(child) for every legal move of the side to move, the children are not normalized.
+template <typename F>
+void ForEachMove(const Board& board, F f) {
+  const int side = board.player;
+  auto emit = [&](Board child) {
+    child.player = 1 - side;
+    if (!Attacks(child, child.player, child.kings[side])) {
+      f(child);
+    }
+  };
+  auto moveto = [&](int piece, int target) { // piece -1 is the king, the target is empty or an enemy piece
+    Board child = board;
+    const int victim = board.PieceAt(target);
+    if (piece < 0) {
+      child.kings[side] = target;
+    } else {
+      child.squares[piece] = target;
+    }
+    if (victim >= 2) {
+      child.Remove(victim - 2);
+    }
+    emit(child);
+  };
+  auto steps = [&](int piece, int from, const int (*offsets)[2]) {
+    for (int k = 0; k < 8; ++k) {
+      const int x = File(from) + offsets[k][0], y = Rank(from) + offsets[k][1];
+      if (OnBoard(x, y)) {
+        const int color = board.ColorAt(x * 8 + y);
+        if (color != side && board.PieceAt(x * 8 + y) != 1 - side) {
+          moveto(piece, x * 8 + y);
+        }
+      }
+    }
+  };
+  steps(-1, board.kings[side], KingSteps);
+  for (int i = 0; i < board.count; ++i) {
+    if (board.colors[i] != side) {
+      continue;
+    }
+    const int from = board.squares[i];
+    const Type type = board.types[i];
+    if (type == Type::knight) {
+      steps(i, from, KnightSteps);
+    } else if (type == Type::pawn) {
+      const int dir = side == 0 ? 1 : -1;
+      const int f = File(from), r = Rank(from);
+      auto pawnto = [&](int target) {
+        if (Rank(target) == (side == 0 ? 7 : 0)) {
+          for (int promotion : Promotions) {
+            Board child = board;
+            child.squares[i] = target;
+            child.types[i] = static_cast<Type>(promotion);
+            const int victim = board.PieceAt(target);
+            if (victim >= 2) {
+              child.Remove(victim - 2);
+            }
+            emit(child);
+          }
+        } else {
+          moveto(i, target);
+        }
+      };
+      if (board.PieceAt(f * 8 + r + dir) < 0) {
+        pawnto(f * 8 + r + dir);
+        if (r == (side == 0 ? 1 : 6) && board.PieceAt(f * 8 + r + 2 * dir) < 0) {
+          moveto(i, f * 8 + r + 2 * dir);
+        }
+      }
+      for (int df : { -1, 1 }) {
+        if (OnBoard(f + df, r + dir)) {
+          const int target = (f + df) * 8 + r + dir;
+          const int victim = board.PieceAt(target);
+          if (victim >= 2 && board.colors[victim - 2] != side) {
+            pawnto(target);
+          }
+        }
+      }
+    } else {
+      for (const auto& d : KingSteps) {
+        const bool diagonal = d[0] != 0 && d[1] != 0;
+        if ((diagonal && type == Type::rook) || (!diagonal && type == Type::bishop)) {
+          continue;
+        }
+        for (int x = File(from) + d[0], y = Rank(from) + d[1]; OnBoard(x, y); x += d[0], y += d[1]) {
+          const int occupant = board.PieceAt(x * 8 + y);
+          if (occupant < 0) {
+            moveto(i, x * 8 + y);
+            continue;
+          }
+          if (occupant >= 2 && board.colors[occupant - 2] != side) {
+            moveto(i, x * 8 + y);
+          }
+          break;
+        }
+      }
+    }
+  }
+}
+
+// Calls f(parent) for every position whose quiet move of the side not to move leads to the board. No piece comes back
+// from a capture or a promotion, those moves leave the endgame. The parents are legal but not normalized.
+template <typename F>
+void ForEachUnmove(const Board& board, F f) {
+  const int side = 1 - board.player; // the side that has just moved
+  auto emit = [&](Board parent) {
+    parent.player = side;
+    if (Legal(parent)) {
+      f(parent);
+    }
+  };
+  auto moveback = [&](int piece, int target) {
+    Board parent = board;
+    if (piece < 0) {
+      parent.kings[side] = target;
+    } else {
+      parent.squares[piece] = target;
+    }
+    emit(parent);
+  };
+  auto steps = [&](int piece, int from, const int (*offsets)[2]) {
+    for (int k = 0; k < 8; ++k) {
+      const int x = File(from) + offsets[k][0], y = Rank(from) + offsets[k][1];
+      if (OnBoard(x, y) && board.PieceAt(x * 8 + y) < 0) {
+        moveback(piece, x * 8 + y);
+      }
+    }
+  };
+  steps(-1, board.kings[side], KingSteps);
+  for (int i = 0; i < board.count; ++i) {
+    if (board.colors[i] != side) {
+      continue;
+    }
+    const int from = board.squares[i];
+    const Type type = board.types[i];
+    if (type == Type::knight) {
+      steps(i, from, KnightSteps);
+    } else if (type == Type::pawn) {
+      const int dir = side == 0 ? 1 : -1;
+      const int f = File(from), r = Rank(from);
+      const int back = r - dir;
+      if (back >= 1 && back <= 6 && board.PieceAt(f * 8 + back) < 0) {
+        moveback(i, f * 8 + back);
+        if (r == (side == 0 ? 3 : 4) && board.PieceAt(f * 8 + back - dir) < 0) {
+          moveback(i, f * 8 + back - dir);
+        }
+      }
+    } else {
+      for (const auto& d : KingSteps) {
+        const bool diagonal = d[0] != 0 && d[1] != 0;
+        if ((diagonal && type == Type::rook) || (!diagonal && type == Type::bishop)) {
+          continue;
+        }
+        for (int x = File(from) + d[0], y = Rank(from) + d[1]; OnBoard(x, y) && board.PieceAt(x * 8 + y) < 0;
+             x += d[0], y += d[1]) {
+          moveback(i, x * 8 + y);
+        }
+      }
+    }
+  }
+}
+
+// Runs f(begin, end) over the parts of the range in the threads.
+template <typename F>
+void Parallel(int threads, size_t count, F f) {
+  if (threads <= 1 || count < 4096) {
+    f(size_t(0), count);
+    return;
+  }
+  boost::thread_group group;
+  const size_t part = (count + threads - 1) / threads;
+  for (int t = 0; t < threads; ++t) {
+    const size_t begin = std::min(count, t * part), end = std::min(count, begin + part);
+    group.create_thread([=]() { f(begin, end); });
+  }
+  group.join_all();
+}
+
+uint8_t Packed(BitbaseValue value) {
+  return static_cast<uint8_t>(value);
+}
+
+}
+
+std::string EndgameName(const Pieces& white, const Pieces& black) {
+  Board board;
+  for (const auto* side : { &white, &black }) {
+    for (const auto& piece : *side) {
+      if (piece.type == Type::king) {
+        continue;
+      }
+      if (board.count == MaxPieces) {
+        return std::string();
+      }
+      board.types[board.count] = piece.type;
+      board.colors[board.count] = side == &white ? 0 : 1;
+      ++board.count;
+    }
+  }
+  return BoardName(board);
+}
+
+bool CanonicalEndgame(const std::string& name) {
+  const size_t second = name.find('K', 1);
+  if (second == std::string::npos) {
+    return false;
+  }
+  auto value = [](const std::string& side) {
+    int sum = 0;
+    for (char c : side) {
+      sum += static_cast<int>(PieceOf(c));
+    }
+    return sum;
+  };
+  const std::string white = name.substr(1, second - 1), black = name.substr(second + 1);
+  return value(white) > value(black) || (value(white) == value(black) && white >= black);
+}
+
+std::string FlippedEndgame(const std::string& name) {
+  const size_t second = name.find('K', 1);
+  return second == std::string::npos ? name : name.substr(second) + name.substr(0, second);
+}
+
+// Converts the pieces of a position to the normalized board of its bitbase.
+bool ToBoard(const Pieces& white, const Pieces& black, Set player, Board& board) {
+  board = Board();
+  board.player = player == Set::white ? 0 : 1;
+  for (const auto* side : { &white, &black }) {
+    const int color = side == &white ? 0 : 1;
+    for (const auto& piece : *side) {
+      if (piece.type == Type::king) {
+        board.kings[color] = piece.position.pos();
+      } else if (board.count == MaxPieces) {
+        return false;
+      } else {
+        board.squares[board.count] = piece.position.pos();
+        board.types[board.count] = piece.type;
+        board.colors[board.count] = color;
+        ++board.count;
+      }
+    }
+  }
+  if (!CanonicalEndgame(BoardName(board))) {
+    board = Flip(board);
+  }
+  Normalize(board);
+  return true;
+}
+
+bool Bitbase::Open(const std::string& filename) {
+  using namespace boost::interprocess;
+  try {
+    file_mapping mapping(filename.c_str(), read_only);
+    mapped_region mapped(mapping, read_only);
+    if (mapped.get_size() < sizeof(BitbaseHeader)) {
+      return false;
+    }
+    const BitbaseHeader* header = static_cast<const BitbaseHeader*>(mapped.get_address());
+    Layout layout;
+    const std::string base(header->name, strnlen(header->name, sizeof(header->name)));
+    if (std::memcmp(header->magic, BaseMagic, sizeof(BaseMagic)) != 0 || header->version != BaseVersion ||
+        !ParseName(base, layout) || header->count != TableSize(layout.count) ||
+        mapped.get_size() < sizeof(BitbaseHeader) + (header->count + 3) / 4) {
+      return false;
+    }
+    name = base;
+    count = static_cast<size_t>(header->count);
+    values = reinterpret_cast<const uint8_t*>(header + 1);
+    file.swap(mapping);
+    region.swap(mapped);
+  } catch (const interprocess_exception&) {
+    return false;
+  }
+  return true;
+}
+
+BitbaseValue Bitbase::Probe(const Pieces& white, const Pieces& black, Set player) const {
+  Board board;
+  if (!values || !ToBoard(white, black, player, board) || BoardName(board) != name || !Ordered(board)) {
+    return BitbaseValue::illegal;
+  }
+  const size_t index = Index(board);
+  return static_cast<BitbaseValue>((values[index / 4] >> (index % 4 * 2)) & 3);
+}
+
+size_t Bitbases::Load(const std::string& directory) {
+  namespace fs = boost::filesystem;
+  boost::system::error_code error;
+  for (fs::directory_iterator entry(directory, error), end; !error && entry != end; entry.increment(error)) {
+    if (entry->path().extension() == ".bitbase") {
+      std::unique_ptr<Bitbase> base(new Bitbase);
+      if (base->Open(entry->path().string())) {
+        bases[base->Name()] = std::move(base);
+      }
+    }
+  }
+  return bases.size();
+}
+
+bool Bitbases::Probe(const IMachine& position, BitbaseValue& value) const {
+  if (bases.empty()) {
+    return false;
+  }
+  const Pieces white = position.GetSet(Set::white);
+  const Pieces black = position.GetSet(Set::black);
+  return white.size() + black.size() <= 2 + MaxPieces && Probe(white, black, position.CurrentPlayer(), value);
+}
+
+bool Bitbases::Probe(const Pieces& white, const Pieces& black, Set player, BitbaseValue& value) const {
+  std::string name = EndgameName(white, black);
+  if (name.empty()) {
+    return false;
+  }
+  if (name == "KK") {
+    value = BitbaseValue::draw;
+    return true;
+  }
+  if (!CanonicalEndgame(name)) {
+    name = FlippedEndgame(name);
+  }
+  auto base = bases.find(name);
+  if (base == bases.end()) {
+    return false;
+  }
+  value = base->second->Probe(white, black, player);
+  return value != BitbaseValue::illegal;
+}
+
+struct BitbaseGenerator::Table {
+  Layout layout;
+  std::vector<std::atomic<uint8_t>> values; // BitbaseValue or Unknown
+
+  explicit Table(size_t size) : values(size) {}
+};
+
+BitbaseGenerator::BitbaseGenerator(int workers)
+  : threads(workers > 0 ? workers : std::max(1, static_cast<int>(boost::thread::hardware_concurrency()))) {
+}
+
+BitbaseGenerator::~BitbaseGenerator() {
+}
+
+bool BitbaseGenerator::Generate(const std::string& endgame, const std::string& directory) {
+  Layout layout;
+  if (!ParseName(endgame, layout) || layout.count == 0) {
+    return false;
+  }
+  const std::string name = CanonicalEndgame(endgame) ? endgame : FlippedEndgame(endgame);
+  if (tables.find(name) != tables.end()) {
+    return true; // built and written before with another endgame
+  }
+  bool pawns[2] = { false, false };
+  for (int i = 0; i < layout.count; ++i) {
+    pawns[layout.colors[i]] |= layout.types[i] == Type::pawn;
+  }
+  if (pawns[0] && pawns[1]) {
+    return false;
+  }
+  const size_t before = stats.size();
+  Build(name, true);
+  // The files of the endgames built by this call, the smaller ones first.
+  for (size_t i = before; i < stats.size(); ++i) {
+    BitbaseStats& s = stats[i];
+    const Table& table = *tables.at(s.name);
+    BitbaseHeader header = {};
+    std::memcpy(header.magic, BaseMagic, sizeof(BaseMagic));
+    header.version = BaseVersion;
+    std::strncpy(header.name, s.name.c_str(), sizeof(header.name));
+    header.pieces = static_cast<uint32_t>(table.layout.count + 2);
+    header.count = table.values.size();
+    std::vector<uint8_t> packed((table.values.size() + 3) / 4, 0);
+    for (size_t index = 0; index < table.values.size(); ++index) {
+      const uint8_t value = table.values[index].load(std::memory_order_relaxed);
+      packed[index / 4] |= Packed(static_cast<BitbaseValue>(value)) << (index % 4 * 2);
+    }
+    const std::string filename = (boost::filesystem::path(directory) / (s.name + ".bitbase")).string();
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+    if (!file) {
+      return false;
+    }
+    s.bytes = sizeof(header) + packed.size();
+  }
+  return true;
+}
+
+std::vector<BitbaseValue> BitbaseGenerator::Values(const std::string& name) const {
+  std::vector<BitbaseValue> result;
+  auto table = tables.find(name);
+  if (table != tables.end()) {
+    result.reserve(table->second->values.size());
+    for (const auto& value : table->second->values) {
+      result.push_back(static_cast<BitbaseValue>(value.load(std::memory_order_relaxed)));
+    }
+  }
+  return result;
+}
+
+std::vector<BitbaseValue> BitbaseGenerator::Solve(const std::string& name) {
+  std::unique_ptr<Table> generated;
+  auto table = tables.find(name);
+  if (table != tables.end()) {
+    generated.swap(table->second);
+    tables.erase(table);
+  }
+  Build(name, false);
+  std::vector<BitbaseValue> result = Values(name);
+  stats.pop_back();
+  if (generated) {
+    tables[name].swap(generated);
+  }
+  return result;
+}
+
+BitbaseGenerator::Table& BitbaseGenerator::Build(const std::string& name, bool retrograde) {
+  Layout layout;
+  ParseName(name, layout);
+  // The endgames the captures and the promotions lead to.
+  for (int i = 0; i < layout.count; ++i) {
+    Board board;
+    board.count = layout.count;
+    board.types = layout.types;
+    board.colors = layout.colors;
+    std::vector<Board> smaller;
+    Board captured = board;
+    captured.Remove(i);
+    smaller.push_back(captured);
+    if (layout.types[i] == Type::pawn) {
+      for (int promotion : Promotions) {
+        Board promoted = board;
+        promoted.types[i] = static_cast<Type>(promotion);
+        smaller.push_back(promoted);
+      }
+    }
+    for (const auto& b : smaller) {
+      const std::string next = CanonicalEndgame(BoardName(b)) ? BoardName(b) : FlippedEndgame(BoardName(b));
+      if (next != "KK" && tables.find(next) == tables.end()) {
+        Build(next, true);
+      }
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<Table> created(new Table(TableSize(layout.count)));
+  Table& table = *created;
+  table.layout = layout;
+  tables[name] = std::move(created);
+  auto& values = table.values;
+
+  // The value of a position of any endgame for the side to move.
+  auto lookup = [&](Board board) -> uint8_t {
+    if (board.count == 0) {
+      return Packed(BitbaseValue::draw);
+    }
+    std::string endgame = BoardName(board);
+    if (!CanonicalEndgame(endgame)) {
+      board = Flip(board);
+      endgame = FlippedEndgame(endgame);
+    }
+    Normalize(board);
+    const Table& t = endgame == name ? table : *tables.at(endgame);
+    return t.values[Index(board)].load(std::memory_order_relaxed);
+  };
+  // Win if a move leads to a loss, loss if all the moves lead to wins of the opponent or mate, draw if stalemate.
+  auto evaluate = [&](const Board& board) -> uint8_t {
+    int moves = 0;
+    bool allwins = true;
+    bool win = false;
+    ForEachMove(board, [&](const Board& child) {
+      const uint8_t value = lookup(child);
+      ++moves;
+      win |= value == Packed(BitbaseValue::loss);
+      allwins &= value == Packed(BitbaseValue::win);
+    });
+    if (win) {
+      return Packed(BitbaseValue::win);
+    }
+    if (moves == 0) {
+      return Attacks(board, 1 - board.player, board.kings[board.player]) ? Packed(BitbaseValue::loss)
+                                                                          : Packed(BitbaseValue::draw);
+    }
+    return allwins ? Packed(BitbaseValue::loss) : Unknown;
+  };
+
+  // The positions decided by their moves alone: mates, stalemates and the moves to the other endgames.
+  Parallel(threads, values.size(), [&](size_t begin, size_t end) {
+    for (size_t index = begin; index < end; ++index) {
+      const Board board = Decode(layout, index);
+      values[index].store(Ordered(board) && Legal(board) ? Unknown : Packed(BitbaseValue::illegal),
+                          std::memory_order_relaxed);
+    }
+  });
+  std::vector<std::vector<size_t>> found(threads);
+  std::atomic<int> part(0);
+  Parallel(threads, values.size(), [&](size_t begin, size_t end) {
+    std::vector<size_t>& local = found[part++];
+    for (size_t index = begin; index < end; ++index) {
+      if (values[index].load(std::memory_order_relaxed) == Unknown) {
+        const uint8_t value = evaluate(Decode(layout, index));
+        if (value != Unknown) {
+          values[index].store(value, std::memory_order_relaxed);
+          local.push_back(index);
+        }
+      }
+    }
+  });
+
+  if (retrograde) {
+    // Every pass takes back the moves leading to the positions decided by the previous one.
+    std::vector<size_t> frontier;
+    for (const auto& local : found) {
+      frontier.insert(frontier.end(), local.begin(), local.end());
+    }
+    while (!frontier.empty()) {
+      std::vector<std::vector<size_t>> next(threads);
+      std::atomic<int> nextpart(0);
+      Parallel(threads, frontier.size(), [&](size_t begin, size_t end) {
+        std::vector<size_t>& local = next[nextpart++];
+        for (size_t i = begin; i < end; ++i) {
+          const size_t child = frontier[i];
+          const uint8_t childvalue = values[child].load(std::memory_order_relaxed);
+          if (childvalue == Packed(BitbaseValue::draw)) {
+            continue;
+          }
+          ForEachUnmove(Decode(layout, child), [&](Board parent) {
+            Normalize(parent);
+            const size_t index = Index(parent);
+            uint8_t expected = Unknown;
+            if (values[index].load(std::memory_order_relaxed) != Unknown) {
+              return;
+            }
+            const uint8_t value = childvalue == Packed(BitbaseValue::loss) ? Packed(BitbaseValue::win) : evaluate(parent);
+            if (value != Unknown && values[index].compare_exchange_strong(expected, value)) {
+              local.push_back(index);
+            }
+          });
+        }
+      });
+      frontier.clear();
+      for (const auto& local : next) {
+        frontier.insert(frontier.end(), local.begin(), local.end());
+      }
+    }
+  } else {
+    // The plain iteration: every pass evaluates all the positions not known yet.
+    for (bool changed = true; changed; ) {
+      changed = false;
+      for (size_t index = 0; index < values.size(); ++index) {
+        if (values[index].load(std::memory_order_relaxed) == Unknown) {
+          const uint8_t value = evaluate(Decode(layout, index));
+          if (value != Unknown) {
+            values[index].store(value, std::memory_order_relaxed);
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  BitbaseStats s;
+  s.name = name;
+  for (auto& value : values) {
+    uint8_t v = value.load(std::memory_order_relaxed);
+    if (v == Unknown) {
+      v = Packed(BitbaseValue::draw);
+      value.store(v, std::memory_order_relaxed);
+    }
+    s.positions += v != Packed(BitbaseValue::illegal);
+    s.wins += v == Packed(BitbaseValue::win);
+    s.draws += v == Packed(BitbaseValue::draw);
+    s.losses += v == Packed(BitbaseValue::loss);
+  }
+  s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  stats.push_back(s);
+  return table;
+}
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+// The result of an endgame position for the side to move with the best play of both sides.
+enum class BitbaseValue : uint8_t { draw, win, loss, illegal };
+
+/**
+  Names of the endgames: the white king with the white pieces, then the black king with the black pieces, the pieces
+  of a side from the queen down to the pawn, "KRKN" for example. The bitbase of an endgame keeps the stronger side as
+  white, the positions of the other color are flipped over.
+*/
+std::string EndgameName(const Pieces& white, const Pieces& black);
+bool CanonicalEndgame(const std::string& name); // the stronger side is white, so the bitbase is kept under this name
+std::string FlippedEndgame(const std::string& name);
+
+struct BitbaseHeader {
+    char magic[8]; // "ChaiBase"
+    uint32_t version;
+    char name[8];  // the endgame
+    uint32_t pieces;
+    uint64_t count; // positions, four of them in a byte
+};
+
+/**
+  Win, draw and loss of every position of an endgame, mapped into the memory.
+
+  The position index is made of the side to move, the white king on the files a-d (the positions with the king on the
+  other half of the board are mirrored), the black king and the other pieces. Equal pieces of a side are indexed in
+  the order of their squares. Castling and en passant are not taken into account.
+*/
+class Bitbase {
+ public:
+    Bitbase() : values(nullptr), count(0) {}
+    Bitbase(const Bitbase&) = delete;
+    Bitbase& operator=(const Bitbase&) = delete;
+
+    bool Open(const std::string& filename); // false if the file is missing or is not a bitbase
+    const std::string& Name() const {
+        return name;
+    }
+    size_t Size() const {
+        return count;
+    }
+    BitbaseValue Probe(const Pieces& white, const Pieces& black, Set player) const; // the position of this endgame
+
+ private:
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    std::string name;
+    const uint8_t* values;
+    size_t count;
+};
+
+// The bitbases of a directory, looked up by the endgame of the position.
+class Bitbases {
+ public:
+    size_t Load(const std::string& directory); // Returns the number of the bitbases found.
+    size_t Size() const {
+        return bases.size();
+    }
+    bool Probe(const IMachine& position, BitbaseValue& value) const; // false if there is no bitbase of the endgame
+    bool Probe(const Pieces& white, const Pieces& black, Set player, BitbaseValue& value) const;
+
+ private:
+    std::map<std::string, std::unique_ptr<Bitbase>> bases;
+};
+
+struct BitbaseStats {
+    std::string name;
+    size_t positions = 0; // legal ones
+    size_t wins = 0;
+    size_t draws = 0;
+    size_t losses = 0;
+    double seconds = 0;
+    size_t bytes = 0; // of the file
+};
+
+/**
+  Retrograde analysis of the endgames of three and four pieces.
+
+  The mates are found first, then the wins and losses spread backwards by the moves taken back, one ply per pass, with
+  the positions of a pass shared by the threads. The captures and promotions lead to the smaller or other endgames,
+  which are generated before. The endgames with the pawns of both sides are not generated, en passant is not known.
+*/
+class BitbaseGenerator {
+ public:
+    explicit BitbaseGenerator(int threads = 0);
+    ~BitbaseGenerator();
+
+    // Generates the endgame with all the endgames it turns into and writes their files into the directory.
+    bool Generate(const std::string& name, const std::string& directory);
+    const std::vector<BitbaseStats>& Stats() const {
+        return stats;
+    }
+    // The values of the endgame generated before, indexed as in the file. Solve finds them by the plain iteration of
+    // all the positions until nothing changes, to check the retrograde analysis.
+    std::vector<BitbaseValue> Values(const std::string& name) const;
+    std::vector<BitbaseValue> Solve(const std::string& name);
+
+ private:
+    struct Table;
+    Table& Build(const std::string& name, bool retrograde);
+
+    const int threads;
+    std::map<std::string, std::unique_ptr<Table>> tables;
+    std::vector<BitbaseStats> stats;
+};
+
+} // namespace Chess
+} // namespace Chai
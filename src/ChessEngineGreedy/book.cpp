@@ -0,0 +1,303 @@
+#include "book.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const char BookMagic[8] = { 'C', 'h', 'a', 'i', 'B', 'o', 'o', 'k' };
+const uint32_t BookVersion = 1;
+
+Position SquareOf(int pos) {
+  return Position((pos >> 3) << 4 | (pos & 7));
+}
+
+bool ByKeyAndMove(const BookEntry& a, const BookEntry& b) {
+  return a.key < b.key || (a.key == b.key && a.move < b.move);
+}
+
+// The same moves of the same positions are summed up, then the moves of a position are ordered by the weight.
+void MergeEntries(std::vector<BookEntry>& entries) {
+  std::sort(entries.begin(), entries.end(), ByKeyAndMove);
+  size_t merged = 0;
+  for (const auto& e : entries) {
+    if (merged > 0 && entries[merged - 1].key == e.key && entries[merged - 1].move == e.move) {
+      entries[merged - 1].weight += e.weight;
+    } else {
+      entries[merged++] = e;
+    }
+  }
+  entries.resize(merged);
+}
+
+Type PieceType(char letter) {
+  switch (letter) {
+  case 'N': return Type::knight;
+  case 'B': return Type::bishop;
+  case 'R': return Type::rook;
+  case 'Q': return Type::queen;
+  case 'K': return Type::king;
+  default:  return Type::bad;
+  }
+}
+
+}
+
+uint16_t PackBookMove(Position from, Position to, Type promotion) {
+  return static_cast<uint16_t>(from.pos() | to.pos() << 6 | static_cast<int>(promotion) << 12);
+}
+
+void UnpackBookMove(uint16_t move, Position& from, Position& to, Type& promotion) {
+  from = SquareOf(move & 63);
+  to = SquareOf((move >> 6) & 63);
+  promotion = static_cast<Type>(move >> 12);
+}
+
+bool OpeningBook::Open(const std::string& filename) {
+  using namespace boost::interprocess;
+  Close();
+  try {
+    file_mapping mapping(filename.c_str(), read_only);
+    mapped_region mapped(mapping, read_only);
+    if (mapped.get_size() < sizeof(BookHeader)) {
+      return false;
+    }
+    const BookHeader* header = static_cast<const BookHeader*>(mapped.get_address());
+    if (std::memcmp(header->magic, BookMagic, sizeof(BookMagic)) != 0 || header->version != BookVersion ||
+        header->entrysize != sizeof(BookEntry) ||
+        mapped.get_size() < sizeof(BookHeader) + header->count * sizeof(BookEntry)) {
+      return false;
+    }
+    count = static_cast<size_t>(header->count);
+    entries = reinterpret_cast<const BookEntry*>(header + 1);
+    file.swap(mapping);
+    region.swap(mapped);
+  } catch (const interprocess_exception&) {
+    return false;
+  }
+  return true;
+}
+
+void OpeningBook::Close() {
+  region = boost::interprocess::mapped_region();
+  file = boost::interprocess::file_mapping();
+  entries = nullptr;
+  count = 0;
+}
+
+std::vector<BookEntry> OpeningBook::Probe(uint64_t key) const {
+  auto range = std::equal_range(entries, entries + count, BookEntry{ key, 0, 0, 0 },
+                                [](const BookEntry& a, const BookEntry& b) { return a.key < b.key; });
+  return std::vector<BookEntry>(range.first, range.second);
+}
+
+BookBuilder::BookBuilder(const IMachine& position, int plies, int workers)
+  : start(position.SlightClone()), maxply(plies),
+    threads(workers > 0 ? workers : std::max(1, static_cast<int>(boost::thread::hardware_concurrency()))), games(0) {
+}
+
+size_t BookBuilder::AddGames(const std::string& pgn) {
+  const std::vector<Game> list = ParseGames(pgn);
+  std::vector<std::vector<BookEntry>> found(threads);
+  boost::thread_group group;
+  for (int i = 0; i < threads; ++i) {
+    group.create_thread([&, i]() { ReplayGames(list, i, threads, found[i]); });
+  }
+  group.join_all();
+  for (const auto& f : found) {
+    moves.insert(moves.end(), f.begin(), f.end());
+  }
+  MergeEntries(moves);
+  games += list.size();
+  return list.size();
+}
+
+bool BookBuilder::AddFile(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::ostringstream text;
+  text << file.rdbuf();
+  AddGames(text.str());
+  return true;
+}
+
+std::vector<BookEntry> BookBuilder::Entries() const {
+  std::vector<BookEntry> entries;
+  std::copy_if(moves.begin(), moves.end(), std::back_inserter(entries), [](const BookEntry& e) { return e.weight > 0; });
+  std::stable_sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+    return a.key < b.key || (a.key == b.key && a.weight > b.weight);
+  });
+  return entries;
+}
+
+bool BookBuilder::Write(const std::string& filename) const {
+  const std::vector<BookEntry> entries = Entries();
+  BookHeader header = {};
+  std::memcpy(header.magic, BookMagic, sizeof(BookMagic));
+  header.version = BookVersion;
+  header.entrysize = sizeof(BookEntry);
+  header.count = entries.size();
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(BookEntry));
+  return static_cast<bool>(file);
+}
+
+// Splits the text into the games by the result tokens and the tag sections, only the moves and the result are kept.
+std::vector<BookBuilder::Game> BookBuilder::ParseGames(const std::string& pgn) {
+  std::vector<Game> list;
+  Game game{ {}, 1 };
+  bool tags = false;
+  int variation = 0;
+  auto finish = [&](int result) {
+    if (!game.moves.empty()) {
+      game.result = result;
+      list.push_back(game);
+    }
+    game = Game{ {}, 1 };
+  };
+  for (size_t i = 0; i < pgn.size(); ) {
+    const char c = pgn[i];
+    if (c == '{') { // a comment
+      const size_t end = pgn.find('}', i);
+      i = end == std::string::npos ? pgn.size() : end + 1;
+    } else if (c == ';' || (c == '%' && (i == 0 || pgn[i - 1] == '\n'))) { // a comment or an escape up to the line end
+      const size_t end = pgn.find('\n', i);
+      i = end == std::string::npos ? pgn.size() : end + 1;
+    } else if (c == '[') { // a tag, the tags of the next game end the previous one
+      if (!tags) {
+        finish(1);
+        tags = true;
+      }
+      const size_t end = pgn.find(']', i);
+      i = end == std::string::npos ? pgn.size() : end + 1;
+    } else if (c == '(') {
+      ++variation;
+      ++i;
+    } else if (c == ')') {
+      variation = std::max(0, variation - 1);
+      ++i;
+    } else if (std::isspace(static_cast<unsigned char>(c))) {
+      ++i;
+    } else {
+      size_t end = i;
+      while (end < pgn.size() && !std::isspace(static_cast<unsigned char>(pgn[end])) &&
+             std::strchr("{}()[];", pgn[end]) == nullptr) {
+        ++end;
+      }
+      std::string token = pgn.substr(i, end - i);
+      i = end;
+      if (variation > 0) {
+        continue;
+      }
+      tags = false;
+      if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+        finish(token == "1-0" ? 2 : token == "0-1" ? 0 : 1);
+        continue;
+      }
+      // Move numbers "12." and "12...", the annotations "$1", "!?", the check marks.
+      const size_t dots = token.find_last_of('.');
+      if (dots != std::string::npos) {
+        token.erase(0, dots + 1);
+      }
+      while (!token.empty() && std::strchr("+#!?", token.back()) != nullptr) {
+        token.pop_back();
+      }
+      if (token.empty() || token[0] == '$' || (std::isdigit(static_cast<unsigned char>(token[0])) && token[0] != '0')) {
+        continue;
+      }
+      if (token == "0-0" || token == "0-0-0") {
+        token = token == "0-0" ? "O-O" : "O-O-O";
+      }
+      game.moves.push_back(token);
+    }
+  }
+  finish(1);
+  return list;
+}
+
+// Standard algebraic notation: the piece letter, the disambiguation, the capture mark, the target and the promotion.
+bool BookBuilder::FindMove(const IMachine& position, const std::string& san, Type& type, Position& from, Position& to,
+                           Type& promotion) {
+  const char rank = position.CurrentPlayer() == Set::white ? '1' : '8';
+  promotion = Type::bad;
+  if (san == "O-O" || san == "O-O-O") {
+    type = Type::king;
+    from = Position('e', rank);
+    to = Position(san == "O-O" ? 'g' : 'c', rank);
+    return true;
+  }
+  std::string text = san;
+  const size_t eq = text.find('=');
+  if (eq != std::string::npos) {
+    if (eq + 1 >= text.size() || (promotion = PieceType(text[eq + 1])) == Type::bad) {
+      return false;
+    }
+    text.erase(eq);
+  }
+  type = PieceType(text.empty() ? 0 : text[0]);
+  if (type == Type::bad) {
+    type = Type::pawn;
+  } else {
+    text.erase(0, 1);
+  }
+  text.erase(std::remove(text.begin(), text.end(), 'x'), text.end());
+  if (text.size() < 2 || text[text.size() - 2] < 'a' || text[text.size() - 2] > 'h' || text.back() < '1' ||
+      text.back() > '8') {
+    return false;
+  }
+  to = Position(text[text.size() - 2], text.back());
+  text.erase(text.size() - 2);
+  // A pawn moving without the file of departure goes straight ahead.
+  if (type == Type::pawn && text.empty()) {
+    text = std::string(1, to.file());
+  }
+  int found = 0;
+  for (const auto& piece : position.GetSet(position.CurrentPlayer())) {
+    if (piece.type != type || (text.find_first_of("abcdefgh") != std::string::npos &&
+                               text.find(piece.position.file()) == std::string::npos) ||
+        (text.find_first_of("12345678") != std::string::npos && text.find(piece.position.rank()) == std::string::npos)) {
+      continue;
+    }
+    const PieceMoves targets = position.EnumMoves(piece.position);
+    if (std::find(targets.begin(), targets.end(), to) != targets.end()) {
+      from = piece.position;
+      ++found;
+    }
+  }
+  return found == 1;
+}
+
+void BookBuilder::ReplayGames(const std::vector<Game>& list, size_t first, size_t step,
+                              std::vector<BookEntry>& found) const {
+  for (size_t g = first; g < list.size(); g += step) {
+    const Game& game = list[g];
+    boost::shared_ptr<IMachine> position = start->SlightClone();
+    for (int ply = 0; ply < maxply && ply < static_cast<int>(game.moves.size()); ++ply) {
+      Type type;
+      Position from, to;
+      Type promotion;
+      const uint64_t key = position->PositionKey();
+      const bool white = position->CurrentPlayer() == Set::white;
+      if (!FindMove(*position, game.moves[ply], type, from, to, promotion) ||
+          !position->Move(type, from, to, promotion)) {
+        break;
+      }
+      const uint32_t weight = static_cast<uint32_t>(white ? game.result : 2 - game.result);
+      found.push_back(BookEntry{ key, PackBookMove(from, to, promotion), 0, weight });
+    }
+  }
+}
+
+}
+}
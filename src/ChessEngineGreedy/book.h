@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+/**
+  A move of the opening book file.
+
+  The file is a header followed by the entries sorted by the position key and then by the weight, the heaviest first.
+  The keys are the Zobrist keys of IMachine::PositionKey, the numbers are in the byte order of the machine that built
+  the book.
+*/
+struct BookEntry {
+    uint64_t key;    // the position before the move
+    uint16_t move;   // from | to << 6 | promotion << 12, the squares numbered by Position::pos
+    uint16_t unused;
+    uint32_t weight; // two points for every win of the side making the move, one for every draw
+};
+
+struct BookHeader {
+    char magic[8]; // "ChaiBook"
+    uint32_t version;
+    uint32_t entrysize;
+    uint64_t count;
+};
+
+uint16_t PackBookMove(Position from, Position to, Type promotion);
+void UnpackBookMove(uint16_t move, Position& from, Position& to, Type& promotion);
+
+/**
+  Opening book mapped into the memory, the moves of a position are found by the binary search over the mapped file.
+*/
+class OpeningBook {
+ public:
+    OpeningBook() : entries(nullptr), count(0) {}
+    OpeningBook(const OpeningBook&) = delete;
+    OpeningBook& operator=(const OpeningBook&) = delete;
+
+    bool Open(const std::string& filename); // false if the file is missing or is not a book
+    void Close();
+    size_t Size() const {
+        return count;
+    }
+
+    // The moves of the position, the heaviest first.
+    std::vector<BookEntry> Probe(uint64_t key) const;
+
+ private:
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const BookEntry* entries;
+    size_t count;
+};
+
+/**
+  Collects the moves of the first plies of the games in the PGN format and writes them as the opening book.
+
+  The games are replayed on the clones of the start position by several threads at once. The tags, comments,
+  variations and annotations are skipped, a game stops at the first move that is not legal.
+*/
+class BookBuilder {
+ public:
+    explicit BookBuilder(const IMachine& start, int maxply = 24, int threads = 0);
+
+    size_t AddGames(const std::string& pgn); // Returns the number of the games replayed.
+    bool AddFile(const std::string& filename);
+    bool Write(const std::string& filename) const;
+
+    size_t Games() const {
+        return games;
+    }
+    std::vector<BookEntry> Entries() const; // sorted as in the file
+
+ private:
+    struct Game {
+        std::vector<std::string> moves;
+        int result; // the points of white: 2 win, 1 draw or unknown, 0 loss
+    };
+    static std::vector<Game> ParseGames(const std::string& pgn);
+    static bool FindMove(const IMachine& position, const std::string& san, Type& type, Position& from, Position& to,
+                         Type& promotion);
+    void ReplayGames(const std::vector<Game>& list, size_t first, size_t step, std::vector<BookEntry>& found) const;
+
+    boost::shared_ptr<IMachine> start;
+    const int maxply;
+    const int threads;
+    std::vector<BookEntry> moves; // the moves of the games, the same moves merged after every batch of the games
+    size_t games;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -1,146 +1,707 @@
 #include "engine.h"
 
-#include <boost/container/flat_set.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
 
 namespace Chai {
 namespace Chess {
 
-GreedyEngine::GreedyEngine() : callBack(nullptr), aborted(false) {
+namespace {
+
+// Whether the piece standing at 'from' attacks the 'target' square on the given board occupancy.
+bool Attacks(Type type, Set set, Position from, Position target, const std::array<bool, 64>& occupied) {
+  const int dx = target.x() - from.x();
+  const int dy = target.y() - from.y();
+  switch (type) {
+  case Type::pawn:    return std::abs(dx) == 1 && dy == (set == Set::white ? 1 : -1);
+  case Type::knight:  return std::abs(dx * dy) == 2;
+  case Type::king:    return std::max(std::abs(dx), std::abs(dy)) == 1;
+  case Type::bishop:  if (std::abs(dx) != std::abs(dy)) return false; break;
+  case Type::rook:    if (dx != 0 && dy != 0) return false; break;
+  case Type::queen:   if (std::abs(dx) != std::abs(dy) && dx != 0 && dy != 0) return false; break;
+  default:            return false;
+  }
+  if (dx == 0 && dy == 0) {
+    return false;
+  }
+  const int sx = (dx > 0) - (dx < 0);
+  const int sy = (dy > 0) - (dy < 0);
+  for (int x = from.x() + sx, y = from.y() + sy; x != target.x() || y != target.y(); x += sx, y += sy) {
+    if (occupied[(x << 3) + y]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::array<bool, 64> Occupancy(const Pieces& pieces, const Pieces& xpieces) {
+  std::array<bool, 64> occupied = {};
+  for (const auto& p : pieces) {
+    occupied[p.position.pos()] = true;
+  }
+  for (const auto& p : xpieces) {
+    occupied[p.position.pos()] = true;
+  }
+  return occupied;
+}
+
+// Direct check only, discovered checks are not detected.
+bool GivesCheck(const Move& move, Set set, const Pieces& xpieces, std::array<bool, 64>& occupied) {
+  auto xking = std::find_if(xpieces.begin(), xpieces.end(), [](const auto& p) { return p.type == Type::king; });
+  if (xking == xpieces.end()) {
+    return false;
+  }
+  occupied[move.piece.position.pos()] = false;
+  const bool check = Attacks(move.promotion != Type::bad ? move.promotion : move.piece.type, set, move.to, xking->position, occupied);
+  occupied[move.piece.position.pos()] = true;
+  return check;
+}
+
+// The piece taken by the move, the pawn passed by en passant included, nullptr for a quiet move.
+const Piece* CapturedPiece(const Move& move, const Pieces& xpieces) {
+  auto captured = std::find_if(xpieces.begin(), xpieces.end(), [&](const Piece& p) { return p.position == move.to; });
+  if (captured == xpieces.end() && move.piece.type == Type::pawn && move.piece.position.x() != move.to.x()) {
+    // En passant, the pawn is taken beside the square of the move.
+    const Position passed((move.to.x() << 4) | move.piece.position.y());
+    captured = std::find_if(xpieces.begin(), xpieces.end(), [&](const Piece& p) { return p.position == passed; });
+  }
+  return captured != xpieces.end() ? &*captured : nullptr;
+}
+
+bool SameMove(const Move& a, const Move& b) {
+  return a.piece.position == b.piece.position && a.to == b.to && a.promotion == b.promotion;
+}
+
+EvalParams ReadParams(const std::string& filename) {
+  EvalParams params = EvalParams::Default();
+  if (!filename.empty()) {
+    params.Read(filename); // the hand-set weights stay if the file is missing
+  }
+  return params;
+}
+
+uint64_t ToBits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float FromBits(uint64_t bits) {
+  const uint32_t low = static_cast<uint32_t>(bits);
+  float value;
+  std::memcpy(&value, &low, sizeof(value));
+  return value;
+}
+
+// A search result in the transposition table: the score bits, the remaining depth and the kind of the bound in the first
+// word, the best move in the second one.
+enum Bound { upperbound = 1, lowerbound = 2, exactbound = 3 };
+
+HashCache<2>::Data PackTransposition(float score, int depth, Bound bound, const Move* best) {
+  HashCache<2>::Data data;
+  data[0] = ToBits(score) | static_cast<uint64_t>(depth) << 32 | static_cast<uint64_t>(bound) << 40;
+  data[1] = best ? 1 | best->piece.position.pos() << 1 | best->to.pos() << 7 | static_cast<uint64_t>(best->promotion) << 13 : 0;
+  return data;
+}
+
+float TranspositionScore(const HashCache<2>::Data& data) {
+  return FromBits(data[0]);
+}
+
+int TranspositionDepth(const HashCache<2>::Data& data) {
+  return static_cast<int>((data[0] >> 32) & 0xff);
+}
+
+Bound TranspositionBound(const HashCache<2>::Data& data) {
+  return static_cast<Bound>((data[0] >> 40) & 3);
+}
+
+bool TranspositionMove(const HashCache<2>::Data& data, const Move& move) {
+  return (data[1] & 1) && move.piece.position.pos() == static_cast<int>((data[1] >> 1) & 63) &&
+         move.to.pos() == static_cast<int>((data[1] >> 7) & 63) &&
+         move.promotion == static_cast<Type>((data[1] >> 13) & 0xff);
+}
+
+// Weights of the pawn structure.
+const float PassedPawn[8] = { 0.0f, 0.05f, 0.05f, 0.10f, 0.20f, 0.35f, 0.60f, 0.0f }; // by the rank from the own side
+const float DoubledPawn = -0.10f;  // for every pawn behind another one on the same file
+const float IsolatedPawn = -0.12f; // no own pawns on the neighbour files
+const float BackwardPawn = -0.08f; // the neighbours are ahead and an enemy pawn guards the square in front
+const float ShieldPawn[2] = { 0.04f, 0.02f }; // own pawns one and two ranks in front of the king on its first ranks
+
+// Zobrist keys of the pawns, indexed by side and square.
+const std::array<uint64_t, 128>& PawnKeys() {
+  static const std::array<uint64_t, 128> keys = [] {
+    std::array<uint64_t, 128> k;
+    uint64_t seed = 0x2545f4914f6cdd1dull;
+    for (auto& key : k) {
+      uint64_t z = (seed += 0x9e3779b97f4a7c15ull); // SplitMix64
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      key = z ^ (z >> 31);
+    }
+    return k;
+  }();
+  return keys;
+}
+
+uint64_t PawnKey(int side, Position position) {
+  return PawnKeys()[side * 64 + position.pos()];
+}
+
+const float LosingCapture = 100.0f; // moves the captures losing the exchange behind the quiet moves in the order
+
+int Millipawns(float weight) {
+  return static_cast<int>(std::lround(weight * 1000));
+}
+
+// Code of the piece in the weights of the batch evaluation.
+int BatchCode(Set set, Type type) {
+  int code = 0;
+  switch (type) {
+  case Type::pawn:    code = 1; break;
+  case Type::knight:  code = 2; break;
+  case Type::bishop:  code = 3; break;
+  case Type::rook:    code = 4; break;
+  case Type::queen:   code = 5; break;
+  case Type::king:    code = 6; break;
+  default:            assert(!"Bad piece type");
+  }
+  return set == Set::white ? code : code + 6;
+}
+
+const float ZeroWindow = 0.0001f;
+const size_t ClockNodes = 16; // Nodes between the clock checks of the progress reports.
+const float KnownWin = 50.0f; // The score of a won endgame of the bitbases, above any material balance.
+
+SearchStatistics SumStatistics(const std::vector<SearchStatCounters>& counters) {
+  std::array<size_t, static_cast<size_t>(SearchStat::count)> sums{};
+  for (const auto& c : counters) {
+    for (size_t i = 0; i < sums.size(); ++i) {
+      sums[i] += c.values[i];
+    }
+  }
+  auto sum = [&](SearchStat stat) { return sums[static_cast<size_t>(stat)]; };
+  SearchStatistics statistics;
+  statistics.nodes = sum(SearchStat::nodes);
+  statistics.evaluations = sum(SearchStat::evaluations);
+  statistics.betacutoffs = sum(SearchStat::betacutoffs);
+  statistics.firstmovecutoffs = sum(SearchStat::firstmovecutoffs);
+  statistics.ttprobes = sum(SearchStat::ttprobes);
+  statistics.tthits = sum(SearchStat::tthits);
+  statistics.clones = sum(SearchStat::clones);
+  statistics.movesgenerated = sum(SearchStat::movesgenerated);
+  statistics.checks = sum(SearchStat::checks);
+  statistics.checkmates = sum(SearchStat::checkmates);
+  statistics.stalemates = sum(SearchStat::stalemates);
+  statistics.aborts = sum(SearchStat::aborts);
+  statistics.nullmoves = sum(SearchStat::nullmoves);
+  statistics.nullverifications = sum(SearchStat::nullverifications);
+  statistics.nullcutoffs = sum(SearchStat::nullcutoffs);
+  statistics.lmrreductions = sum(SearchStat::lmrreductions);
+  statistics.lmrresearches = sum(SearchStat::lmrresearches);
+  statistics.pvsresearches = sum(SearchStat::pvsresearches);
+  statistics.futility = sum(SearchStat::futility);
+  statistics.reversefutility = sum(SearchStat::reversefutility);
+  statistics.seepruned = sum(SearchStat::seepruned);
+  statistics.ttcutoffs = sum(SearchStat::ttcutoffs);
+  statistics.bitbasehits = sum(SearchStat::bitbasehits);
+  return statistics;
+}
+
+}
+
+GreedyEngine::GreedyEngine(const SearchOptions& opts) : GreedyEngine(opts, ReadParams(opts.evalparams)) {}
+
+GreedyEngine::GreedyEngine(const SearchOptions& opts, const EvalParams& weights)
+  : options(opts), params(weights), evalcache(opts.evalcache), pawncache(opts.pawncache), transpositions(opts.transpositions), followpv(false), nextprogress(0), iterationdepth(0), seldepth(0), rootposition(nullptr), currmovenumber(0),
+    aborted(false), infochannel(aborted, MaxPly), taskwork(new boost::asio::io_service::work(taskservice)),
+    maxthreads(opts.threads > 0 ? opts.threads : static_cast<int>(std::max(1u, boost::thread::hardware_concurrency()))),
+    searchthread(aborted, [this](boost::shared_ptr<IMachine> machine, int depth) { ThreadFun(machine, depth); }) {
+  statcounters.resize(maxthreads + 1);
+  FillBatchWeights();
+  if (!options.book.empty()) {
+    book.Open(options.book); // without the book every move is searched
+  }
+  if (!options.bitbases.empty()) {
+    bitbases.Load(options.bitbases);
+  }
+  if (!options.network.empty()) {
+    network.Open(options.network); // without the network the weights evaluate
+  }
+  if (network.Loaded()) {
+    networksums.resize(MaxPly + options.qmaxdepth + 1);
+  }
 }
 
 GreedyEngine::~GreedyEngine() {
   Stop();
+  taskwork.reset();
+  threadpool.join_all();
 }
 
 bool GreedyEngine::Start(const IMachine& position, int depth) {
+  return StartSearch(position, depth, false);
+}
+
+bool GreedyEngine::Ponder(const IMachine& position, int depth) {
+  return depth > 0 && StartSearch(position, depth, true);
+}
+
+bool GreedyEngine::StartSearch(const IMachine& position, int depth, bool ponder) {
   if (position.CheckStatus() == Status::normal || position.CheckStatus() == Status::check || (depth == 0 && position.CheckStatus() != Status::invalid)) {
-    aborted = false;
-    mainthread = boost::thread(boost::bind(&GreedyEngine::ThreadFun, this, position.SlightClone(), depth));
+    Stop();
+    if (maxthreads > 1 && threadpool.size() == 0) {
+      StartWorkers();
+    }
+    starttime = std::chrono::steady_clock::now();
+    searchthread.Start(position.SlightClone(), depth, ponder);
     return true;
   }
   return false;
 }
 
+// The threads are started by the first search, so the engines used only to evaluate never start them. A single
+// thread needs no workers.
+void GreedyEngine::StartWorkers() {
+  for (int i = 0; i < maxthreads; ++i) {
+    threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &taskservice));
+  }
+}
+
 void GreedyEngine::Stop() {
-  aborted = true;
-  mainthread.join();
+  searchthread.Stop();
 }
 
+void GreedyEngine::PonderHit() {
+  searchthread.PonderHit();
+}
+
+// The engine keeps the statistics of the records on their way to the consumer.
 void GreedyEngine::ProcessInfo(IInfoCall* cb) {
-  callBack = cb;
-  cbservice.poll();
-  cbservice.reset();
-  callBack = nullptr;
+  InfoRecord record;
+  while (infochannel.TryPop(record)) {
+    if (record.kind == InfoRecord::searchstats) {
+      laststatistics = record.statistics;
+    }
+    if (cb) {
+      DispatchInfo(record, *cb);
+    }
+  }
+}
+
+bool GreedyEngine::WaitInfo(int milliseconds) {
+  return infochannel.Wait(milliseconds);
 }
 
 float GreedyEngine::EvalPosition(const IMachine & position) const
 {
-  if (position.CheckStatus() == Status::checkmate) {
-    return -std::numeric_limits<float>::infinity();
+  return EvalPosition(position, Accumulate(position));
+}
+
+void GreedyEngine::EvalPositions(const PositionSnapshot* positions, size_t count, float* scores) const {
+  EvalPositions(positions, count, scores, BestKernel());
+}
+
+void GreedyEngine::EvalPositions(const PositionSnapshot* positions, size_t count, float* scores, EvalKernel kernel) const {
+  if (network.Loaded()) {
+    NetworkAccumulator accumulator;
+    for (size_t i = 0; i < count; ++i) {
+      network.Refresh(positions[i].white, positions[i].black, accumulator);
+      scores[i] = network.Evaluate(accumulator, positions[i].player);
+    }
+  } else {
+    EvalBatchWeights(positions, count, scores, kernel);
   }
-  if (position.CheckStatus() == Status::stalemate || position.CheckStatus() == Status::invalid) {
-    return 0;
+  for (size_t i = 0; i < count; ++i) {
+    switch (positions[i].status) {
+    case Status::checkmate:   scores[i] = -std::numeric_limits<float>::infinity(); break;
+    case Status::stalemate:
+    case Status::invalid:     scores[i] = 0; break;
+    default:                  break;
+    }
   }
-  Set set = position.CurrentPlayer();
-  Set xset = (set == Set::white) ? Set::black : Set::white;
-  Pieces pieces = position.GetSet(set);
-  Pieces xpieces = position.GetSet(xset);
-  return EvalSide(position, set, pieces, xpieces) - EvalSide(position, xset, xpieces, pieces);
 }
 
-void GreedyEngine::NodesSearched(size_t nodes) {
-  if (callBack) {
-    callBack->NodesSearched(nodes);
+void GreedyEngine::EvalBatchWeights(const PositionSnapshot* positions, size_t count, float* scores, EvalKernel kernel) const {
+  EvalBatch batch(count);
+  for (size_t i = 0; i < count; ++i) {
+    const PositionSnapshot& position = positions[i];
+    const auto pawn = [](const Piece& p) { return p.type == Type::pawn; };
+    const bool pawns = std::any_of(position.white.begin(), position.white.end(), pawn) ||
+                       std::any_of(position.black.begin(), position.black.end(), pawn);
+    const int table = pawns ? 0 : BatchCodes * EvalBatch::Squares;
+    float extra = 0.001f * (position.whitemoves - position.blackmoves);
+    for (Set set : { Set::white, Set::black }) {
+      const Pieces& pieces = set == Set::white ? position.white : position.black;
+      const Pieces& xpieces = set == Set::white ? position.black : position.white;
+      for (const auto& piece : pieces) {
+        batch.indices[piece.position.pos() * batch.stride + i] = table + BatchCode(set, piece.type) * EvalBatch::Squares + piece.position.pos();
+        if (piece.type == Type::queen) {
+          extra += (set == Set::white ? 1 : -1) * DynamicWeight(set, piece, xpieces, pawns);
+        }
+      }
+    }
+    if (pawns) {
+      // Snapshots carry no key, so the structure is evaluated without the cache.
+      const HashCache<3>::Data structure = EvalPawns(position.white, position.black);
+      extra += FromBits(structure[0]) + PawnShield(Set::white, position.white, structure[1]) -
+               PawnShield(Set::black, position.black, structure[2]);
+    }
+    batch.extra[i] = extra;
+    batch.sign[i] = position.player == Set::white ? 1.0f : -1.0f;
   }
+  std::vector<float> results;
+  RunEvalBatch(kernel, batchweights.data(), batch, results);
+  std::copy(results.begin(), results.begin() + count, scores);
 }
 
-void GreedyEngine::NodesPerSecond(int nps) {
-  if (callBack) {
-    callBack->NodesPerSecond(nps);
-  }
+SearchStatistics GreedyEngine::Statistics() const {
+  return laststatistics;
+}
+
+HashStats GreedyEngine::EvalCacheStats() const {
+  return evalcache.Stats();
+}
+
+HashStats GreedyEngine::PawnCacheStats() const {
+  return pawncache.Stats();
+}
+
+HashStats GreedyEngine::TranspositionStats() const {
+  return transpositions.Stats();
 }
 
-void GreedyEngine::ReadyOk() {
-  if (callBack) {
-    callBack->ReadyOk();
+void GreedyEngine::ThreadFun(boost::shared_ptr<IMachine> machine, int maxdepth) {
+  const float inf = std::numeric_limits<float>::infinity();
+  size_t searched_nodes = 0;
+  startlatency = std::chrono::microseconds(0);
+  std::fill(statcounters.begin(), statcounters.end(), SearchStatCounters());
+  pvline.clear();
+  lastlines.clear();
+  nextreport = starttime + std::chrono::milliseconds(options.reportinterval);
+  nextprogress = options.reportnodes > 0 ? options.reportnodes : ClockNodes;
+  iterationdepth = 0;
+  seldepth = 0;
+  rootposition = machine.get();
+  currmovenumber = 0;
+  std::vector<std::string> notations;
+  Move bookmove;
+  const bool inbook = maxdepth > 0 && BookMove(*machine, bookmove);
+  if (inbook) {
+    pvline.assign(1, bookmove);
+    notations = Notations(*machine, pvline);
+  }
+  const EvalAccumulator eval = Accumulate(*machine);
+  if (network.Loaded()) {
+    AccumulateNetwork(*machine, networksums[0]);
+  }
+  float bestscore = inbook ? 0.0f : Search(*machine, eval, 0, 0, searched_nodes, -inf, inf); // a book move has no score
+  // Iterative deepening, every iteration searches the principal variation of the previous one first.
+  for (int depth = 1; depth <= std::min(maxdepth, MaxPly - 1) && !inbook && !aborted; ++depth) {
+    followpv = true;
+    iterationdepth = depth;
+    float score = Search(*machine, eval, depth, 0, searched_nodes, -inf, inf);
+    if (aborted && !pvline.empty()) {
+      break; // The incomplete iteration is discarded.
+    }
+    pvline.assign(pvtable[0].begin(), pvtable[0].begin() + pvlength[0]);
+    bestscore = score;
+    notations = Notations(*machine, pvline);
+    if (options.multipv > 1) {
+      lastlines = rootlines;
+      for (size_t i = 0; i < lastlines.size(); ++i) {
+        infochannel.Post(MakeInfo(InfoRecord::principalvariation, i + 1, depth, lastlines[i].score, JoinLine(Notations(*machine, lastlines[i].line))));
+      }
+    } else {
+      infochannel.Post(MakeInfo(InfoRecord::principalvariation, 1, depth, bestscore, JoinLine(notations)));
+    }
   }
+
+  currmovenumber = 0;
+  const std::chrono::microseconds stoplatency = searchthread.StopLatency();
+  if (!searchthread.AwaitPonderHit()) {
+    return; // The opponent made another move, nobody waits for the results.
+  }
+  ReportProgress(searched_nodes);
+  InfoRecord statistics = MakeInfo(InfoRecord::searchstats);
+  statistics.statistics = SumStatistics(statcounters);
+  statistics.statistics.startlatency = startlatency;
+  statistics.statistics.stoplatency = stoplatency;
+  infochannel.Post(statistics);
+  infochannel.Post(MakeInfo(InfoRecord::nodessearched, searched_nodes));
+  infochannel.Post(MakeInfo(InfoRecord::bestscore, 0, 0, bestscore));
+  infochannel.Post(MakeInfo(InfoRecord::bestmove, 0, 0, 0, notations.empty() ? std::string() : notations.front()));
+  infochannel.Post(MakeInfo(InfoRecord::readyok));
 }
 
-void GreedyEngine::BestMove(std::string notation) {
-  if (callBack) {
-    callBack->BestMove(notation);
+void GreedyEngine::CheckProgress(size_t nodes) {
+  if (options.reportnodes > 0) {
+    nextprogress = nodes + options.reportnodes;
+    ReportProgress(nodes);
+    return;
+  }
+  nextprogress = nodes + ClockNodes;
+  const auto now = std::chrono::steady_clock::now();
+  if (now >= nextreport) {
+    nextreport = now + std::chrono::milliseconds(options.reportinterval);
+    ReportProgress(nodes);
   }
 }
 
-void GreedyEngine::BestScore(float score) {
-  if (callBack) {
-    callBack->BestScore(score);
+void GreedyEngine::ReportProgress(size_t nodes) {
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - starttime;
+  const int nps = elapsed.count() > 0 ? static_cast<int>(nodes / elapsed.count()) : 0;
+  infochannel.Post(MakeInfo(InfoRecord::nodessearched, nodes));
+  infochannel.Post(MakeInfo(InfoRecord::nodespersecond, nps));
+  infochannel.Post(MakeInfo(InfoRecord::searchdepth, seldepth, iterationdepth));
+  infochannel.Post(MakeInfo(InfoRecord::hashfull, HashUsage()));
+  if (currmovenumber > 0) {
+    infochannel.Post(MakeInfo(InfoRecord::currentmove, currmovenumber, 0, 0, Notations(*rootposition, Moves{currmove}).front()));
   }
 }
 
-void GreedyEngine::ThreadFun(boost::shared_ptr<IMachine> machine, int maxdepth) {
-  taskservice.reset();
-  boost::asio::io_service::work work(taskservice);
-  
-  boost::thread_group threadpool;
-  for (int i = 0; i < maxthreads; ++i) {
-    threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &taskservice));
+int GreedyEngine::HashUsage() const {
+  return transpositions.Usage();
+}
+
+std::vector<std::string> GreedyEngine::Notations(const IMachine& machine, const Moves& line) const {
+  std::vector<std::string> notations;
+  boost::shared_ptr<IMachine> position = machine.SlightClone();
+  for (const auto& m : line) {
+    if (!position->Move(m.piece.type, m.piece.position, m.to, m.promotion)) {
+      assert(!"Can't make move!");
+      break;
+    }
+    notations.push_back(position->LastMoveNotation());
   }
-  
-  std::string bestmove;
-  size_t searched_nodes = 0;
-  float bestscore = Search(*machine, maxdepth, searched_nodes, -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), &bestmove);
-  
-  taskservice.stop();
-  threadpool.join_all();
-  
-  cbservice.post(boost::bind(&GreedyEngine::NodesSearched, this, searched_nodes));
-  cbservice.post(boost::bind(&GreedyEngine::BestScore, this, bestscore));
-  cbservice.post(boost::bind(&GreedyEngine::BestMove, this, bestmove));
-  cbservice.post(boost::bind(&GreedyEngine::ReadyOk, this));
+  return notations;
 }
 
-float GreedyEngine::Search(const IMachine& machine, int depth, size_t& nodes, float alpha, const float betta, std::string *bestmove) {
+float GreedyEngine::Search(const IMachine& machine, const EvalAccumulator& eval, int depth, int ply, size_t& nodes, float alpha, const float betta, bool nullmove) {
+  pvlength[ply] = 0;
+  const bool follow = followpv;
+  followpv = false;
+  if (ply == 0) {
+    rootlines.clear();
+  }
+  if (depth <= 0 && ply > 0) {
+    return Quiesce(machine, eval, ply, 0, nodes, alpha, betta);
+  }
+  if (++nodes >= nextprogress) {
+    CheckProgress(nodes);
+  }
+  Count<SearchStat::nodes>();
+  if (nodes == 1) {
+    startlatency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - starttime);
+  }
+  if (ply > 0 && aborted.load(std::memory_order_relaxed)) {
+    return Aborted(alpha); // The parents see the abort and discard the score.
+  }
+  seldepth = std::max(seldepth, ply);
   Status status = machine.CheckStatus();
+  CountStatus(status);
+  float known;
+  if (ply > 0 && status != Status::checkmate && status != Status::stalemate && ProbeBitbases(machine, eval, ply, known)) {
+    return known;
+  }
   if (depth > 0 && status != Status::checkmate && status != Status::stalemate) {
+    const bool pvnode = betta - alpha > ZeroWindow;
+    const bool selective = ply > 0 && !pvnode && status != Status::check;
+
+    // The result of the same position searched before, through another move order, another line or another search.
+    const uint64_t key = machine.PositionKey();
+    HashCache<2>::Data transposition;
+    const bool transposed = ply > 0 && transpositions.Probe(key, transposition);
+    Count<SearchStat::ttprobes>(ply > 0 ? 1 : 0);
+    Count<SearchStat::tthits>(transposed ? 1 : 0);
+    if (transposed && !pvnode && TranspositionDepth(transposition) >= depth) {
+      const float score = TranspositionScore(transposition);
+      const Bound bound = TranspositionBound(transposition);
+      if (bound == exactbound || (bound == lowerbound && score >= betta) || (bound == upperbound && score <= alpha)) {
+        Count<SearchStat::ttcutoffs>();
+        return std::max(alpha, std::min(betta, score));
+      }
+    }
+    const float originalalpha = alpha;
+
+    const float staticeval = selective ? EvalNode(machine, eval, ply) : 0.0f;
+    Count<SearchStat::evaluations>(selective ? 1 : 0);
+
+    if (selective && options.reversefutility && depth <= options.reversefutilitydepth &&
+        staticeval - options.reversefutilitymargin * depth >= betta) {
+      // Reverse futility: the static score is so far above betta that no move is expected to bring it back.
+      Count<SearchStat::reversefutility>();
+      return betta;
+    }
+
+    if (selective && options.nullmove && nullmove && depth >= options.nullmovedepth && staticeval >= betta &&
+        HasPieces(machine)) {
+      // Null move: if passing the move still fails high, a real move would fail high too. Positions without pieces are
+      // skipped as zugzwang is likely there.
+      boost::shared_ptr<IMachine> nullposition = machine.SlightClone();
+      Count<SearchStat::clones>();
+      if (nullposition->NullMove()) {
+        Count<SearchStat::nullmoves>();
+        if (network.Loaded()) {
+          networksums[ply + 1] = networksums[ply]; // passing moves no piece
+        }
+        const int reduction = options.nullmovereduction + (depth > 6 ? 1 : 0);
+        float score = -Search(*nullposition, eval, depth - 1 - reduction, ply + 1, nodes, -betta, -betta + ZeroWindow, false);
+        if (score >= betta && depth >= options.nullverifydepth) {
+          Count<SearchStat::nullverifications>();
+          score = Search(machine, eval, depth - reduction, ply, nodes, betta - ZeroWindow, betta, false);
+        }
+        if (aborted) {
+          return Aborted(alpha);
+        }
+        if (score >= betta) {
+          Count<SearchStat::nullcutoffs>();
+          return betta;
+        }
+      }
+    }
+
+    const Set set = machine.CurrentPlayer();
+    const Pieces pieces = machine.GetSet(set);
+    const Pieces xpieces = machine.GetSet(set == Set::white ? Set::black : Set::white);
     Moves moves = EmunMoves(machine);
     assert(!moves.empty());
-    bool first_move = !!bestmove;
-    boost::container::flat_set<Position> xpos;
-    for (const auto& xp : machine.GetSet(machine.CurrentPlayer() == Set::white ? Set::black : Set::white)) {
-      xpos.insert(xp.position);
-    }
-    for (auto move = moves.begin(); move != moves.end() && !aborted; ) {
-      boost::container::small_vector< TaskData, 8 > machinepool;
-      {
-        boost::unique_lock<boost::mutex> lock(muttasks);
-        workingtasks = 0;
-        for (int i = 0; i < maxthreads && move != moves.end(); ++i, ++move) {
-          machinepool.push_back(boost::make_tuple(false, machine.SlightClone(), *move));
-          taskservice.post(boost::bind(&GreedyEngine::TaskFun, this, boost::ref(machinepool.back())));
-          ++workingtasks;
-        }
-        while (workingtasks > 0) {
-          condtasks.wait(lock);
+    Count<SearchStat::movesgenerated>(moves.size());
+    OrderMoves(machine, moves, xpieces);
+    const bool multipv = ply == 0 && options.multipv > 1;
+    if (multipv) {
+      for (auto line = lastlines.rbegin(); line != lastlines.rend(); ++line) {
+        auto rootmove = std::find_if(moves.begin(), moves.end(), [&](const Move& m) { return SameMove(m, line->line.front()); });
+        if (rootmove != moves.end()) {
+          std::rotate(moves.begin(), rootmove, rootmove + 1);
         }
       }
+    }
+    if (follow && ply < static_cast<int>(pvline.size())) {
+      auto pvmove = std::find_if(moves.begin(), moves.end(), [&](const Move& m) { return SameMove(m, pvline[ply]); });
+      if (pvmove != moves.end()) {
+        std::rotate(moves.begin(), pvmove, pvmove + 1);
+        followpv = true; // Only the first child continues to follow the previous principal variation.
+      }
+    }
+    if (transposed && !followpv) {
+      auto hashmove = std::find_if(moves.begin(), moves.end(), [&](const Move& m) { return TranspositionMove(transposition, m); });
+      if (hashmove != moves.end()) {
+        std::rotate(moves.begin(), hashmove, hashmove + 1);
+      }
+    }
+
+    if (selective && options.futility && depth <= options.futilitydepth &&
+        staticeval + options.futilitymargin * depth <= alpha) {
+      // Futility: quiet moves and captures losing the exchange can not raise the hopeless static score to alpha.
+      std::array<bool, 64> occupied = Occupancy(machine.GetSet(set), xpieces);
+      const size_t count = moves.size();
+      moves.erase(std::remove_if(moves.begin(), moves.end(), [&](const Move& m) {
+        return (MoveGain(m, xpieces) == 0.0f || !machine.SEEAtLeast(m.piece.position, m.to, 0, m.promotion)) &&
+               !GivesCheck(m, set, xpieces, occupied);
+      }), moves.end());
+      Count<SearchStat::futility>(count - moves.size());
+    }
+
+    if (selective && options.seepruning && depth <= options.seepruningdepth) {
+      // SEE pruning: a move giving away more material than the remaining depth is expected to win back, unless it checks.
+      const int threshold = -static_cast<int>(options.seepruningmargin * 100 * depth);
+      std::array<bool, 64> occupied = Occupancy(machine.GetSet(set), xpieces);
+      const size_t count = moves.size();
+      moves.erase(std::remove_if(moves.begin(), moves.end(), [&](const Move& m) {
+        return !machine.SEEAtLeast(m.piece.position, m.to, threshold, m.promotion) && !GivesCheck(m, set, xpieces, occupied);
+      }), moves.end());
+      Count<SearchStat::seepruned>(count - moves.size());
+    }
+
+    bool first_move = ply == 0;
+    int index = 0;
+    for (auto move = moves.cbegin(); move != moves.cend() && !aborted; ) {
+      MachinePool machinepool;
+      MakeMoves(machine, move, moves.cend(), machinepool);
       for (const auto& m : machinepool) {
-        if (aborted || alpha >= betta) {
-          return alpha;
+        if (aborted) {
+          return Aborted(alpha);
+        }
+        if (alpha >= betta) {
+          return StoreTransposition(key, depth, ply, originalalpha, betta, alpha);
         }
         if (m.get<0>()) {
-          bool forcing = depth == 1 && (m.get<1>()->CheckStatus() == Status::check || xpos.find(m.get<2>().to) != xpos.end()); // todo: en passat
-          float score = -Search(*m.get<1>(), forcing ? depth : depth - 1, nodes, -betta, -alpha);
+          const IMachine& child = *m.get<1>();
+          if (ply == 0) {
+            currmove = m.get<2>(); // the notation is built only when it is reported
+            currmovenumber = index + 1;
+          }
+          // Late quiet moves are searched with reduced depth, all moves after the first one with the zero window.
+          int reduction = 0;
+          const Move& move = m.get<2>();
+          if (options.lmr && depth >= options.lmrdepth && index >= options.lmrmoves && status != Status::check &&
+              (MoveGain(move, xpieces) == 0.0f || !machine.SEEAtLeast(move.piece.position, move.to, 0, move.promotion)) &&
+              child.CheckStatus() != Status::check) {
+            reduction = static_cast<int>(options.lmrbase + std::log(depth) * std::log(index) / options.lmrdivisor);
+            reduction = std::max(1, std::min(reduction, depth - 2));
+            Count<SearchStat::lmrreductions>();
+          }
+          const EvalAccumulator childeval = Accumulate(eval, set, m.get<2>(), pieces, xpieces);
+          if (network.Loaded()) {
+            AccumulateNetwork(networksums[ply], eval, set, m.get<2>(), pieces, xpieces, networksums[ply + 1]);
+          }
+          const bool zerowindow = options.pvs && index > 0 && !std::isinf(alpha);
+          const float wbetta = zerowindow ? alpha + ZeroWindow : betta;
+          float score = -Search(child, childeval, depth - 1 - reduction, ply + 1, nodes, -wbetta, -alpha);
+          followpv = false;
+          if (reduction > 0 && score > alpha && !aborted) {
+            Count<SearchStat::lmrresearches>();
+            score = -Search(child, childeval, depth - 1, ply + 1, nodes, -wbetta, -alpha);
+          }
+          if (zerowindow && score > alpha && score < betta && !aborted) {
+            Count<SearchStat::pvsresearches>();
+            score = -Search(child, childeval, depth - 1, ply + 1, nodes, -betta, -alpha);
+          }
+          ++index;
+          if (aborted) {
+            return Aborted(alpha);
+          }
+          if (multipv) {
+            // Every root move better than the last of the best lines takes its place, the window of the following
+            // moves starts from the last line, so the lines get exact scores at the cost of one search.
+            if (static_cast<int>(rootlines.size()) < options.multipv || score > alpha) {
+              RootLine line = { score, { move } };
+              line.line.insert(line.line.end(), pvtable[1].begin(), pvtable[1].begin() + pvlength[1]);
+              auto place = std::find_if(rootlines.begin(), rootlines.end(), [&](const RootLine& l) { return score > l.score; });
+              if (place == rootlines.begin()) {
+                std::copy(line.line.begin(), line.line.end(), pvtable[0].begin());
+                pvlength[0] = static_cast<int>(line.line.size());
+                infochannel.Post(MakeInfo(InfoRecord::bestscore, 0, 0, score));
+              }
+              rootlines.insert(place, line);
+              if (static_cast<int>(rootlines.size()) > options.multipv) {
+                rootlines.pop_back();
+              }
+              if (static_cast<int>(rootlines.size()) == options.multipv) {
+                alpha = rootlines.back().score;
+              }
+            }
+            continue;
+          }
           if (first_move || score > alpha) {
             first_move = false;
             if (score > alpha) {
               alpha = score;
             }
-            cbservice.post(boost::bind(&GreedyEngine::NodesSearched, this, nodes));
-            cbservice.post(boost::bind(&GreedyEngine::BestScore, this, score));
-            if (bestmove) {
-              *bestmove = m.get<1>()->LastMoveNotation();
-              cbservice.post(boost::bind(&GreedyEngine::BestMove, this, *bestmove));
+            if (alpha >= betta) {
+              Count<SearchStat::betacutoffs>();
+              Count<SearchStat::firstmovecutoffs>(index == 1 ? 1 : 0);
+            }
+            // The line is kept as moves, the notation is built only when it is reported.
+            pvtable[ply][0] = m.get<2>();
+            std::copy(pvtable[ply + 1].begin(), pvtable[ply + 1].begin() + pvlength[ply + 1], pvtable[ply].begin() + 1);
+            pvlength[ply] = pvlength[ply + 1] + 1;
+            if (ply == 0) {
+              infochannel.Post(MakeInfo(InfoRecord::bestscore, 0, 0, score));
             }
           }
         } else {
@@ -148,10 +709,94 @@ float GreedyEngine::Search(const IMachine& machine, int depth, size_t& nodes, fl
         }
       }
     }
-    return alpha;
+    if (multipv) {
+      return rootlines.empty() ? alpha : rootlines.front().score;
+    }
+    return aborted ? Aborted(alpha) : StoreTransposition(key, depth, ply, originalalpha, betta, alpha);
+  }
+  Count<SearchStat::evaluations>();
+  return EvalNode(machine, eval, ply);
+}
+
+float GreedyEngine::StoreTransposition(uint64_t key, int depth, int ply, float alpha, float betta, float score) {
+  // The root is not stored, its lines depend on the multi-PV window. The best move is known only if alpha was raised.
+  if (ply > 0) {
+    const Bound bound = score >= betta ? lowerbound : score > alpha ? exactbound : upperbound;
+    transpositions.Store(key, PackTransposition(score, depth, bound, score > alpha ? &pvtable[ply][0] : nullptr));
+  }
+  return score;
+}
+
+float GreedyEngine::Quiesce(const IMachine& machine, const EvalAccumulator& eval, int ply, int qply, size_t& nodes, float alpha, const float betta) {
+  if (++nodes >= nextprogress) {
+    CheckProgress(nodes);
+  }
+  Count<SearchStat::nodes>();
+  if (aborted.load(std::memory_order_relaxed)) {
+    return Aborted(alpha);
+  }
+  seldepth = std::max(seldepth, ply + qply);
+  const Status status = machine.CheckStatus();
+  CountStatus(status);
+  float known;
+  if (status != Status::checkmate && status != Status::stalemate && ProbeBitbases(machine, eval, ply + qply, known)) {
+    return known;
+  }
+  const float standpat = EvalNode(machine, eval, ply + qply);
+  Count<SearchStat::evaluations>();
+  if (status == Status::checkmate || status == Status::stalemate || qply >= options.qmaxdepth) {
+    return standpat;
+  }
+  const Set set = machine.CurrentPlayer();
+  const Pieces pieces = machine.GetSet(set);
+  const Pieces xpieces = machine.GetSet(set == Set::white ? Set::black : Set::white);
+  Moves moves;
+  if (status == Status::check) {
+    moves = EmunMoves(machine); // There is no stand pat in check, all evasions are searched.
+  } else {
+    if (standpat >= betta) {
+      return standpat;
+    }
+    if (standpat > alpha) {
+      alpha = standpat;
+    }
+    moves = EnumTacticalMoves(machine, options.qchecks && qply == 0);
+    // Delta pruning: the exchange started by the move can not bring the score back to alpha even with a safety margin.
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [&](const Move& m) {
+      return standpat + machine.SEE(m.piece.position, m.to, m.promotion) / 100.0f + options.deltamargin <= alpha;
+    }), moves.end());
+  }
+  Count<SearchStat::movesgenerated>(moves.size());
+  int searched = 0;
+  for (auto move = moves.cbegin(); move != moves.cend() && !aborted; ) {
+    MachinePool machinepool;
+    MakeMoves(machine, move, moves.cend(), machinepool);
+    for (const auto& m : machinepool) {
+      if (aborted) {
+        return Aborted(alpha);
+      }
+      if (alpha >= betta) {
+        return alpha;
+      }
+      if (m.get<0>()) {
+        if (network.Loaded()) {
+          AccumulateNetwork(networksums[ply + qply], eval, set, m.get<2>(), pieces, xpieces, networksums[ply + qply + 1]);
+        }
+        float score = -Quiesce(*m.get<1>(), Accumulate(eval, set, m.get<2>(), pieces, xpieces), ply, qply + 1, nodes, -betta, -alpha);
+        ++searched;
+        if (score > alpha) {
+          alpha = score;
+          if (alpha >= betta) {
+            Count<SearchStat::betacutoffs>();
+            Count<SearchStat::firstmovecutoffs>(searched == 1 ? 1 : 0);
+          }
+        }
+      } else {
+        assert(!"Can't make move!");
+      }
+    }
   }
-  ++nodes;
-  return EvalPosition(machine);
+  return aborted ? Aborted(alpha) : alpha;
 }
 
 Moves GreedyEngine::EmunMoves(const IMachine& position) const
@@ -171,9 +816,141 @@ Moves GreedyEngine::EmunMoves(const IMachine& position) const
   return moves;
 }
 
-void GreedyEngine::TaskFun(TaskData& data)
+Moves GreedyEngine::EnumTacticalMoves(const IMachine& position, bool checks) const
 {
-  data.get<0>() = data.get<1>()->Move(data.get<2>().piece.type, data.get<2>().piece.position, data.get<2>().to, data.get<2>().promotion);
+  const Set set = position.CurrentPlayer();
+  const Pieces pieces = position.GetSet(set);
+  const Pieces xpieces = position.GetSet(set == Set::white ? Set::black : Set::white);
+  std::array<bool, 64> occupied = Occupancy(pieces, xpieces);
+
+  // A move is losing if the opponent wins material by the exchange on the target square.
+  auto losing = [&](const Piece& piece, Position to) {
+    return options.qskiplosing && !position.SEEAtLeast(piece.position, to, 0);
+  };
+
+  Moves moves;
+  for (const auto& piece : pieces) {
+    for (const auto& to : position.EnumMoves(piece.position)) {
+      if (piece.type == Type::pawn && (to.rank() == '1' || to.rank() == '8')) {
+        moves.push_back({ piece, to, Type::queen }); // Under-promotions are left to the full-width search.
+      } else if (occupied[to.pos()] || (piece.type == Type::pawn && to.file() != piece.position.file())) {
+        if (!losing(piece, to)) {
+          moves.push_back({ piece, to, Type::bad }); // Including en passant.
+        }
+      } else if (checks) {
+        Move quiet = { piece, to, Type::bad };
+        if (GivesCheck(quiet, set, xpieces, occupied) && !losing(piece, to)) {
+          moves.push_back(quiet);
+        }
+      }
+    }
+  }
+  OrderMoves(position, moves, xpieces);
+  return moves;
+}
+
+void GreedyEngine::OrderMoves(const IMachine& position, Moves& moves, const Pieces& xpieces) const
+{
+  // MVV-LVA: the most valuable victim first, then the least valuable attacker. Quiet moves keep their order, captures
+  // losing the exchange go after them.
+  boost::container::small_vector<std::pair<float, Move>, 50> ordered;
+  for (const auto& m : moves) {
+    const float gain = MoveGain(m, xpieces);
+    const bool losing = gain > 0 && !position.SEEAtLeast(m.piece.position, m.to, 0, m.promotion);
+    ordered.push_back({ losing ? gain - LosingCapture : gain, m });
+  }
+  std::stable_sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+    return a.first > b.first || (a.first == b.first && a.first > 0 && a.second.piece.type < b.second.piece.type);
+  });
+  for (size_t i = 0; i < ordered.size(); ++i) {
+    moves[i] = ordered[i].second;
+  }
+}
+
+bool GreedyEngine::HasPieces(const IMachine& position) const
+{
+  const Pieces pieces = position.GetSet(position.CurrentPlayer());
+  return std::any_of(pieces.begin(), pieces.end(), [](const auto& p) { return p.type != Type::pawn && p.type != Type::king; });
+}
+
+// The exact result of the endgame. The won positions keep the evaluation on top of the win, so the search still
+// heads for the mate by the usual terms.
+bool GreedyEngine::ProbeBitbases(const IMachine& position, const EvalAccumulator& eval, int ply, float& score)
+{
+  BitbaseValue value;
+  if (bitbases.Size() == 0 || !bitbases.Probe(position, value)) {
+    return false;
+  }
+  Count<SearchStat::bitbasehits>();
+  switch (value) {
+  case BitbaseValue::win:   score = KnownWin + EvalNode(position, eval, ply); break;
+  case BitbaseValue::loss:  score = -KnownWin + EvalNode(position, eval, ply); break;
+  default:                  score = 0.0f; break;
+  }
+  return true;
+}
+
+// The heaviest book move legal in the position, a key collision may bring the moves of another position.
+bool GreedyEngine::BookMove(const IMachine& position, Move& move) const
+{
+  if (book.Size() == 0) {
+    return false;
+  }
+  const Pieces pieces = position.GetSet(position.CurrentPlayer());
+  for (const auto& entry : book.Probe(position.PositionKey())) {
+    Position from, to;
+    Type promotion;
+    UnpackBookMove(entry.move, from, to, promotion);
+    auto piece = std::find_if(pieces.begin(), pieces.end(), [&](const auto& p) { return p.position == from; });
+    if (piece != pieces.end()) {
+      const PieceMoves targets = position.EnumMoves(from);
+      if (std::find(targets.begin(), targets.end(), to) != targets.end()) {
+        move = Move{ *piece, to, promotion };
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+float GreedyEngine::MoveGain(const Move& move, const Pieces& xpieces) const
+{
+  float gain = move.promotion != Type::bad ? PieceWeight(move.promotion) - PieceWeight(Type::pawn) : 0.0f;
+  auto victim = std::find_if(xpieces.begin(), xpieces.end(), [&](const auto& p) { return p.position == move.to; });
+  if (victim != xpieces.end()) {
+    gain += PieceWeight(victim->type);
+  } else if (move.piece.type == Type::pawn && move.to.file() != move.piece.position.file()) {
+    gain += PieceWeight(Type::pawn); // En passant
+  }
+  return gain;
+}
+
+void GreedyEngine::MakeMoves(const IMachine& machine, Moves::const_iterator& move, Moves::const_iterator end, MachinePool& pool)
+{
+  pool.reserve(maxthreads); // The tasks keep references to the pool items.
+  if (maxthreads == 1) {
+    // Without the workers the move is made here, one by one, and the search stays on its thread.
+    pool.push_back(boost::make_tuple(false, machine.SlightClone(), *move++));
+    Count<SearchStat::clones>();
+    MakeMove(pool.back(), statcounters.front());
+    return;
+  }
+  boost::unique_lock<boost::mutex> lock(muttasks);
+  workingtasks = 0;
+  for (int i = 0; i < maxthreads && move != end; ++i, ++move) {
+    pool.push_back(boost::make_tuple(false, machine.SlightClone(), *move));
+    Count<SearchStat::clones>();
+    taskservice.post(boost::bind(&GreedyEngine::TaskFun, this, boost::ref(pool.back()), boost::ref(statcounters[i + 1])));
+    ++workingtasks;
+  }
+  while (workingtasks > 0) {
+    condtasks.wait(lock);
+  }
+}
+
+void GreedyEngine::TaskFun(TaskData& data, SearchStatCounters& stats)
+{
+  MakeMove(data, stats);
   {
     boost::lock_guard<boost::mutex> lock(muttasks);
     --workingtasks;
@@ -181,94 +958,296 @@ void GreedyEngine::TaskFun(TaskData& data)
   condtasks.notify_one();
 }
 
-float GreedyEngine::EvalSide(const IMachine & position, Set set, const Pieces& pieces, const Pieces& xpieces) const {
+void GreedyEngine::MakeMove(TaskData& data, SearchStatCounters& stats) const
+{
+  if (aborted.load(std::memory_order_relaxed)) {
+    stats.Add<SearchStat::aborts>();
+    data.get<0>() = false;
+    return;
+  }
+  data.get<0>() = data.get<1>()->Move(data.get<2>().piece.type, data.get<2>().piece.position, data.get<2>().to, data.get<2>().promotion);
+}
+
+void GreedyEngine::CountStatus(Status status)
+{
+  switch (status) {
+  case Status::check:       Count<SearchStat::checks>(); break;
+  case Status::checkmate:   Count<SearchStat::checkmates>(); break;
+  case Status::stalemate:   Count<SearchStat::stalemates>(); break;
+  default:                  break;
+  }
+}
+
+float GreedyEngine::EvalPosition(const IMachine& position, const EvalAccumulator& accumulator, const NetworkAccumulator* sums) const {
+  const uint64_t key = position.PositionKey();
+  HashCache<1>::Data cached;
+  if (evalcache.Probe(key, cached)) {
+    return FromBits(cached[0]);
+  }
+  float score;
+  if (position.CheckStatus() == Status::checkmate) {
+    score = -std::numeric_limits<float>::infinity();
+  } else if (position.CheckStatus() == Status::stalemate || position.CheckStatus() == Status::invalid) {
+    score = 0;
+  } else if (network.Loaded()) {
+    NetworkAccumulator counted;
+    if (!sums) {
+      AccumulateNetwork(position, counted);
+    }
+    score = network.Evaluate(sums ? *sums : counted, position.CurrentPlayer());
+  } else {
+    Set set = position.CurrentPlayer();
+    Set xset = (set == Set::white) ? Set::black : Set::white;
+    Pieces pieces = position.GetSet(set);
+    Pieces xpieces = position.GetSet(xset);
+    const bool pawns = accumulator.pawns[0] + accumulator.pawns[1] > 0;
+    score = (accumulator.Score(set) - accumulator.Score(xset)) / 1000.0f + EvalSide(position, set, pieces, xpieces, pawns) -
+            EvalSide(position, xset, xpieces, pieces, pawns);
+    if (pawns) {
+      const bool white = set == Set::white;
+      const HashCache<3>::Data structure = PawnStructure(accumulator.pawnkey, white ? pieces : xpieces, white ? xpieces : pieces);
+      score += (white ? 1 : -1) * FromBits(structure[0]) + PawnShield(set, pieces, structure[white ? 1 : 2]) -
+               PawnShield(xset, xpieces, structure[white ? 2 : 1]);
+    }
+  }
+  evalcache.Store(key, {ToBits(score)});
+  return score;
+}
+
+EvalAccumulator GreedyEngine::Accumulate(const IMachine& position) const {
+  EvalAccumulator accumulator;
+  for (Set set : { Set::white, Set::black }) {
+    const int side = EvalAccumulator::Side(set);
+    for (const auto& piece : position.GetSet(set)) {
+      accumulator.material[side] += Millipawns(PieceWeight(piece.type));
+      accumulator.squares[side] += Millipawns(SquareWeight(set, piece.type, piece.position));
+      if (piece.type == Type::pawn) {
+        ++accumulator.pawns[side];
+        accumulator.pawnkey ^= PawnKey(side, piece.position);
+      } else if (piece.type == Type::king) {
+        accumulator.kings[side] = piece.position;
+      }
+    }
+  }
+  return accumulator;
+}
+
+EvalAccumulator GreedyEngine::Accumulate(const EvalAccumulator& accumulator, Set set, const Move& move, const Pieces& /*pieces*/,
+                                         const Pieces& xpieces) const {
+  EvalAccumulator result = accumulator;
+  const Set xset = (set == Set::white) ? Set::black : Set::white;
+  const int side = EvalAccumulator::Side(set);
+  const int xside = EvalAccumulator::Side(xset);
+  const Type type = move.promotion != Type::bad ? move.promotion : move.piece.type;
+  result.squares[side] += Millipawns(SquareWeight(set, type, move.to)) - Millipawns(SquareWeight(set, move.piece.type, move.piece.position));
+  if (type != move.piece.type) {
+    result.material[side] += Millipawns(PieceWeight(type)) - Millipawns(PieceWeight(move.piece.type));
+    --result.pawns[side];
+    result.pawnkey ^= PawnKey(side, move.piece.position);
+  } else if (type == Type::pawn) {
+    result.pawnkey ^= PawnKey(side, move.piece.position) ^ PawnKey(side, move.to);
+  }
+  const Piece* captured = CapturedPiece(move, xpieces);
+  if (captured) {
+    result.material[xside] -= Millipawns(PieceWeight(captured->type));
+    result.squares[xside] -= Millipawns(SquareWeight(xset, captured->type, captured->position));
+    if (captured->type == Type::pawn) {
+      --result.pawns[xside];
+      result.pawnkey ^= PawnKey(xside, captured->position);
+    }
+  }
+  // The rook of castling needs no update, rooks have no square weights.
+  if (move.piece.type == Type::king) {
+    result.kings[side] = move.to;
+  }
+  return result;
+}
+
+void GreedyEngine::AccumulateNetwork(const IMachine& position, NetworkAccumulator& sums) const {
+  network.Refresh(position.GetSet(Set::white), position.GetSet(Set::black), sums);
+}
+
+// The pieces changed by the move are added to and taken from the sums of both sides, except the side whose king moved,
+// its sums are counted again from the pieces after the move.
+void GreedyEngine::AccumulateNetwork(const NetworkAccumulator& sums, const EvalAccumulator& accumulator, Set set, const Move& move,
+                                     const Pieces& pieces, const Pieces& xpieces, NetworkAccumulator& result) const {
+  const Set xset = (set == Set::white) ? Set::black : Set::white;
+  const Type type = move.promotion != Type::bad ? move.promotion : move.piece.type;
+  const Piece* captured = CapturedPiece(move, xpieces);
+  std::array<NetworkChange, 4> changes;
+  int count = 0;
+  if (move.piece.type != Type::king) {
+    changes[count++] = NetworkChange{ set, move.piece.type, move.piece.position, false };
+    changes[count++] = NetworkChange{ set, type, move.to, true };
+  } else if (std::abs(move.to.x() - move.piece.position.x()) == 2) {
+    // Castling, the rook goes over the king.
+    const bool kingside = move.to.x() > move.piece.position.x();
+    changes[count++] = NetworkChange{ set, Type::rook, Position(kingside ? 7 << 4 | move.to.y() : move.to.y()), false };
+    changes[count++] = NetworkChange{ set, Type::rook, Position((kingside ? 5 : 3) << 4 | move.to.y()), true };
+  }
+  if (captured) {
+    changes[count++] = NetworkChange{ xset, captured->type, captured->position, false };
+  }
+  result = sums;
+  network.Update(xset, accumulator.kings[EvalAccumulator::Side(xset)], changes.data(), count, result);
+  if (move.piece.type != Type::king) {
+    network.Update(set, accumulator.kings[EvalAccumulator::Side(set)], changes.data(), count, result);
+    return;
+  }
+  Pieces after = pieces;
+  for (auto& piece : after) {
+    if (piece.position == move.piece.position) {
+      piece.position = move.to;
+    } else if (count == 2 && piece.position == changes[0].square) {
+      piece.position = changes[1].square; // the rook of castling
+    }
+  }
+  Pieces xafter;
+  std::copy_if(xpieces.begin(), xpieces.end(), std::back_inserter(xafter), [&](const Piece& p) { return !captured || p.position != captured->position; });
+  network.Refresh(set, set == Set::white ? after : xafter, set == Set::white ? xafter : after, result);
+}
+
+float GreedyEngine::EvalSide(const IMachine& position, Set set, const Pieces& pieces, const Pieces& xpieces, bool pawns) const {
   float score = 0;
   for (const auto& piece : pieces) {
-    score += PieceWeight(piece.type) + PositionWeight(set, piece, pieces, xpieces) + 0.001f * position.EnumMoves(piece.position).size();
+    score += DynamicWeight(set, piece, xpieces, pawns) + 0.001f * position.EnumMoves(piece.position).size();
   }
   return score;
 }
 
+HashCache<3>::Data GreedyEngine::PawnStructure(uint64_t pawnkey, const Pieces& white, const Pieces& black) const {
+  HashCache<3>::Data structure;
+  if (!pawncache.Probe(pawnkey, structure)) {
+    structure = EvalPawns(white, black);
+    pawncache.Store(pawnkey, structure);
+  }
+  return structure;
+}
+
+HashCache<3>::Data GreedyEngine::EvalPawns(const Pieces& white, const Pieces& black) const {
+  // Pawns of both sides by file and rank, the ranks are counted from the own side.
+  std::array<std::array<std::array<bool, 8>, 10>, 2> pawns = {}; // [side][file + 1][rank], with empty edge files
+  std::array<uint64_t, 2> squares = {};
+  for (Set set : { Set::white, Set::black }) {
+    const int side = EvalAccumulator::Side(set);
+    for (const auto& piece : set == Set::white ? white : black) {
+      if (piece.type == Type::pawn) {
+        const int rank = set == Set::white ? piece.position.y() : 7 - piece.position.y();
+        pawns[side][piece.position.x() + 1][rank] = true;
+        squares[side] |= 1ull << piece.position.pos();
+      }
+    }
+  }
+  float score = 0;
+  for (int side = 0; side < 2; ++side) {
+    const auto& own = pawns[side];
+    const auto& enemy = pawns[1 - side];
+    float sidescore = 0;
+    for (int file = 1; file <= 8; ++file) {
+      bool behind = false;
+      for (int rank = 1; rank < 7; ++rank) {
+        if (!own[file][rank]) {
+          continue;
+        }
+        sidescore += behind ? DoubledPawn : 0.0f;
+        behind = true;
+        // The ranks of the enemy pawns are mirrored to the own side.
+        bool passed = true;
+        for (int f = file - 1; f <= file + 1; ++f) {
+          for (int r = rank + 1; r < 7; ++r) {
+            passed = passed && !enemy[f][7 - r];
+          }
+        }
+        sidescore += passed ? PassedPawn[rank] : 0.0f;
+        const bool isolated = std::none_of(own[file - 1].begin(), own[file - 1].end(), [](bool p) { return p; }) &&
+                              std::none_of(own[file + 1].begin(), own[file + 1].end(), [](bool p) { return p; });
+        sidescore += isolated ? IsolatedPawn : 0.0f;
+        if (!isolated && !passed && rank < 6) {
+          bool supported = false;
+          for (int r = 1; r <= rank; ++r) {
+            supported = supported || own[file - 1][r] || own[file + 1][r];
+          }
+          const bool guarded = enemy[file - 1][7 - (rank + 2)] || enemy[file + 1][7 - (rank + 2)];
+          sidescore += !supported && guarded ? BackwardPawn : 0.0f;
+        }
+      }
+    }
+    score += side == 0 ? sidescore : -sidescore;
+  }
+  return { ToBits(score), squares[0], squares[1] };
+}
+
+float GreedyEngine::PawnShield(Set set, const Pieces& pieces, uint64_t pawns) const {
+  auto king = std::find_if(pieces.begin(), pieces.end(), [](const Piece& p) { return p.type == Type::king; });
+  if (king == pieces.end()) {
+    return 0;
+  }
+  const int forward = set == Set::white ? 1 : -1;
+  const int rank = set == Set::white ? king->position.y() : 7 - king->position.y();
+  if (rank > 1) {
+    return 0;
+  }
+  float shield = 0;
+  for (int x = std::max(0, king->position.x() - 1); x <= std::min(7, king->position.x() + 1); ++x) {
+    for (int ahead = 1; ahead <= 2; ++ahead) {
+      const int y = king->position.y() + ahead * forward;
+      if ((pawns >> ((x << 3) + y)) & 1) {
+        shield += ShieldPawn[ahead - 1];
+        break;
+      }
+    }
+  }
+  return shield;
+}
+
 float GreedyEngine::PieceWeight(Type type) const {
-  static const std::map<Type, float> weights = { {Type::pawn, 1.0f}, {Type::knight, 3.0f}, {Type::bishop, 3.0f}, {Type::rook, 5.0f}, {Type::queen, 9.0f}, {Type::king, 0.0f} };
-  return weights.at(type);
-}
-
-float GreedyEngine::PositionWeight(Set set, const Piece & piece, const Pieces& pieces, const Pieces& xpieces) const {
-  static const float pawn[8][8] =   { {  0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f },
-                                      {  0.004f, 0.004f, 0.004f, 0.000f, 0.000f, 0.004f, 0.004f, 0.004f },
-                                      {  0.006f, 0.008f, 0.002f, 0.010f, 0.010f, 0.002f, 0.008f, 0.006f },
-                                      {  0.006f, 0.008f, 0.012f, 0.016f, 0.016f, 0.012f, 0.008f, 0.006f },
-                                      {  0.008f, 0.012f, 0.016f, 0.024f, 0.024f, 0.016f, 0.012f, 0.008f },
-                                      {  0.012f, 0.016f, 0.024f, 0.032f, 0.032f, 0.024f, 0.016f, 0.012f },
-                                      {  0.012f, 0.016f, 0.024f, 0.032f, 0.032f, 0.024f, 0.016f, 0.012f },
-                                      {  0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f } };
-
-  static const float knight[8][8] = { {  0.000f, 0.004f, 0.008f, 0.010f, 0.010f, 0.008f, 0.004f, 0.000f },
-                                      {  0.004f, 0.008f, 0.016f, 0.020f, 0.020f, 0.016f, 0.008f, 0.004f },
-                                      {  0.008f, 0.016f, 0.024f, 0.028f, 0.028f, 0.024f, 0.016f, 0.008f },
-                                      {  0.010f, 0.020f, 0.028f, 0.032f, 0.032f, 0.028f, 0.020f, 0.010f },
-                                      {  0.010f, 0.020f, 0.028f, 0.032f, 0.032f, 0.028f, 0.020f, 0.010f },
-                                      {  0.008f, 0.016f, 0.024f, 0.028f, 0.028f, 0.024f, 0.016f, 0.008f },
-                                      {  0.004f, 0.008f, 0.016f, 0.020f, 0.020f, 0.016f, 0.008f, 0.004f },
-                                      {  0.000f, 0.004f, 0.008f, 0.010f, 0.010f, 0.008f, 0.004f, 0.000f } };
-
-  static const float bishop[8][8] = { {  0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f },
-                                      {  0.014f, 0.022f, 0.018f, 0.018f, 0.018f, 0.018f, 0.022f, 0.014f },
-                                      {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
-                                      {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
-                                      {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
-                                      {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
-                                      {  0.014f, 0.022f, 0.018f, 0.018f, 0.018f, 0.018f, 0.022f, 0.014f },
-                                      {  0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f } };
-
-  static const float king1[8][8] =  { {  0.000f, 0.000f,-0.004f,-0.010f,-0.010f,-0.004f, 0.000f, 0.000f },
-                                      { -0.004f,-0.004f,-0.008f,-0.012f,-0.012f,-0.008f,-0.004f,-0.004f },
-                                      { -0.012f,-0.016f,-0.020f,-0.020f,-0.020f,-0.020f,-0.016f,-0.012f },
-                                      { -0.016f,-0.020f,-0.024f,-0.024f,-0.024f,-0.024f,-0.020f,-0.016f },
-                                      { -0.016f,-0.020f,-0.024f,-0.024f,-0.024f,-0.024f,-0.020f,-0.016f },
-                                      { -0.012f,-0.016f,-0.020f,-0.020f,-0.020f,-0.020f,-0.016f,-0.012f },
-                                      { -0.004f,-0.004f,-0.008f,-0.012f,-0.012f,-0.008f,-0.004f,-0.004f },
-                                      {  0.000f, 0.000f,-0.004f,-0.010f,-0.010f,-0.004f, 0.000f, 0.000f } };
-
-  static const float king2[8][8] =  { {  0.000f, 0.006f, 0.012f, 0.018f, 0.018f, 0.012f, 0.006f, 0.000f },
-                                      {  0.006f, 0.012f, 0.018f, 0.024f, 0.024f, 0.018f, 0.012f, 0.006f },
-                                      {  0.012f, 0.018f, 0.024f, 0.030f, 0.030f, 0.024f, 0.018f, 0.012f },
-                                      {  0.018f, 0.024f, 0.030f, 0.036f, 0.036f, 0.030f, 0.024f, 0.018f },
-                                      {  0.018f, 0.024f, 0.030f, 0.036f, 0.036f, 0.030f, 0.024f, 0.018f },
-                                      {  0.012f, 0.018f, 0.024f, 0.030f, 0.030f, 0.024f, 0.018f, 0.012f },
-                                      {  0.006f, 0.012f, 0.018f, 0.024f, 0.024f, 0.018f, 0.012f, 0.006f },
-                                      {  0.000f, 0.006f, 0.012f, 0.018f, 0.018f, 0.012f, 0.006f, 0.000f } };
-
-  int x = piece.position.x();
-  assert(x >= 0 && x < 8);
-  int y = piece.position.y();
-  assert(y >= 0 && y <8);
+  return params.Material(type);
+}
+
+float GreedyEngine::SquareWeight(Set set, Type type, Position position) const {
+  assert(position.isValid());
+  switch (type) {
+  case Type::pawn:    return params.Square(EvalTable::pawn, set, position);
+  case Type::knight:  return params.Square(EvalTable::knight, set, position);
+  case Type::bishop:  return params.Square(EvalTable::bishop, set, position);
+  default:            return 0; // The weights of the queen and the king depend on the other pieces.
+  }
+}
+
+float GreedyEngine::DynamicWeight(Set set, const Piece& piece, const Pieces& xpieces, bool pawns) const {
+  const int x = piece.position.x();
+  const int y = piece.position.y();
   switch (piece.type) {
-  case Type::pawn:
-    if (set == Set::black) {
-      y = 7 - y;
-    }
-    return pawn[y][x];
-  case Type::knight:  return knight[y][x];
-  case Type::bishop:  return bishop[y][x];
-  case Type::rook:    return 0;
   case Type::queen:
   {
     auto xking = std::find_if(xpieces.begin(), xpieces.end(), [](auto p) { return p.type == Type::king; });
     assert(xking != xpieces.end());
     return (2 * 8 * 8 - ((x - xking->position.x()) * (x - xking->position.x()) + (y - xking->position.y()) * (y - xking->position.y()))) / 4000.0f;
   }
-  case Type::king:
-  {
-    const float(&king)[8][8] = std::any_of(pieces.begin(), pieces.end(), [](auto p) { return p.type == Type::pawn; }) ||
-                             std::any_of(xpieces.begin(), xpieces.end(), [](auto p) { return p.type == Type::pawn; }) ? king1 : king2;
-    return king[y][x];
+  case Type::king:    return params.Square(pawns ? EvalTable::king : EvalTable::kingendgame, set, piece.position);
+  default:            return 0;
   }
-  default:
-    assert(!"Bad piece type");
+}
+
+void GreedyEngine::FillBatchWeights() {
+  batchweights.fill(0);
+  for (bool pawns : { true, false }) {
+    const int table = pawns ? 0 : BatchCodes * EvalBatch::Squares;
+    for (Set set : { Set::white, Set::black }) {
+      for (Type type : { Type::pawn, Type::knight, Type::bishop, Type::rook, Type::queen, Type::king }) {
+        for (int x = 0; x < 8; ++x) {
+          for (int y = 0; y < 8; ++y) {
+            const Piece piece = { type, Position((x << 4) | y) };
+            // The queen depends on the other king, it is counted apart from the weights.
+            float weight = PieceWeight(type) + SquareWeight(set, type, piece.position) +
+                           (type == Type::king ? DynamicWeight(set, piece, Pieces(), pawns) : 0.0f);
+            batchweights[table + BatchCode(set, type) * EvalBatch::Squares + piece.position.pos()] =
+              set == Set::white ? weight : -weight;
+          }
+        }
+      }
+    }
   }
-  return 0;
 }
 
 }
@@ -2,11 +2,24 @@
 
 #include <Interfaces/chessmachine.h>
 
+#include "bitbase.h"
+#include "book.h"
+#include "evalbatch.h"
+#include "evalparams.h"
+#include "hashcache.h"
+#include "network.h"
+#include "searchthread.h"
+
 #include <boost/asio.hpp>
 #include <boost/container/small_vector.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
 namespace Chai {
 namespace Chess {
 
@@ -18,45 +31,274 @@ struct Move {
 
 typedef boost::container::small_vector<Move, 50> Moves;
 
-class GreedyEngine : public IEngine, private IInfoCall {
+struct SearchOptions {
+    // Quiescence search at the horizon: stand pat, captures and queen promotions.
+    int qmaxdepth = 8;        // hard limit of plies in the quiescence search
+    bool qchecks = true;      // quiet moves giving a direct check are searched at the first quiescence ply
+    bool qskiplosing = true;  // captures and checks losing material by the static exchange evaluation are skipped
+    float deltamargin = 2.0f; // captures that can not raise the score above alpha even with this margin are skipped
+
+    // Selective search, each technique can be switched off separately.
+    bool pvs = true;                    // principal variation search with zero window re-searches
+    bool nullmove = true;               // null move pruning
+    int nullmovedepth = 3;              // minimal remaining depth to try the null move
+    int nullmovereduction = 2;          // depth reduction of the null move search (one more deeper than 6 plies)
+    int nullverifydepth = 5;            // null move cutoffs from this depth on are verified by a reduced search
+    bool lmr = true;                    // late move reductions of quiet moves
+    int lmrdepth = 3;                   // minimal remaining depth to reduce
+    int lmrmoves = 3;                   // number of moves searched at full depth
+    float lmrbase = 0.75f;              // reduction = base + ln(depth) * ln(move index) / divisor
+    float lmrdivisor = 2.25f;           //
+    bool futility = true;               // futility pruning of quiet moves at the frontier
+    int futilitydepth = 2;              // maximal remaining depth to prune
+    float futilitymargin = 1.0f;        // per ply of the remaining depth, in pawns
+    bool reversefutility = true;        // reverse futility (static null move) pruning
+    int reversefutilitydepth = 3;       // maximal remaining depth to prune
+    float reversefutilitymargin = 1.2f; // per ply of the remaining depth, in pawns
+    bool seepruning = true;             // pruning of moves losing material by the static exchange near the frontier
+    int seepruningdepth = 3;            // maximal remaining depth to prune
+    float seepruningmargin = 1.0f;      // loss allowed per ply of the remaining depth, in pawns
+
+    // Worker threads making the moves of a node together, the search thread walks the tree alone. 0 runs one worker per
+    // processor, 1 makes the moves on the search thread, so the whole search runs on a single thread.
+    int threads = 0;
+
+    // Progress reports sent during the search.
+    int reportinterval = 100; // milliseconds between the reports
+    size_t reportnodes = 0;   // if not zero, the reports are sent every this number of nodes instead
+
+    // Evaluations of the positions met again through another move order.
+    size_t evalcache = 1 << 16; // entries, rounded down to a power of two, 0 switches the cache off
+    size_t pawncache = 1 << 14; // entries of the pawn structure cache, the same way
+    size_t transpositions = 1 << 17; // entries of the search results, shared by the searches and the lines of multi-PV
+
+    // Analysis of several best root moves, each one reported with its exact score and line.
+    int multipv = 1;
+
+    // Opening book built by BookBuilder, the most played move of a book position is returned without a search.
+    std::string book; // the file name, empty switches the book off
+
+    // Endgame bitbases of BitbaseGenerator, the positions found there get their exact result in the search.
+    std::string bitbases; // the directory of the files, empty switches them off
+
+    // Evaluation network written by NetworkWeights::Write, it evaluates the positions instead of the weights.
+    std::string network; // the file name, empty switches the network off
+
+    // Material and square weights written by EvalParams::Write, a tuned set instead of the hand-set one.
+    std::string evalparams; // the file name, empty for EvalParams::Default
+};
+
+/**
+  Search statistics counted by every thread taking part in the search on a cache line of its own, so the threads never
+  share a line they write. They are summed into SearchStatistics when the search is over. A counter whose bit is clear
+  in CHAI_SEARCH_STATS is compiled out, all of them are counted by default.
+*/
+#ifndef CHAI_SEARCH_STATS
+#define CHAI_SEARCH_STATS 0xffffffffu
+#endif
+
+enum class SearchStat {
+    nodes,
+    evaluations,
+    betacutoffs,
+    firstmovecutoffs,
+    ttprobes,
+    tthits,
+    clones,
+    movesgenerated,
+    checks,
+    checkmates,
+    stalemates,
+    aborts,
+    nullmoves,
+    nullverifications,
+    nullcutoffs,
+    lmrreductions,
+    lmrresearches,
+    pvsresearches,
+    futility,
+    reversefutility,
+    seepruned,
+    ttcutoffs,
+    bitbasehits,
+    count
+};
+
+struct alignas(64) SearchStatCounters {
+    std::array<size_t, static_cast<size_t>(SearchStat::count)> values{};
+
+    static constexpr bool Enabled(SearchStat stat) {
+        return ((CHAI_SEARCH_STATS) >> static_cast<unsigned>(stat)) & 1u;
+    }
+    template <SearchStat Stat>
+    void Add(size_t n = 1) {
+        if constexpr (Enabled(Stat)) {
+            values[static_cast<size_t>(Stat)] += n;
+        }
+    }
+};
+
+// Material and square weights of both sides carried along the search. Every move updates them by its difference, so
+// only the terms depending on the other pieces and the mobility are counted at the leaves. The weights are summed in
+// whole millipawns, so the score of a position does not depend on the moves that led to it.
+struct EvalAccumulator {
+    std::array<int, 2> material{}; // indexed by Side
+    std::array<int, 2> squares{};
+    std::array<int, 2> pawns{};
+    uint64_t pawnkey = 0; // Zobrist key of the pawns only, the key of the pawn structure cache
+    std::array<Position, 2> kings;
+
+    static int Side(Set set) {
+        return set == Set::white ? 0 : 1;
+    }
+    int Score(Set set) const {
+        return material[Side(set)] + squares[Side(set)];
+    }
+};
+
+class GreedyEngine : public IEngine {
     typedef boost::tuple<bool, boost::shared_ptr<IMachine>, Move> TaskData;
+    typedef boost::container::small_vector<TaskData, 8> MachinePool;
 
  public:
-    GreedyEngine();
+    explicit GreedyEngine(const SearchOptions& opts = SearchOptions());
+    GreedyEngine(const SearchOptions& opts, const EvalParams& weights); // the weights instead of opts.evalparams
     ~GreedyEngine() override;
 
     bool Start(const IMachine& position, int depth) override;
     void Stop() override;
+    bool Ponder(const IMachine& position, int depth) override;
+    void PonderHit() override;
     void ProcessInfo(IInfoCall* cb) override;
+    bool WaitInfo(int milliseconds) override;
     float EvalPosition(const IMachine& position) const override;
+    void EvalPositions(const PositionSnapshot* positions, size_t count, float* scores) const override;
+    void EvalPositions(const PositionSnapshot* positions, size_t count, float* scores, EvalKernel kernel) const;
 
- private:
-    void NodesSearched(size_t nodes) override;
-    void NodesPerSecond(int nps) override;
-    void ReadyOk() override;
-    void BestMove(std::string notation) override;
-    void BestScore(float score) override;
+    SearchStatistics Statistics() const;  // Statistics of the last search delivered by ProcessInfo.
+    HashStats EvalCacheStats() const;     // Probes and hits of the evaluation cache since the engine was created.
+    HashStats PawnCacheStats() const;     // Probes and hits of the pawn structure cache since the engine was created.
+    HashStats TranspositionStats() const; // Probes and hits of the transposition table since the engine was created.
+
+    // Evaluation with the accumulator of the position, which is counted once and then updated by every move made. The
+    // network sums are kept apart the same way and used only if the network is loaded, without them they are counted.
+    float EvalPosition(const IMachine& position, const EvalAccumulator& accumulator,
+                       const NetworkAccumulator* sums = nullptr) const;
+    EvalAccumulator Accumulate(const IMachine& position) const;
+    EvalAccumulator Accumulate(const EvalAccumulator& accumulator, Set set, const Move& move, const Pieces& pieces,
+                               const Pieces& xpieces) const;
+    void AccumulateNetwork(const IMachine& position, NetworkAccumulator& sums) const;
+    void AccumulateNetwork(const NetworkAccumulator& sums, const EvalAccumulator& accumulator, Set set, const Move& move,
+                           const Pieces& pieces, const Pieces& xpieces, NetworkAccumulator& result) const;
 
+ private:
+    bool StartSearch(const IMachine& position, int depth, bool ponder);
+    void StartWorkers();
     void ThreadFun(boost::shared_ptr<IMachine> machine, int maxdepth);
-    float Search(const IMachine& machine, int depth, size_t& nodes, float alpha, const float betta,
-                 std::string* bestmove = nullptr);
+    float Search(const IMachine& machine, const EvalAccumulator& eval, int depth, int ply, size_t& nodes, float alpha,
+                 const float betta, bool nullmove = true);
+    float Quiesce(const IMachine& machine, const EvalAccumulator& eval, int ply, int qply, size_t& nodes, float alpha,
+                  const float betta);
+    float StoreTransposition(uint64_t key, int depth, int ply, float alpha, float betta, float score);
     Moves EmunMoves(const IMachine& position) const;
-    void TaskFun(TaskData& data);
+    Moves EnumTacticalMoves(const IMachine& position, bool checks) const;
+    void OrderMoves(const IMachine& position, Moves& moves, const Pieces& xpieces) const;
+    float MoveGain(const Move& move, const Pieces& xpieces) const;
+    bool HasPieces(const IMachine& position) const;
+    bool BookMove(const IMachine& position, Move& move) const;
+    float EvalNode(const IMachine& position, const EvalAccumulator& eval, int ply) const {
+        return EvalPosition(position, eval, network.Loaded() ? &networksums[ply] : nullptr);
+    }
+    bool ProbeBitbases(const IMachine& position, const EvalAccumulator& eval, int ply, float& score);
+    std::vector<std::string> Notations(const IMachine& machine, const Moves& line) const;
+    void CheckProgress(size_t nodes);
+    void ReportProgress(size_t nodes);
+    int HashUsage() const;
+    void MakeMoves(const IMachine& machine, Moves::const_iterator& move, Moves::const_iterator end, MachinePool& pool);
+    void TaskFun(TaskData& data, SearchStatCounters& stats);
+    void MakeMove(TaskData& data, SearchStatCounters& stats) const;
+    template <SearchStat Stat>
+    void Count(size_t n = 1) {
+        statcounters.front().Add<Stat>(n); // by the search thread
+    }
+    void CountStatus(Status status);
+    float Aborted(float alpha) { // the score of a node given up by the stopped search
+        Count<SearchStat::aborts>();
+        return alpha;
+    }
 
-    float EvalSide(const IMachine& position, Set set, const Pieces& white, const Pieces& black) const;
+    float EvalSide(const IMachine& position, Set set, const Pieces& pieces, const Pieces& xpieces, bool pawns) const;
     float PieceWeight(Type type) const;
-    float PositionWeight(Set set, const Piece& piece, const Pieces& white, const Pieces& black) const;
+    float SquareWeight(Set set, Type type, Position position) const;
+    float DynamicWeight(Set set, const Piece& piece, const Pieces& xpieces, bool pawns) const;
+    HashCache<3>::Data PawnStructure(uint64_t pawnkey, const Pieces& white, const Pieces& black) const;
+    HashCache<3>::Data EvalPawns(const Pieces& white, const Pieces& black) const;
+    float PawnShield(Set set, const Pieces& pieces, uint64_t pawns) const;
+    void FillBatchWeights();
+    void EvalBatchWeights(const PositionSnapshot* positions, size_t count, float* scores, EvalKernel kernel) const;
+
+    const SearchOptions options;
+    EvalParams params;
+
+    // Material and square weights of the batch evaluation: two tables, with and without pawns on the board, of the 13
+    // piece codes (none, then white and black pawn to king) on every square. Black weights are negative.
+    static const int BatchCodes = 13;
+    std::array<float, 2 * BatchCodes * EvalBatch::Squares> batchweights;
+
+    mutable HashCache<1> evalcache; // filled by the const evaluation, keeps the bits of the score
+    mutable HashCache<3> pawncache; // the bits of the white structure score, white and black pawns by square
+    HashCache<2> transpositions;    // the bits of the score with the depth and the bound, the best move
+    OpeningBook book;
+    Bitbases bitbases;
+    Network network;
+    std::vector<NetworkAccumulator> networksums; // of the positions on the searched line by ply, if the network is loaded
+    std::chrono::microseconds startlatency; // of the current search
+    SearchStatistics laststatistics;
 
-    boost::asio::io_service cbservice;
-    boost::thread mainthread;
-    IInfoCall* callBack;
-    volatile bool aborted;
+    // Triangular table of principal variations: the line found at every ply of the current iteration.
+    static const int MaxPly = 64;
+    std::array<std::array<Move, MaxPly>, MaxPly + 1> pvtable;
+    std::array<int, MaxPly + 1> pvlength;
+    Moves pvline; // The principal variation of the last completed iteration.
+    bool followpv;
 
+    // Multi-PV: the best root moves of the current iteration with their lines, the best first. The lines of the last
+    // completed iteration are searched first in the next one.
+    struct RootLine {
+        float score;
+        Moves line;
+    };
+    std::vector<RootLine> rootlines;
+    std::vector<RootLine> lastlines;
+
+    // Progress of the current search. The tree is walked by the search thread only, the workers just make moves, so
+    // the node count stays a plain counter of that thread and is checked against the report threshold on every node.
+    std::chrono::steady_clock::time_point starttime;
+    std::chrono::steady_clock::time_point nextreport;
+    size_t nextprogress;
+    int iterationdepth;
+    int seldepth;
+    const IMachine* rootposition;
+    Move currmove;      // the root move searched
+    int currmovenumber; // 0 while no root move is searched
+
+    std::atomic<bool> aborted; // checked on every node and by the workers before every move
+    InfoChannel infochannel;   // the search posts a line per iteration at most
+
+    // The workers start with the first search, live as long as the engine and wait for the moves between searches.
     boost::asio::io_service taskservice;
+    std::unique_ptr<boost::asio::io_service::work> taskwork;
+    boost::thread_group threadpool;
     boost::condition_variable condtasks;
     boost::mutex muttasks;
     int workingtasks;
-    const int maxthreads = std::max(1u, boost::thread::hardware_concurrency());
+    const int maxthreads; // moves made together, by the workers of the pool or by the search thread if it is 1
+    // Counters of the current search: the search thread counts in the first block, the worker making the move i of a
+    // batch in the block i + 1.
+    std::vector<SearchStatCounters> statcounters;
+
+    // The last member, so the search thread is gone before the members it uses.
+    SearchThread searchthread;
 };
 
 } // namespace Chess
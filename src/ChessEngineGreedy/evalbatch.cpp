@@ -0,0 +1,118 @@
+#include "evalbatch.h"
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHAI_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(CHAI_X86) && defined(__GNUC__)
+#define CHAI_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CHAI_TARGET(isa)
+#endif
+
+namespace Chai {
+namespace Chess {
+
+EvalBatch::EvalBatch(size_t size)
+  : count(size), stride((size + Lanes - 1) / Lanes * Lanes), indices(Squares * stride, 0), extra(stride, 0.0f), sign(stride, 1.0f) {
+}
+
+namespace {
+
+void ScalarKernel(const float* weights, const EvalBatch& batch, float* scores) {
+  for (size_t i = 0; i < batch.stride; ++i) {
+    float sum = 0;
+    for (int s = 0; s < EvalBatch::Squares; ++s) {
+      sum += weights[batch.indices[s * batch.stride + i]];
+    }
+    scores[i] = (sum + batch.extra[i]) * batch.sign[i];
+  }
+}
+
+#if defined(CHAI_X86)
+
+// SSE has no gather, the weights of four positions are loaded one by one and added at once.
+CHAI_TARGET("sse2") void SseKernel(const float* weights, const EvalBatch& batch, float* scores) {
+  for (size_t i = 0; i < batch.stride; i += 4) {
+    __m128 sum = _mm_setzero_ps();
+    for (int s = 0; s < EvalBatch::Squares; ++s) {
+      const int32_t* index = &batch.indices[s * batch.stride + i];
+      sum = _mm_add_ps(sum, _mm_set_ps(weights[index[3]], weights[index[2]], weights[index[1]], weights[index[0]]));
+    }
+    sum = _mm_add_ps(sum, _mm_loadu_ps(&batch.extra[i]));
+    _mm_storeu_ps(&scores[i], _mm_mul_ps(sum, _mm_loadu_ps(&batch.sign[i])));
+  }
+}
+
+CHAI_TARGET("avx2") void Avx2Kernel(const float* weights, const EvalBatch& batch, float* scores) {
+  for (size_t i = 0; i < batch.stride; i += 8) {
+    __m256 sum = _mm256_setzero_ps();
+    for (int s = 0; s < EvalBatch::Squares; ++s) {
+      const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&batch.indices[s * batch.stride + i]));
+      sum = _mm256_add_ps(sum, _mm256_i32gather_ps(weights, index, 4));
+    }
+    sum = _mm256_add_ps(sum, _mm256_loadu_ps(&batch.extra[i]));
+    _mm256_storeu_ps(&scores[i], _mm256_mul_ps(sum, _mm256_loadu_ps(&batch.sign[i])));
+  }
+}
+
+bool CpuHasAvx2() {
+#if defined(__GNUC__)
+  return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  __cpuidex(info, 7, 0);
+  const bool avx2 = (info[1] & (1 << 5)) != 0;
+  return avx2 && osxsave && (_xgetbv(0) & 6) == 6; // the system saves the AVX registers
+#else
+  return false;
+#endif
+}
+
+#endif
+
+}
+
+bool KernelSupported(EvalKernel kernel) {
+  switch (kernel) {
+  case EvalKernel::scalar:  return true;
+#if defined(CHAI_X86)
+  case EvalKernel::sse:     return true;
+  case EvalKernel::avx2:    return CpuHasAvx2();
+#endif
+  default:                  return false;
+  }
+}
+
+EvalKernel BestKernel() {
+  static const EvalKernel best = KernelSupported(EvalKernel::avx2) ? EvalKernel::avx2 :
+                                 KernelSupported(EvalKernel::sse) ? EvalKernel::sse : EvalKernel::scalar;
+  return best;
+}
+
+void RunEvalBatch(EvalKernel kernel, const float* weights, const EvalBatch& batch, std::vector<float>& scores) {
+  assert(KernelSupported(kernel));
+  scores.resize(batch.stride);
+  switch (kernel) {
+#if defined(CHAI_X86)
+  case EvalKernel::sse:     SseKernel(weights, batch, scores.data()); break;
+  case EvalKernel::avx2:    Avx2Kernel(weights, batch, scores.data()); break;
+#endif
+  default:                  ScalarKernel(weights, batch, scores.data()); break;
+  }
+}
+
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+/**
+  Positions evaluated together, laid out as a structure of arrays.
+
+  Every square keeps a row with the weight index of its piece in all the positions, so a kernel loads the same square
+  of several positions by one instruction. The result of a position is sign * (sum of the weights + extra).
+*/
+struct EvalBatch {
+    static const size_t Lanes = 8; // the positions are padded to the width of the widest kernel
+    static const int Squares = 64;
+
+    explicit EvalBatch(size_t size);
+
+    size_t count;
+    size_t stride;                // count rounded up to the lanes
+    std::vector<int32_t> indices; // [square * stride + position] index into the weights, empty squares point to zero
+    std::vector<float> extra;     // [position] terms counted outside of the weights
+    std::vector<float> sign;      // [position] 1 if white is to move, -1 otherwise
+};
+
+enum class EvalKernel { scalar, sse, avx2 };
+
+bool KernelSupported(EvalKernel kernel);
+EvalKernel BestKernel(); // The widest kernel the processor runs, chosen once.
+
+// Every kernel adds the weights in the same order, so they all give exactly the same scores.
+void RunEvalBatch(EvalKernel kernel, const float* weights, const EvalBatch& batch, std::vector<float>& scores);
+
+} // namespace Chess
+} // namespace Chai
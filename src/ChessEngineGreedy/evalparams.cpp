@@ -0,0 +1,169 @@
+#include "evalparams.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <fstream>
+#include <iomanip>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const float PawnSquares[8][8] = { {  0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f },
+                                  {  0.004f, 0.004f, 0.004f, 0.000f, 0.000f, 0.004f, 0.004f, 0.004f },
+                                  {  0.006f, 0.008f, 0.002f, 0.010f, 0.010f, 0.002f, 0.008f, 0.006f },
+                                  {  0.006f, 0.008f, 0.012f, 0.016f, 0.016f, 0.012f, 0.008f, 0.006f },
+                                  {  0.008f, 0.012f, 0.016f, 0.024f, 0.024f, 0.016f, 0.012f, 0.008f },
+                                  {  0.012f, 0.016f, 0.024f, 0.032f, 0.032f, 0.024f, 0.016f, 0.012f },
+                                  {  0.012f, 0.016f, 0.024f, 0.032f, 0.032f, 0.024f, 0.016f, 0.012f },
+                                  {  0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f, 0.000f } };
+
+const float KnightSquares[8][8] = { {  0.000f, 0.004f, 0.008f, 0.010f, 0.010f, 0.008f, 0.004f, 0.000f },
+                                    {  0.004f, 0.008f, 0.016f, 0.020f, 0.020f, 0.016f, 0.008f, 0.004f },
+                                    {  0.008f, 0.016f, 0.024f, 0.028f, 0.028f, 0.024f, 0.016f, 0.008f },
+                                    {  0.010f, 0.020f, 0.028f, 0.032f, 0.032f, 0.028f, 0.020f, 0.010f },
+                                    {  0.010f, 0.020f, 0.028f, 0.032f, 0.032f, 0.028f, 0.020f, 0.010f },
+                                    {  0.008f, 0.016f, 0.024f, 0.028f, 0.028f, 0.024f, 0.016f, 0.008f },
+                                    {  0.004f, 0.008f, 0.016f, 0.020f, 0.020f, 0.016f, 0.008f, 0.004f },
+                                    {  0.000f, 0.004f, 0.008f, 0.010f, 0.010f, 0.008f, 0.004f, 0.000f } };
+
+const float BishopSquares[8][8] = { {  0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f },
+                                    {  0.014f, 0.022f, 0.018f, 0.018f, 0.018f, 0.018f, 0.022f, 0.014f },
+                                    {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
+                                    {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
+                                    {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
+                                    {  0.014f, 0.018f, 0.022f, 0.022f, 0.022f, 0.022f, 0.018f, 0.014f },
+                                    {  0.014f, 0.022f, 0.018f, 0.018f, 0.018f, 0.018f, 0.022f, 0.014f },
+                                    {  0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f, 0.014f } };
+
+const float KingSquares[8][8] = { {  0.000f, 0.000f,-0.004f,-0.010f,-0.010f,-0.004f, 0.000f, 0.000f },
+                                  { -0.004f,-0.004f,-0.008f,-0.012f,-0.012f,-0.008f,-0.004f,-0.004f },
+                                  { -0.012f,-0.016f,-0.020f,-0.020f,-0.020f,-0.020f,-0.016f,-0.012f },
+                                  { -0.016f,-0.020f,-0.024f,-0.024f,-0.024f,-0.024f,-0.020f,-0.016f },
+                                  { -0.016f,-0.020f,-0.024f,-0.024f,-0.024f,-0.024f,-0.020f,-0.016f },
+                                  { -0.012f,-0.016f,-0.020f,-0.020f,-0.020f,-0.020f,-0.016f,-0.012f },
+                                  { -0.004f,-0.004f,-0.008f,-0.012f,-0.012f,-0.008f,-0.004f,-0.004f },
+                                  {  0.000f, 0.000f,-0.004f,-0.010f,-0.010f,-0.004f, 0.000f, 0.000f } };
+
+const float KingEndgameSquares[8][8] = { {  0.000f, 0.006f, 0.012f, 0.018f, 0.018f, 0.012f, 0.006f, 0.000f },
+                                         {  0.006f, 0.012f, 0.018f, 0.024f, 0.024f, 0.018f, 0.012f, 0.006f },
+                                         {  0.012f, 0.018f, 0.024f, 0.030f, 0.030f, 0.024f, 0.018f, 0.012f },
+                                         {  0.018f, 0.024f, 0.030f, 0.036f, 0.036f, 0.030f, 0.024f, 0.018f },
+                                         {  0.018f, 0.024f, 0.030f, 0.036f, 0.036f, 0.030f, 0.024f, 0.018f },
+                                         {  0.012f, 0.018f, 0.024f, 0.030f, 0.030f, 0.024f, 0.018f, 0.012f },
+                                         {  0.006f, 0.012f, 0.018f, 0.024f, 0.024f, 0.018f, 0.012f, 0.006f },
+                                         {  0.000f, 0.006f, 0.012f, 0.018f, 0.018f, 0.012f, 0.006f, 0.000f } };
+
+const char* Names[EvalParams::Tables + 1] = { "pieces", "pawn", "knight", "bishop", "king", "kingendgame" };
+
+}
+
+EvalParams EvalParams::Default() {
+  EvalParams params;
+  const float pieces[Materials] = { 1.0f, 3.0f, 3.0f, 5.0f, 9.0f };
+  std::copy(pieces, pieces + Materials, params.values.begin());
+  const float (*tables[Tables])[8] = { PawnSquares, KnightSquares, BishopSquares, KingSquares, KingEndgameSquares };
+  for (int table = 0; table < Tables; ++table) {
+    for (int y = 0; y < 8; ++y) {
+      std::copy(tables[table][y], tables[table][y] + 8, params.values.begin() + Materials + table * 64 + y * 8);
+    }
+  }
+  return params;
+}
+
+EvalParams EvalParams::Zero() {
+  EvalParams params;
+  params.values.fill(0);
+  return params;
+}
+
+int EvalParams::PieceIndex(Type type) {
+  switch (type) {
+  case Type::pawn:    return 0;
+  case Type::knight:  return 1;
+  case Type::bishop:  return 2;
+  case Type::rook:    return 3;
+  case Type::queen:   return 4;
+  case Type::king:    return -1;
+  default:
+    assert(!"Bad piece type");
+  }
+  return -1;
+}
+
+int EvalParams::SquareIndex(EvalTable table, Set set, Position position) {
+  const int y = set == Set::white ? position.y() : 7 - position.y();
+  return Materials + static_cast<int>(table) * 64 + y * 8 + position.x();
+}
+
+const char* EvalParams::Name(int index) {
+  return index < Materials ? Names[0] : Names[1 + (index - Materials) / 64];
+}
+
+void EvalParams::Features(const Pieces& white, const Pieces& black, std::vector<std::pair<int, int>>& features) {
+  features.clear();
+  const auto pawn = [](const Piece& p) { return p.type == Type::pawn; };
+  const bool pawns = std::any_of(white.begin(), white.end(), pawn) || std::any_of(black.begin(), black.end(), pawn);
+  auto add = [&](int index, int count) {
+    auto f = std::lower_bound(features.begin(), features.end(), std::make_pair(index, INT_MIN));
+    if (f != features.end() && f->first == index) {
+      f->second += count;
+    } else {
+      features.insert(f, std::make_pair(index, count));
+    }
+  };
+  for (Set set : { Set::white, Set::black }) {
+    const int sign = set == Set::white ? 1 : -1;
+    for (const auto& piece : set == Set::white ? white : black) {
+      switch (piece.type) {
+      case Type::pawn:    add(SquareIndex(EvalTable::pawn, set, piece.position), sign); break;
+      case Type::knight:  add(SquareIndex(EvalTable::knight, set, piece.position), sign); break;
+      case Type::bishop:  add(SquareIndex(EvalTable::bishop, set, piece.position), sign); break;
+      case Type::king:    add(SquareIndex(pawns ? EvalTable::king : EvalTable::kingendgame, set, piece.position), sign); break;
+      default:            break;
+      }
+      if (piece.type != Type::king) {
+        add(PieceIndex(piece.type), sign);
+      }
+    }
+  }
+  features.erase(std::remove_if(features.begin(), features.end(), [](const std::pair<int, int>& f) { return f.second == 0; }),
+                 features.end());
+}
+
+bool EvalParams::Read(const std::string& filename) {
+  std::ifstream file(filename);
+  EvalParams params;
+  for (int index = 0; index < Size; ++index) {
+    std::string name;
+    if (index == 0 || (index >= Materials && (index - Materials) % 64 == 0)) {
+      if (!(file >> name) || name != Name(index)) {
+        return false;
+      }
+    }
+    if (!(file >> params.values[index])) {
+      return false;
+    }
+  }
+  *this = params;
+  return true;
+}
+
+// A line of the pieces, then every table under its name by rank from the own side.
+bool EvalParams::Write(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::trunc);
+  file << std::fixed << std::setprecision(5) << Name(0);
+  for (int index = 0; index < Size; ++index) {
+    if (index >= Materials && (index - Materials) % 64 == 0) {
+      file << "\n" << Name(index);
+    }
+    file << (index < Materials || (index - Materials) % 8 != 0 ? " " : "\n") << std::setw(8) << values[index];
+  }
+  file << "\n";
+  return static_cast<bool>(file);
+}
+
+}
+}
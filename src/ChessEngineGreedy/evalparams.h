@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+// Square tables of the weights, the ranks are counted from the own side.
+enum class EvalTable : char { pawn, knight, bishop, king, kingendgame };
+
+/**
+  The material and square weights of the evaluation in pawns, as one vector that a tuner can fit: the pawn, knight,
+  bishop, rook and queen, then the tables by rank and file. The king table counts while pawns are on the board, the
+  endgame one without them.
+
+  The weights add up linearly into the score, so the score of white is a sum of the weights with the number of the
+  white pieces minus the black ones using each of them, plus the terms depending on the other pieces.
+*/
+struct EvalParams {
+    static const int Materials = 5;
+    static const int Tables = 5;
+    static const int Size = Materials + Tables * 64;
+
+    std::array<float, Size> values;
+
+    static EvalParams Default(); // the hand-set weights
+    static EvalParams Zero();
+
+    static int PieceIndex(Type type); // -1 for the king
+    static int SquareIndex(EvalTable table, Set set, Position position);
+    static const char* Name(int index); // of the piece or table
+
+    float Material(Type type) const {
+        const int index = PieceIndex(type);
+        return index >= 0 ? values[index] : 0.0f;
+    }
+    float Square(EvalTable table, Set set, Position position) const {
+        return values[SquareIndex(table, set, position)];
+    }
+
+    // The indices of the weights and their counts in the score of white, sorted by the index.
+    static void Features(const Pieces& white, const Pieces& black, std::vector<std::pair<int, int>>& features);
+
+    bool Read(const std::string& filename); // false if the file is missing or incomplete
+    bool Write(const std::string& filename) const;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Chai {
+namespace Chess {
+
+struct HashStats {
+    size_t probes = 0;
+    size_t hits = 0;
+};
+
+/**
+  Lossy cache of the evaluation data indexed by a Zobrist key, every entry keeps a few words of data.
+
+  Any number of threads may probe and store without locks. An entry keeps the data and the key xor-ed with all of its
+  words, so an entry torn by a concurrent store does not match its key and is just a miss. A new entry always replaces
+  the old one.
+*/
+template <size_t Words>
+class HashCache {
+ public:
+    typedef std::array<uint64_t, Words> Data;
+
+    explicit HashCache(size_t size) : mask(0), probes(0), hits(0) {
+        size_t count = 1;
+        while (count * 2 <= size) {
+            count *= 2;
+        }
+        if (size > 0) {
+            entries.reset(new Entry[count]);
+            mask = count - 1;
+        }
+    }
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    bool Probe(uint64_t key, Data& data) const {
+        if (!entries) {
+            return false;
+        }
+        probes.fetch_add(1, std::memory_order_relaxed);
+        const Entry& entry = entries[key & mask];
+        uint64_t check = entry.check.load(std::memory_order_relaxed) ^ Used;
+        for (size_t i = 0; i < Words; ++i) {
+            data[i] = entry.data[i].load(std::memory_order_relaxed);
+            check ^= data[i];
+        }
+        if (check != key) {
+            return false;
+        }
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    void Store(uint64_t key, const Data& data) {
+        if (!entries) {
+            return;
+        }
+        Entry& entry = entries[key & mask];
+        uint64_t check = key ^ Used;
+        for (size_t i = 0; i < Words; ++i) {
+            check ^= data[i];
+        }
+        entry.check.store(check, std::memory_order_relaxed);
+        for (size_t i = 0; i < Words; ++i) {
+            entry.data[i].store(data[i], std::memory_order_relaxed);
+        }
+    }
+
+    size_t Size() const {
+        return entries ? mask + 1 : 0;
+    }
+    // Permill of the entries in use, counted on the first thousand.
+    int Usage() const {
+        const size_t sample = std::min<size_t>(Size(), 1000);
+        size_t used = 0;
+        for (size_t i = 0; i < sample; ++i) {
+            used += entries[i].check.load(std::memory_order_relaxed) != 0 ? 1 : 0;
+        }
+        return sample > 0 ? static_cast<int>(used * 1000 / sample) : 0;
+    }
+    HashStats Stats() const {
+        HashStats stats;
+        stats.probes = probes.load(std::memory_order_relaxed);
+        stats.hits = hits.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+ private:
+    // Mixed into the check word, so that an empty entry matches no real key but by chance.
+    static const uint64_t Used = 0x5bd1e9955bd1e995ull;
+
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::array<std::atomic<uint64_t>, Words> data{};
+    };
+    std::unique_ptr<Entry[]> entries;
+    size_t mask;
+
+    mutable std::atomic<size_t> probes;
+    mutable std::atomic<size_t> hits;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,261 @@
+#include "network.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHAI_X86
+#include <immintrin.h>
+#endif
+
+#if defined(CHAI_X86) && defined(__GNUC__)
+#define CHAI_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CHAI_TARGET(isa)
+#endif
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const char NetworkMagic[8] = { 'C', 'h', 'a', 'i', 'N', 'n', 'u', 'e' };
+const uint32_t NetworkVersion = 1;
+
+const int Hidden = NetworkWeights::Hidden;
+const int Hidden2 = NetworkWeights::Hidden2;
+
+int TypeIndex(Type type) {
+  switch (type) {
+  case Type::pawn:    return 0;
+  case Type::knight:  return 1;
+  case Type::bishop:  return 2;
+  case Type::rook:    return 3;
+  case Type::queen:   return 4;
+  default:            assert(!"Bad piece type"); return 0;
+  }
+}
+
+int Side(Set set) {
+  return set == Set::white ? 0 : 1;
+}
+
+Position FindKing(const Pieces& pieces) {
+  auto king = std::find_if(pieces.begin(), pieces.end(), [](const Piece& p) { return p.type == Type::king; });
+  return king != pieces.end() ? king->position : Position();
+}
+
+void ScalarAdd(int16_t* values, const int16_t* row) {
+  for (int i = 0; i < Hidden; ++i) {
+    values[i] = static_cast<int16_t>(values[i] + row[i]);
+  }
+}
+
+void ScalarSub(int16_t* values, const int16_t* row) {
+  for (int i = 0; i < Hidden; ++i) {
+    values[i] = static_cast<int16_t>(values[i] - row[i]);
+  }
+}
+
+int32_t ScalarDot(const uint8_t* input, const int8_t* weights, int size) {
+  int32_t sum = 0;
+  for (int i = 0; i < size; ++i) {
+    sum += input[i] * weights[i];
+  }
+  return sum;
+}
+
+#if defined(CHAI_X86)
+
+CHAI_TARGET("avx2") void Avx2Add(int16_t* values, const int16_t* row) {
+  for (int i = 0; i < Hidden; i += 16) {
+    __m256i* v = reinterpret_cast<__m256i*>(values + i);
+    _mm256_store_si256(v, _mm256_add_epi16(_mm256_load_si256(v), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i))));
+  }
+}
+
+CHAI_TARGET("avx2") void Avx2Sub(int16_t* values, const int16_t* row) {
+  for (int i = 0; i < Hidden; i += 16) {
+    __m256i* v = reinterpret_cast<__m256i*>(values + i);
+    _mm256_store_si256(v, _mm256_sub_epi16(_mm256_load_si256(v), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i))));
+  }
+}
+
+// The inputs are at most 127, so the pairs of the products never saturate the 16 bits and the sum is exact.
+CHAI_TARGET("avx2") int32_t Avx2Dot(const uint8_t* input, const int8_t* weights, int size) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+  for (int i = 0; i < size; i += 32) {
+    const __m256i products = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i)),
+                                                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+  }
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+  return _mm_cvtsi128_si32(half);
+}
+
+#endif
+
+void AddRow(EvalKernel kernel, int16_t* values, const int16_t* row) {
+#if defined(CHAI_X86)
+  if (kernel == EvalKernel::avx2) {
+    Avx2Add(values, row);
+    return;
+  }
+#endif
+  (void)kernel;
+  ScalarAdd(values, row);
+}
+
+void SubRow(EvalKernel kernel, int16_t* values, const int16_t* row) {
+#if defined(CHAI_X86)
+  if (kernel == EvalKernel::avx2) {
+    Avx2Sub(values, row);
+    return;
+  }
+#endif
+  (void)kernel;
+  ScalarSub(values, row);
+}
+
+int32_t Dot(EvalKernel kernel, const uint8_t* input, const int8_t* weights, int size) {
+#if defined(CHAI_X86)
+  if (kernel == EvalKernel::avx2) {
+    return Avx2Dot(input, weights, size);
+  }
+#endif
+  (void)kernel;
+  return ScalarDot(input, weights, size);
+}
+
+uint8_t Clip(int value) {
+  return static_cast<uint8_t>(std::max(0, std::min(127, value)));
+}
+
+template <typename T>
+void WriteArray(std::ofstream& file, const std::vector<T>& values) {
+  file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+}
+
+bool NetworkWeights::Write(const std::string& filename) const {
+  if (features.size() != static_cast<size_t>(Inputs) * Hidden || biases.size() != static_cast<size_t>(Hidden) ||
+      weights2.size() != static_cast<size_t>(Hidden2) * 2 * Hidden || biases2.size() != static_cast<size_t>(Hidden2) ||
+      weights3.size() != static_cast<size_t>(Hidden2) || outputscale <= 0) {
+    return false;
+  }
+  NetworkHeader header = {};
+  std::memcpy(header.magic, NetworkMagic, sizeof(NetworkMagic));
+  header.version = NetworkVersion;
+  header.inputs = Inputs;
+  header.hidden = Hidden;
+  header.hidden2 = Hidden2;
+  header.outputscale = outputscale;
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteArray(file, features);
+  WriteArray(file, biases);
+  WriteArray(file, weights2);
+  WriteArray(file, biases2);
+  WriteArray(file, weights3);
+  file.write(reinterpret_cast<const char*>(&bias3), sizeof(bias3));
+  return static_cast<bool>(file);
+}
+
+bool Network::Open(const std::string& filename) {
+  using namespace boost::interprocess;
+  const size_t size = sizeof(NetworkHeader) + sizeof(int16_t) * (static_cast<size_t>(NetworkWeights::Inputs) + 1) * Hidden +
+                      sizeof(int8_t) * Hidden2 * 2 * Hidden + sizeof(int32_t) * Hidden2 + sizeof(int8_t) * Hidden2 +
+                      sizeof(int32_t);
+  try {
+    file_mapping mapping(filename.c_str(), read_only);
+    mapped_region mapped(mapping, read_only);
+    if (mapped.get_size() < size) {
+      return false;
+    }
+    const NetworkHeader* header = static_cast<const NetworkHeader*>(mapped.get_address());
+    if (std::memcmp(header->magic, NetworkMagic, sizeof(NetworkMagic)) != 0 || header->version != NetworkVersion ||
+        header->inputs != NetworkWeights::Inputs || header->hidden != Hidden || header->hidden2 != Hidden2 ||
+        header->outputscale <= 0) {
+      return false;
+    }
+    const char* data = reinterpret_cast<const char*>(header + 1);
+    features = reinterpret_cast<const int16_t*>(data);
+    biases = features + static_cast<size_t>(NetworkWeights::Inputs) * Hidden;
+    weights2 = reinterpret_cast<const int8_t*>(biases + Hidden);
+    biases2 = reinterpret_cast<const int32_t*>(weights2 + Hidden2 * 2 * Hidden);
+    weights3 = reinterpret_cast<const int8_t*>(biases2 + Hidden2);
+    std::memcpy(&bias3, weights3 + Hidden2, sizeof(bias3));
+    outputscale = header->outputscale;
+    file.swap(mapping);
+    region.swap(mapped);
+  } catch (const interprocess_exception&) {
+    return false;
+  }
+  return true;
+}
+
+void Network::SetKernel(EvalKernel k) {
+  kernel = k == EvalKernel::avx2 && KernelSupported(k) ? k : EvalKernel::scalar;
+}
+
+int Network::Feature(Set side, Position king, Set set, Type type, Position square) {
+  // Flipping the ranks for black: the square number is file * 8 + rank.
+  const int flip = side == Set::white ? 0 : 7;
+  const int piece = (set == side ? 0 : 5) + TypeIndex(type);
+  return ((king.pos() ^ flip) * 10 + piece) * 64 + (square.pos() ^ flip);
+}
+
+void Network::Refresh(const Pieces& white, const Pieces& black, NetworkAccumulator& accumulator) const {
+  Refresh(Set::white, white, black, accumulator);
+  Refresh(Set::black, white, black, accumulator);
+}
+
+void Network::Refresh(Set side, const Pieces& white, const Pieces& black, NetworkAccumulator& accumulator) const {
+  int16_t* values = accumulator.values[Side(side)].data();
+  std::copy(biases, biases + Hidden, values);
+  const Position king = FindKing(side == Set::white ? white : black);
+  for (Set set : { Set::white, Set::black }) {
+    for (const auto& piece : set == Set::white ? white : black) {
+      if (piece.type != Type::king) {
+        AddRow(kernel, values, features + static_cast<size_t>(Feature(side, king, set, piece.type, piece.position)) * Hidden);
+      }
+    }
+  }
+}
+
+void Network::Update(Set side, Position king, const NetworkChange* changes, int count, NetworkAccumulator& accumulator) const {
+  int16_t* values = accumulator.values[Side(side)].data();
+  for (int i = 0; i < count; ++i) {
+    const NetworkChange& c = changes[i];
+    const int16_t* row = features + static_cast<size_t>(Feature(side, king, c.set, c.type, c.square)) * Hidden;
+    if (c.added) {
+      AddRow(kernel, values, row);
+    } else {
+      SubRow(kernel, values, row);
+    }
+  }
+}
+
+float Network::Evaluate(const NetworkAccumulator& accumulator, Set player) const {
+  alignas(32) std::array<uint8_t, 2 * Hidden> input;
+  const int side = Side(player);
+  for (int i = 0; i < Hidden; ++i) {
+    input[i] = Clip(accumulator.values[side][i]);
+    input[Hidden + i] = Clip(accumulator.values[1 - side][i]);
+  }
+  alignas(32) std::array<uint8_t, Hidden2> hidden;
+  for (int j = 0; j < Hidden2; ++j) {
+    hidden[j] = Clip((biases2[j] + Dot(kernel, input.data(), weights2 + j * 2 * Hidden, 2 * Hidden)) >> NetworkWeights::Shift);
+  }
+  const int32_t output = bias3 + Dot(kernel, hidden.data(), weights3, Hidden2);
+  return static_cast<float>(output) / outputscale;
+}
+
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include "evalbatch.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+/**
+  The first layer of the network summed up for both sides, indexed by EvalAccumulator::Side.
+
+  A side sees the board from its own king: the features are the own king square with a piece of either color on a
+  square, the board is flipped for black so that both sides look up the board. A move changes a few features only, so
+  the sums of the position after the move are the sums before it plus and minus a few weight rows. The sums of the
+  position before the move are kept apart by the search, so taking the move back costs nothing. The sums of the side
+  whose king moved are counted again.
+*/
+struct NetworkAccumulator {
+    static const int Hidden = 128;
+
+    alignas(32) std::array<std::array<int16_t, Hidden>, 2> values;
+};
+
+// A piece put on or taken off a square by a move.
+struct NetworkChange {
+    Set set;
+    Type type;
+    Position square;
+    bool added;
+};
+
+struct NetworkHeader {
+    char magic[8]; // "ChaiNnue"
+    uint32_t version;
+    uint32_t inputs;
+    uint32_t hidden;
+    uint32_t hidden2;
+    int32_t outputscale; // of the output per pawn
+    uint32_t unused;
+};
+
+/**
+  The weights of the network, laid out in the file after the header in this order. The numbers are in the byte order
+  of the machine that wrote the file.
+*/
+struct NetworkWeights {
+    static const int Inputs = 64 * 10 * 64; // own king square, piece of either color without the kings, square
+    static const int Hidden = NetworkAccumulator::Hidden;
+    static const int Hidden2 = 32;
+    static const int Shift = 6; // the sums of the second layer are divided by 2^Shift before the clipping
+
+    std::vector<int16_t> features; // [input][hidden]
+    std::vector<int16_t> biases;   // [hidden]
+    std::vector<int8_t> weights2;  // [hidden2][2 * hidden], the side to move first
+    std::vector<int32_t> biases2;  // [hidden2]
+    std::vector<int8_t> weights3;  // [hidden2]
+    int32_t bias3 = 0;
+    int32_t outputscale = 1;
+
+    bool Write(const std::string& filename) const;
+};
+
+/**
+  Evaluation network mapped into the memory: the accumulators of the first layer, clipped into [0, 127] and joined with
+  the side to move first, then a layer of Hidden2 clipped neurons and the output. The layers after the first run on
+  int8 weights and int32 sums. The kernels add in the same order, so they all give exactly the same scores.
+*/
+class Network {
+ public:
+    Network() : features(nullptr), biases(nullptr), weights2(nullptr), biases2(nullptr), weights3(nullptr), bias3(0),
+                outputscale(1), kernel(BestKernel()) {}
+    Network(const Network&) = delete;
+    Network& operator=(const Network&) = delete;
+
+    bool Open(const std::string& filename); // false if the file is missing or is not a network of this version
+    bool Loaded() const {
+        return features != nullptr;
+    }
+    void SetKernel(EvalKernel k); // the scalar one if the processor does not run it
+
+    static int Feature(Set side, Position king, Set set, Type type, Position square);
+
+    // Counts the sums of both sides from the pieces.
+    void Refresh(const Pieces& white, const Pieces& black, NetworkAccumulator& accumulator) const;
+    void Refresh(Set side, const Pieces& white, const Pieces& black, NetworkAccumulator& accumulator) const;
+    // Adds and removes the pieces changed by a move to the sums of the side, whose king stays on its square.
+    void Update(Set side, Position king, const NetworkChange* changes, int count, NetworkAccumulator& accumulator) const;
+    // The score in pawns for the side to move.
+    float Evaluate(const NetworkAccumulator& accumulator, Set player) const;
+
+ private:
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const int16_t* features;
+    const int16_t* biases;
+    const int8_t* weights2;
+    const int32_t* biases2;
+    const int8_t* weights3;
+    int32_t bias3;
+    int32_t outputscale;
+    EvalKernel kernel;
+};
+
+} // namespace Chess
+} // namespace Chai
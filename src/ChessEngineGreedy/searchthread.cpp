@@ -0,0 +1,194 @@
+#include "searchthread.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+namespace Chai {
+namespace Chess {
+
+InfoRecord MakeInfo(InfoRecord::Kind kind, size_t value, int depth, float score, const std::string& text) {
+  InfoRecord record = {};
+  record.kind = kind;
+  record.value = value;
+  record.depth = depth;
+  record.score = score;
+  text.copy(record.text, std::min(text.size(), InfoRecord::TextSize - 1));
+  return record;
+}
+
+std::string JoinLine(const std::vector<std::string>& notations) {
+  std::string line;
+  for (const auto& n : notations) {
+    if (line.size() + n.size() + 1 >= InfoRecord::TextSize) {
+      break;
+    }
+    line += line.empty() ? n : " " + n;
+  }
+  return line;
+}
+
+void DispatchInfo(const InfoRecord& record, IInfoCall& cb) {
+  switch (record.kind) {
+  case InfoRecord::nodessearched:       cb.NodesSearched(record.value); break;
+  case InfoRecord::nodespersecond:      cb.NodesPerSecond(static_cast<int>(record.value)); break;
+  case InfoRecord::searchdepth:         cb.SearchDepth(record.depth, static_cast<int>(record.value)); break;
+  case InfoRecord::hashfull:            cb.HashFull(static_cast<int>(record.value)); break;
+  case InfoRecord::currentmove:         cb.CurrentMove(record.text, static_cast<int>(record.value)); break;
+  case InfoRecord::bestscore:           cb.BestScore(record.score); break;
+  case InfoRecord::principalvariation: {
+    std::vector<std::string> notations;
+    std::istringstream line(record.text);
+    for (std::string n; line >> n; ) {
+      notations.push_back(n);
+    }
+    cb.PrincipalVariation(record.depth, record.score, notations, static_cast<int>(record.value));
+    break;
+  }
+  case InfoRecord::searchstats:         cb.SearchStats(record.statistics); break;
+  case InfoRecord::bestmove:            cb.BestMove(record.text); break;
+  case InfoRecord::readyok:             cb.ReadyOk(); break;
+  }
+}
+
+InfoChannel::InfoChannel(const std::atomic<bool>& abort, int lines)
+  : aborted(abort), progressreserve(lines + ResultReserve), pendingmask(0) {}
+
+void InfoChannel::Post(const InfoRecord& record) {
+  if (record.kind < InfoRecord::Coalesced) {
+    pending[record.kind] = record;
+    pendingmask |= 1u << record.kind;
+    Flush(progressreserve);
+    return;
+  }
+  // The results follow all the progress sent before them.
+  if (record.kind == InfoRecord::principalvariation) {
+    while (!(Flush(ResultReserve) && queue.Free() > static_cast<size_t>(ResultReserve) && queue.TryPush(record))) {
+      if (aborted) {
+        return;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+    return;
+  }
+  // The closing records are never dropped, the progress left behind by a stopped search is dropped instead. The room
+  // kept free by the progress and the lines is enough for them unless the consumer has left the closing records of
+  // earlier searches in the queue, then they wait for it.
+  const int closing = InfoRecord::readyok - record.kind + 1; // this record and the closing records to come
+  while (!Flush(closing)) {
+    if (aborted) {
+      pendingmask = 0;
+      break;
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+  }
+  while (!queue.TryPush(record)) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+  }
+}
+
+bool InfoChannel::Flush(int reserve) {
+  for (int kind = 0; kind < InfoRecord::Coalesced; ++kind) {
+    if (pendingmask & (1u << kind)) {
+      if (queue.Free() <= static_cast<size_t>(reserve)) {
+        return false;
+      }
+      queue.TryPush(pending[kind]);
+      pendingmask &= ~(1u << kind);
+    }
+  }
+  return true;
+}
+
+SearchThread::SearchThread(std::atomic<bool>& abort, SearchFun fun)
+  : aborted(abort), search(fun), searchdepth(0), searching(false), pondering(false), shutdown(false) {}
+
+SearchThread::~SearchThread() {
+  Stop();
+  {
+    boost::lock_guard<boost::mutex> lock(mutsearch);
+    shutdown = true;
+  }
+  condsearch.notify_all();
+  if (mainthread.joinable()) {
+    mainthread.join();
+  }
+}
+
+void SearchThread::Start(boost::shared_ptr<IMachine> position, int depth, bool ponder) {
+  {
+    boost::lock_guard<boost::mutex> lock(mutsearch);
+    if (!mainthread.joinable()) {
+      mainthread = boost::thread(boost::bind(&SearchThread::MainFun, this));
+    }
+    aborted = false;
+    searchposition = position;
+    searchdepth = depth;
+    searching = true;
+    pondering = ponder;
+  }
+  condsearch.notify_all();
+}
+
+bool SearchThread::Stop() {
+  boost::unique_lock<boost::mutex> lock(mutsearch);
+  stoptime = std::chrono::steady_clock::now();
+  aborted = true;
+  if (!searching) {
+    return false;
+  }
+  condsearch.notify_all(); // wakes up the search waiting for PonderHit
+  while (searching) {
+    condsearch.wait(lock);
+  }
+  return true;
+}
+
+std::chrono::microseconds SearchThread::StopLatency() const {
+  boost::lock_guard<boost::mutex> lock(mutsearch);
+  return aborted ? std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stoptime)
+                 : std::chrono::microseconds(0);
+}
+
+void SearchThread::PonderHit() {
+  {
+    boost::lock_guard<boost::mutex> lock(mutsearch);
+    if (!searching || !pondering) {
+      return;
+    }
+    pondering = false;
+  }
+  condsearch.notify_all();
+}
+
+// The pondering search is either complete or dropped by Stop, then it waits for the opponent's move. The search
+// converted by PonderHit before has already gone on as the real one.
+bool SearchThread::AwaitPonderHit() {
+  boost::unique_lock<boost::mutex> lock(mutsearch);
+  while (pondering && !aborted) {
+    condsearch.wait(lock);
+  }
+  return !pondering;
+}
+
+void SearchThread::MainFun() {
+  boost::unique_lock<boost::mutex> lock(mutsearch);
+  while (!shutdown) {
+    if (!searchposition) {
+      condsearch.wait(lock);
+      continue;
+    }
+    boost::shared_ptr<IMachine> machine;
+    machine.swap(searchposition);
+    const int depth = searchdepth;
+    lock.unlock();
+    search(machine, depth);
+    lock.lock();
+    searching = false;
+    condsearch.notify_all();
+  }
+}
+
+}
+}
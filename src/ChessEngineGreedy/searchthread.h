@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include "spscqueue.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+// A message of the search thread to the consumer of ProcessInfo, fixed-size to be passed through the lock-free queue.
+struct InfoRecord {
+    enum Kind {
+        // Progress, superseded by the next record of the same kind and coalesced when the consumer is behind.
+        nodessearched,
+        nodespersecond,
+        searchdepth,
+        hashfull,
+        currentmove,
+        bestscore,
+        // Results, never coalesced.
+        principalvariation,
+        searchstats,
+        bestmove,
+        readyok
+    };
+    static const int Coalesced = principalvariation; // number of the progress kinds
+    static const size_t TextSize = 512;              // notations of the line separated by spaces
+
+    Kind kind;
+    size_t value; // nodes, nps, seldepth, permill, move number or line number
+    int depth;
+    float score;
+    SearchStatistics statistics;
+    char text[TextSize];
+};
+
+// A record of the kind, the text is cut to fit.
+InfoRecord MakeInfo(InfoRecord::Kind kind, size_t value = 0, int depth = 0, float score = 0,
+                    const std::string& text = std::string());
+// Notations separated by spaces, the line is cut at the last move fitting into the record.
+std::string JoinLine(const std::vector<std::string>& notations);
+// Calls the method of the consumer the record stands for.
+void DispatchInfo(const InfoRecord& record, IInfoCall& cb);
+
+/**
+  The records of the search thread on their way to the thread calling ProcessInfo.
+
+  The search thread is the only producer and the consumer is the only one popping. Progress records wait in 'pending'
+  while the queue is short of space, a newer record of the same kind replaces the waiting one. Progress leaves room for
+  the lines, the lines leave room for the records closing the search: the progress still waiting, the statistics, the
+  best move and ReadyOk. So the closing records get through even to a consumer that has not polled for a whole search,
+  and a stopped search drops its progress and its lines, never the closing records.
+*/
+class InfoChannel {
+ public:
+    // The lines are the principal variations a search may post before it closes.
+    InfoChannel(const std::atomic<bool>& aborted, int lines);
+
+    // Producer side. The results wait for the consumer unless the search is stopped, then the progress and the lines
+    // that do not fit are dropped.
+    void Post(const InfoRecord& record);
+
+    // Consumer side.
+    bool TryPop(InfoRecord& record) {
+        return queue.TryPop(record);
+    }
+    bool Wait(int milliseconds) {
+        return queue.Wait(milliseconds);
+    }
+
+ private:
+    bool Flush(int reserve);
+
+    static const size_t Capacity = 256;
+    static const int ClosingRecords = InfoRecord::readyok - InfoRecord::principalvariation; // statistics to ReadyOk
+    static const int ResultReserve = InfoRecord::Coalesced + ClosingRecords;
+
+    const std::atomic<bool>& aborted;
+    const int progressreserve;
+    SpscQueue<InfoRecord, Capacity> queue;
+    std::array<InfoRecord, InfoRecord::Coalesced> pending;
+    unsigned pendingmask;
+};
+
+/**
+  The thread running the searches of an engine one after another.
+
+  The thread starts with the first search, lives as long as the engine and is parked between searches. A pondering
+  search keeps its results until PonderHit, or drops them when it is stopped. The flag 'aborted' belongs to the engine,
+  which checks it while searching: Stop raises it and Start clears it.
+*/
+class SearchThread {
+ public:
+    typedef std::function<void(boost::shared_ptr<IMachine> position, int depth)> SearchFun;
+
+    SearchThread(std::atomic<bool>& aborted, SearchFun search);
+    ~SearchThread();
+
+    // Hands the position over to the search thread. The previous search has to be stopped.
+    void Start(boost::shared_ptr<IMachine> position, int depth, bool ponder);
+    // Returns when the running search is over, false if there was none.
+    bool Stop();
+    // Called by the search when it is over, the time since it was stopped or 0 if it was not.
+    std::chrono::microseconds StopLatency() const;
+    void PonderHit();
+    // Called by the search before posting its results, false if they are to be dropped.
+    bool AwaitPonderHit();
+
+ private:
+    void MainFun();
+
+    std::atomic<bool>& aborted;
+    const SearchFun search;
+    boost::thread mainthread;
+    mutable boost::mutex mutsearch;
+    boost::condition_variable condsearch;
+    boost::shared_ptr<IMachine> searchposition; // the position of the next search, taken by the search thread
+    int searchdepth;
+    std::chrono::steady_clock::time_point stoptime;
+    bool searching;
+    bool pondering; // the results of the search wait for PonderHit
+    bool shutdown;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Chai {
+namespace Chess {
+
+/**
+  Bounded lock-free queue of one producer thread and one consumer thread.
+
+  The records are copied into preallocated slots, so pushing and popping never allocate or lock. The consumer may
+  either poll with TryPop or sleep in Wait, the producer takes the mutex only to wake up a sleeping consumer.
+*/
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity must be a power of two");
+
+ public:
+    SpscQueue() : head(0), tail(0), sleeping(false) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side.
+    bool TryPush(const T& record) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        slots[t & (N - 1)] = record;
+        tail.store(t + 1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst)) {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            cond.notify_one();
+        }
+        return true;
+    }
+    size_t Free() const {
+        return N - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+    }
+
+    // Consumer side.
+    bool TryPop(T& record) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        record = slots[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    bool Empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+    // Blocks until there is a record to pop or the timeout expires, returns whether the queue is not empty.
+    bool Wait(int milliseconds) {
+        if (!Empty()) {
+            return true;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        sleeping.store(true, std::memory_order_seq_cst);
+        const bool ready =
+            cond.timed_wait(lock, boost::posix_time::milliseconds(milliseconds), [this]() {
+                return head.load(std::memory_order_relaxed) != tail.load(std::memory_order_seq_cst);
+            });
+        sleeping.store(false, std::memory_order_relaxed);
+        return ready;
+    }
+
+ private:
+    // The indices grow monotonically, the slot is the index modulo capacity.
+    alignas(64) std::atomic<size_t> head; // written by the consumer
+    alignas(64) std::atomic<size_t> tail; // written by the producer
+    alignas(64) std::atomic<bool> sleeping;
+    std::array<T, N> slots;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -7,11 +7,18 @@
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/container/small_vector.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
 
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+
 void DebugBreak() {
     __builtin_trap();
 }
@@ -22,13 +29,23 @@ CHESSBOARD;
 
 static const float inff = std::numeric_limits<float>::infinity();
 
-class infotest : private IInfoCall {
+class infotest : private InfoCallAdapter {
  public:
     infotest() : readyok(false), deadline(false), bestscore(0), nodes(0) {}
 
     std::string bestmove;
     float bestscore;
     size_t nodes;
+    std::vector<int> depths;
+    std::vector<std::string> pv;
+    std::map<int, std::pair<float, std::vector<std::string>>> lines; // the last score and line by the line number
+    int reports = 0;
+    int nps = 0;
+    int seldepth = 0;
+    int hashfull = 0;
+    std::vector<std::string> currmoves;
+    SearchStatistics stats;
+    int statsreports = 0;
 
     bool wait(IEngine* engine, int timeout) {
         if (deadline) {
@@ -40,7 +57,7 @@ class infotest : private IInfoCall {
         timer.async_wait(boost::bind(&infotest::on_timeout, this, _1));
         boost::thread thread = boost::thread(boost::bind(&boost::asio::io_service::run, &service));
         while (!readyok && !deadline) {
-            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            engine->WaitInfo(10);
             engine->ProcessInfo(this);
         }
         service.stop();
@@ -52,12 +69,39 @@ class infotest : private IInfoCall {
         }
         return readyok;
     }
+    // Takes the messages for the given time without stopping the search.
+    void process(IEngine* engine, int milliseconds) {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+        while (std::chrono::steady_clock::now() < end) {
+            engine->WaitInfo(10);
+            engine->ProcessInfo(this);
+        }
+    }
 
  private:
     void NodesSearched(size_t n) override {
         nodes = n;
     }
-    void NodesPerSecond(int /*nps*/) override {}
+    void NodesPerSecond(int n) override {
+        ++reports;
+        nps = n;
+    }
+    void SearchDepth(int /*depth*/, int sd) override {
+        seldepth = std::max(seldepth, sd);
+    }
+    void HashFull(int permill) override {
+        hashfull = permill;
+    }
+    void CurrentMove(const std::string& notation, int /*number*/) override {
+        currmoves.push_back(notation);
+    }
+    void PrincipalVariation(int depth, float score, const std::vector<std::string>& notations, int line) override {
+        lines[line] = {score, notations};
+        if (line == 1) {
+            depths.push_back(depth);
+            pv = notations;
+        }
+    }
 
     void ReadyOk() override {
         readyok = true;
@@ -68,6 +112,10 @@ class infotest : private IInfoCall {
     void BestScore(float score) override {
         bestscore = score;
     }
+    void SearchStats(const SearchStatistics& s) override {
+        stats = s;
+        ++statsreports;
+    }
 
     void on_timeout(const boost::system::error_code& e) {
         if (e != boost::asio::error::operation_aborted) {
@@ -91,9 +139,138 @@ struct scoped_counter {
 
 int global_count = 0;
 
+// The options followed by the reference search below: no selective search and no delta pruning, which depends on
+// the window and so on the move order. The rest of the quiescence search does not, so any move order finds the score.
+SearchOptions ReferenceOptions() {
+    SearchOptions options;
+    options.pvs = false;
+    options.nullmove = false;
+    options.lmr = false;
+    options.futility = false;
+    options.reversefutility = false;
+    options.seepruning = false;
+    options.deltamargin = 1000.0f;
+    options.threads = 1;
+    return options;
+}
+
+// One engine evaluates all the positions of the reference search.
+const IEngine& ReferenceEvaluator() {
+    static const GreedyEngine engine(ReferenceOptions());
+    return engine;
+}
+
+// Whether the piece moved from 'from' to 'to' attacks the king of the opponent: the direct checks searched at the first
+// quiescence ply, discovered checks are not.
+bool ReferenceDirectCheck(const IMachine& machine, Type type, Position from, Position to) {
+    const Set set = machine.CurrentPlayer();
+    const Pieces xpieces = machine.GetSet(set == Set::white ? Set::black : Set::white);
+    auto xking = std::find_if(xpieces.begin(), xpieces.end(), [](const Piece& p) { return p.type == Type::king; });
+    if (xking == xpieces.end()) {
+        return false;
+    }
+    std::set<int> occupied;
+    for (Set s : {Set::white, Set::black}) {
+        for (const auto& p : machine.GetSet(s)) {
+            occupied.insert(p.position.pos());
+        }
+    }
+    occupied.erase(from.pos());
+    const int dx = xking->position.x() - to.x();
+    const int dy = xking->position.y() - to.y();
+    switch (type) {
+    case Type::pawn:
+        return std::abs(dx) == 1 && dy == (set == Set::white ? 1 : -1);
+    case Type::knight:
+        return std::abs(dx * dy) == 2;
+    case Type::king:
+        return std::max(std::abs(dx), std::abs(dy)) == 1;
+    case Type::bishop:
+        if (std::abs(dx) != std::abs(dy)) {
+            return false;
+        }
+        break;
+    case Type::rook:
+        if (dx != 0 && dy != 0) {
+            return false;
+        }
+        break;
+    default: // queen
+        if (std::abs(dx) != std::abs(dy) && dx != 0 && dy != 0) {
+            return false;
+        }
+        break;
+    }
+    const int sx = (dx > 0) - (dx < 0);
+    const int sy = (dy > 0) - (dy < 0);
+    for (int x = to.x() + sx, y = to.y() + sy; x != xking->position.x() || y != xking->position.y(); x += sx, y += sy) {
+        if (occupied.count(x * 8 + y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  The quiescence search of the engine with ReferenceOptions, written plainly: stand pat, then captures not losing the
+  exchange, queen promotions and, at the first ply, quiet direct checks not losing the moved piece. In check there is
+  no stand pat and every evasion is searched. The plies are limited by qmaxdepth.
+*/
+float TestQuiesce(IMachine& machine, int qply, size_t& nodes, float alpha, const float betta,
+                  const IEngine& evaluator = ReferenceEvaluator()) {
+    ++nodes;
+    const Status status = machine.CheckStatus();
+    const float standpat = evaluator.EvalPosition(machine);
+    if (status == Status::checkmate || status == Status::stalemate || qply >= ReferenceOptions().qmaxdepth) {
+        return standpat;
+    }
+    if (status != Status::check) {
+        if (standpat >= betta) {
+            return standpat;
+        }
+        alpha = std::max(alpha, standpat);
+    }
+    boost::container::flat_set<Position> xpos;
+    for (const auto& xp : machine.GetSet(machine.CurrentPlayer() == Set::white ? Set::black : Set::white)) {
+        xpos.insert(xp.position);
+    }
+    for (const auto& p : machine.GetSet(machine.CurrentPlayer())) {
+        for (const auto& m : machine.EnumMoves(p.position)) {
+            const bool promotion = p.type == Type::pawn && (m.rank() == '1' || m.rank() == '8');
+            const bool capture = xpos.find(m) != xpos.end() || (p.type == Type::pawn && m.file() != p.position.file());
+            boost::container::small_vector<Type, 4> searched;
+            if (status == Status::check) {
+                if (promotion) {
+                    searched = {Type::knight, Type::bishop, Type::rook, Type::queen};
+                } else {
+                    searched = {Type::bad};
+                }
+            } else if (promotion) {
+                searched = {Type::queen};
+            } else if ((capture || (qply == 0 && ReferenceDirectCheck(machine, p.type, p.position, m))) &&
+                       machine.SEEAtLeast(p.position, m, 0)) {
+                searched = {Type::bad};
+            }
+            for (Type type : searched) {
+                if (machine.Move(p.type, p.position, m, type)) {
+                    const float score = -TestQuiesce(machine, qply + 1, nodes, -betta, -alpha, evaluator);
+                    machine.Undo();
+                    alpha = std::max(alpha, score);
+                    if (alpha >= betta) {
+                        return alpha;
+                    }
+                } else {
+                    assert(!"Can't make move!");
+                }
+            }
+        }
+    }
+    return alpha;
+}
+
 /* Classic NegaMax searching */
 std::pair<float, std::string> TestSearch(IMachine& machine, int depth, size_t& nodes, float alpha = -inff,
-                                         const float betta = inff) {
+                                         const float betta = inff, const IEngine& evaluator = ReferenceEvaluator()) {
     scoped_counter counter(global_count);
     if (counter.count > 100)
         DebugBreak();
@@ -101,10 +278,6 @@ std::pair<float, std::string> TestSearch(IMachine& machine, int depth, size_t& n
     Status status = machine.CheckStatus();
     if (depth > 0 && status != Status::checkmate && status != Status::stalemate) {
         boost::optional<std::pair<float, std::string>> bestmove;
-        boost::container::flat_set<Position> xpos;
-        for (const auto& xp : machine.GetSet(machine.CurrentPlayer() == Set::white ? Set::black : Set::white)) {
-            xpos.insert(xp.position);
-        }
         for (const auto& p : machine.GetSet(machine.CurrentPlayer())) {
             for (const auto& m : machine.EnumMoves(p.position)) {
                 boost::container::small_vector<Move, 4> moves;
@@ -117,10 +290,8 @@ std::pair<float, std::string> TestSearch(IMachine& machine, int depth, size_t& n
                 }
                 for (const auto& mm : moves) {
                     if (machine.Move(mm.piece.type, mm.piece.position, mm.to, mm.promotion)) {
-                        bool forcing =
-                            (depth == 1 && (/*status == Status::check ||*/ machine.CheckStatus() == Status::check ||
-                                            xpos.find(mm.to) != xpos.end())); // TODO: en passant
-                        float score = -TestSearch(machine, forcing ? depth : depth - 1, nodes, -betta, -alpha).first;
+                        float score = depth > 1 ? -TestSearch(machine, depth - 1, nodes, -betta, -alpha, evaluator).first
+                                                : -TestQuiesce(machine, 0, nodes, -betta, -alpha, evaluator);
                         if (!bestmove || score > bestmove->first) {
                             bestmove = std::pair<float, std::string>({score, machine.LastMoveNotation()});
                             if (score > alpha) {
@@ -142,8 +313,7 @@ std::pair<float, std::string> TestSearch(IMachine& machine, int depth, size_t& n
         return *bestmove;
     }
     ++nodes;
-    boost::shared_ptr<IEngine> engine = boost::make_shared<GreedyEngine>();
-    return std::make_pair(engine->EvalPosition(machine), std::string());
+    return std::make_pair(evaluator.EvalPosition(machine), std::string());
 }
 
 BOOST_AUTO_TEST_SUITE(GreedyEngineTest)
@@ -193,6 +363,12 @@ BOOST_AUTO_TEST_CASE(GumpSteinitzTest) {
 #else
     const int max_depth_testing = 2; // 4
 #endif
+    // Every depth is searched by its own engine, the transposition table carries the results over to the next moves.
+    // The engines search full width, so they find the scores of the plain reference search.
+    std::vector<boost::shared_ptr<IEngine>> engines;
+    for (int depth = 0; depth <= max_depth_testing; depth++) {
+        engines.push_back(boost::make_shared<GreedyEngine>(ReferenceOptions()));
+    }
     const std::vector<std::string> moves = split(
         "\
 1.e4 e5 2.Nc3 Nf6 3.f4 d5 4.exd5 Nxd5 5.fxe5 Nxc3 6.bxc3 Qh4+ 7.Ke2 Bg4+ 8.Nf3 Nc6 \
@@ -203,55 +379,16 @@ BOOST_AUTO_TEST_CASE(GumpSteinitzTest) {
     BOOST_REQUIRE(moves.size() == 46);
 
     const std::vector<std::pair<std::string, float>> scores0 = {
-        {"e4", 0.000f},    {"e5", -0.026f},   {"Nc3", 0.000f},    {"Nf6", -0.022f},  {"f4", 0.004f},
-        {"d5", -0.012f},   {"exd5", -0.012f}, {"Nxd5", -1.011f},  {"fxe5", -0.026f}, {"Nxc3", -1.003f},
-        {"bxc3", -2.023f}, {"Qh4", -1.007f},  {"Ke2", 0.965f},    {"Bg4", -0.980f},  {"Nf3", 0.963f},
-        {"Nc6", -1.003f},  {"d4", 0.970f},    {"O-O-O", -1.000f}, {"Bd2", 0.990f},   {"Bxf3", -0.999f},
-        {"gxf3", -2.056f}, {"Nxe5", -0.991f}, {"dxe5", -0.047f},  {"Bc5", -2.997f},  {"Qe1", 2.977f},
-        {"Qc4", -2.983f},  {"Kd1", 2.956f},   {"Qxc3", -2.984f},  {"Rb1", 1.981f},   {"Qxf3", -1.993f},
-        {"Qe2", 0.951f},   {"Rxd2", -0.992f}, {"Kxd2", -2.064f},  {"Rd8", -2.977f},  {"Kc1", 2.938f},
-        {"Ba3", -2.976f},  {"Rb2", 2.956f},   {"Qc3", -2.985f},   {"Bh3", 2.976f},   {"Kb8", -3.035f},
-        {"Qb5", 2.976f},   {"Qd2", -2.993f},  {"Kb1", 2.958f},    {"Qd1", -2.998f},  {"Rxd1", 2.964f},
-        {"Rxd1", -12.053f}};
-
-    typedef std::vector<boost::tuple<std::string, float, size_t>> scores_t;
-    const std::vector<scores_t> scoresn = {
-        {{"e4", 0.026f, 20},      {"e5", -0.000f, 20},     {"d4", 0.024f, 29},     {"d5", 0.002f, 29},
-         {"d4", 0.027f, 31},      {"exf4", 0.977f, 95},    {"exd5", 0.020f, 1107}, {"exf4", -0.020f, 411},
-         {"fxe5", 0.981f, 410},   {"Nc6", -0.981f, 210},   {"dxc3", 0.990f, 186},  {"Qd3", -0.980f, 66},
-         {"g3", 0.997f, 2},       {"Nc6", -0.955f, 120},   {"Nf3", 1.003f, 3},     {"Bxf3", -0.964f, 343},
-         {"d4", 1.000f, 15},      {"Bxf3", -0.978f, 1397}, {"Qd3", 1.010f, 22},    {"Bxf3", -0.976f, 2538},
-         {"gxf3", 0.976f, 1546},  {"Bc5", -0.976f, 516},   {"dxe5", 2.977f, 254},  {"Bc5", -2.977f, 233},
-         {"Bf4", 2.997f, 20},     {"Kb8", -2.974f, 302},   {"Kd1", 2.984f, 1},     {"Qxc3", -2.008f, 313},
-         {"Qe4", 2.008f, 24},     {"Qxf3", -0.994f, 682},  {"Kc1", 0.994f, 3},     {"Qxh1", 3.972f, 891},
-         {"Kxd2", -1.988f, 1051}, {"Qxh1", 1.988f, 1049},  {"Qd3", 2.987f, 3},     {"Qxh1", 1.991f, 454},
-         {"Rb2", 2.984f, 1},      {"Bxb2", 2.023f, 325},   {"Qd3", 3.002f, 43},    {"Qxh3", 0.004f, 26},
-         {"Qd3", 3.001f, 28},     {"Bxb2", 1.995f, 724},   {"Kb1", 2.998f, 1},     {"Qd1", inff, 288},
-         {"Rxd1", -inff, 126},    {"Rxd1", inff, 126}},
-        {{"e4", 0.000f, 178},     {"e5", -0.024f, 283},    {"d4", 0.000f, 356},    {"Nc6", -0.023f, 421},
-         {"d4", 0.003f, 847},     {"exf4", 0.977f, 4436},  {"exd5", 0.020f, 8752}, {"exf4", -0.020f, 2028},
-         {"fxe5", 0.981f, 4408},  {"Qh4", -0.989f, 1295},  {"dxc3", 0.990f, 1327}, {"Qh4", -0.997f, 309},
-         {"g3", 0.973f, 246},     {"Nc6", -0.983f, 354},   {"Nf3", 0.964f, 607},   {"Bxf3", -0.964f, 435},
-         {"d4", 0.978f, 10152},   {"Bxf3", -0.978f, 3423}, {"Bf4", 0.982f, 14877}, {"Bxf3", -0.976f, 4985},
-         {"gxf3", 0.976f, 6159},  {"Ba3", -0.997f, 1430},  {"dxe5", 2.977f, 5294}, {"Bc5", -2.997f, 677},
-         {"Qb1", 2.976f, 2043},   {"Qc4", -2.984f, 3741},  {"Kd1", 2.008f, 313},   {"Qxc3", -2.008f, 786},
-         {"Bh3", 1.973f, 1265},   {"Qxf3", -0.994f, 3699}, {"Be2", 0.970f, 3827},  {"Qxh1", 3.972f, 8324},
-         {"Kxd2", -1.988f, 2597}, {"Qxh1", 1.988f, 4677},  {"Qd3", -1.982f, 3216}, {"Qxh1", 1.991f, 2087},
-         {"Rb2", -2.023f, 325},   {"Bxb2", 2.023f, 375},   {"Qg4", 2.981f, 638},   {"Qxh3", 0.004f, 26},
-         {"Qb5", -1.995f, 805},   {"Bxb2", 1.995f, 770},   {"Kb1", -inff, 288},    {"Qd1", inff, 288},
-         {"Rxd1", -inff, 126},    {"Rxd1", inff, 602}},
-        {{"d4", 0.026f, 2241},      {"d5", 0.001f, 3386},       {"Nc3", 0.023f, 6540},     {"Nc6", 0.002f, 11086},
-         {"Nf3", 0.023f, 68381},    {"exf4", 1.004f, 44761},    {"exd5", 0.020f, 1183603}, {"exf4", 0.008f, 194934},
-         {"fxe5", 0.989f, 188373},  {"Qh4", -0.965f, 58603},    {"bxc3", 0.997f, 19465},   {"Qh4", -0.973f, 23983},
-         {"g3", 0.999f, 4946},      {"Qe4", 0.009f, 43574},     {"Nf3", 0.964f, 1998},     {"Bxf3", -0.964f, 124284},
-         {"d4", 0.978f, 88336},     {"Bxf3", -0.978f, 1089065}, {"Bf4", 0.982f, 103847},   {"Bxf3", -0.976f, 839939},
-         {"Kxf3", 0.999f, 36971},   {"Kb8", -0.984f, 255949},   {"dxe5", 2.997f, 97342},   {"Qh5", -1.999f, 50131},
-         {"Qb1", 2.987f, 25624},    {"Qc4", -2.008f, 102233},   {"Kd1", 2.008f, 786},      {"Qxc3", -1.973f, 60725},
-         {"Bh3", 2.003f, 8496},     {"Qxf3", -0.970f, 93016},   {"Be2", 1.010f, 35149},    {"Qxh1", 4.002f, 308154},
-         {"Kxd2", -1.988f, 152586}, {"Qxh1", 2.002f, 206914},   {"Qd3", -1.982f, 10981},   {"Ba3", 2.023f, 42723},
-         {"Rb2", -2.023f, 375},     {"Bxb2", 3.961f, 12624},    {"Qg4", 3.012f, 843},      {"Qxh3", 2.001f, 2822},
-         {"Qb5", -1.995f, 1733},    {"Qd2", inff, 12169},       {"Kb1", -inff, 288},       {"Qd1", inff, 18796},
-         {"Rxd1", -inff, 602},      {"Rxd1", inff, 17616}}};
+        {"e4", 0.000f},    {"e5", 0.014f},    {"Nc3", 0.000f},    {"Nf6", -0.022f},  {"f4", 0.004f},
+        {"d5", 0.028f},    {"exd5", -0.012f}, {"Nxd5", -0.911f},  {"fxe5", -0.026f}, {"Nxc3", -1.003f},
+        {"bxc3", -2.023f}, {"Qh4", -0.787f},  {"Ke2", 0.745f},    {"Bg4", -0.720f},  {"Nf3", 0.703f},
+        {"Nc6", -0.743f},  {"d4", 0.710f},    {"O-O-O", -0.760f}, {"Bd2", 0.710f},   {"Bxf3", -0.719f},
+        {"gxf3", -2.336f}, {"Nxe5", -0.631f}, {"dxe5", -0.527f},  {"Bc5", -2.377f},  {"Qe1", 2.357f},
+        {"Qc4", -2.363f},  {"Kd1", 2.337f},   {"Qxc3", -2.364f},  {"Rb1", 1.581f},   {"Qxf3", -1.593f},
+        {"Qe2", 0.432f},   {"Rxd2", -0.472f}, {"Kxd2", -2.584f},  {"Rd8", -2.416f},  {"Kc1", 2.377f},
+        {"Ba3", -2.455f},  {"Rb2", 2.435f},   {"Qc3", -2.464f},   {"Bh3", 2.456f},   {"Kb8", -2.515f},
+        {"Qb5", 2.417f},   {"Qd2", -2.434f},  {"Kb1", 2.398f},    {"Qd1", -2.478f},  {"Rxd1", 2.445f},
+        {"Rxd1", -11.534f}};
 
     size_t nm = 0;
     for (auto m : moves) {
@@ -269,35 +406,32 @@ BOOST_AUTO_TEST_CASE(GumpSteinitzTest) {
             BOOST_CHECK_SMALL(info.bestscore - s0.second, 0.001f);
             BOOST_CHECK_SMALL(engine->EvalPosition(*machine) - s0.second, 0.001f);
         }
-        // int depth = 3;
         for (int depth = 1; depth <= max_depth_testing; depth++) {
             BOOST_TEST_MESSAGE("Search at '" + m + "'(" + std::to_string(nm / 2 + 1) + ") with " +
                                std::to_string(depth) + " moves in depth");
-            size_t searched_nodes;
-            std::pair<float, std::string> bestmove;
-            if (scoresn.size() >= depth) {
-                searched_nodes = scoresn[depth - 1][nm].get<2>();
-                bestmove = std::make_pair(scoresn[depth - 1][nm].get<1>(), scoresn[depth - 1][nm].get<0>());
-            } else {
-                searched_nodes = 0;
-                bestmove = TestSearch(*machine, depth, searched_nodes);
-            }
-            // char str[32];
-            // sprintf_s(str, "%.3f", bestmove.first);
-            // BOOST_TEST_MESSAGE("{ \"" + bestmove.second + "\", " + std::string(str) + "f, " +
-            // std::to_string(searched_nodes) + " }");
+            size_t nodes = 0;
+            const std::pair<float, std::string> reference = TestSearch(*machine, depth, nodes);
             infotest info2;
-            BOOST_REQUIRE_MESSAGE(engine->Start(*machine, depth), "Can't start search " + std::to_string(depth) +
-                                                                      " moves in depth at '" + m + "' move");
-            BOOST_REQUIRE_MESSAGE(info2.wait(&*engine, 120000), "Searching timeout at move '" + m + "' with " +
+            BOOST_REQUIRE_MESSAGE(engines[depth]->Start(*machine, depth), "Can't start search " +
+                                                                              std::to_string(depth) +
+                                                                              " moves in depth at '" + m + "' move");
+            BOOST_REQUIRE_MESSAGE(info2.wait(&*engines[depth], 120000), "Searching timeout at move '" + m + "' with " +
                                                                     std::to_string(depth) + " moves in depth");
-            if (std::abs(bestmove.first) == inff) {
-                BOOST_CHECK(info2.bestscore == bestmove.first);
+            BOOST_TEST_MESSAGE("Reference " + reference.second + " " + std::to_string(reference.first) + " in " +
+                               std::to_string(nodes) + " nodes, engine " + info2.bestmove + " " +
+                               std::to_string(info2.bestscore) + " in " + std::to_string(info2.nodes) + " nodes");
+            if (std::isinf(reference.first)) {
+                BOOST_CHECK(info2.bestscore == reference.first);
             } else {
-                BOOST_CHECK_SMALL(info2.bestscore - bestmove.first, 0.001f);
+                BOOST_CHECK_SMALL(info2.bestscore - reference.first, 0.001f);
             }
-            BOOST_CHECK(info2.bestmove == bestmove.second);
-            BOOST_CHECK(info2.nodes == searched_nodes);
+            // The engine orders the moves, so of the moves with the best score it may choose another one.
+            boost::shared_ptr<IMachine> child = machine->SlightClone();
+            BOOST_REQUIRE_MESSAGE(child->Move(info2.bestmove), "Can't make the best move " + info2.bestmove);
+            const float score =
+                depth > 1 ? -TestSearch(*child, depth - 1, nodes).first : -TestQuiesce(*child, 0, nodes, -inff, inff);
+            BOOST_CHECK_MESSAGE(score == reference.first || std::abs(score - reference.first) < 0.001f,
+                                "The best move " + info2.bestmove + " scores " + std::to_string(score));
         }
         BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
         BOOST_CHECK_MESSAGE(machine->LastMoveNotation() == m, "Can't take move " + m);
@@ -322,4 +456,1021 @@ BOOST_AUTO_TEST_CASE(GumpSteinitzTest) {
     // }
 }
 
+BOOST_AUTO_TEST_CASE(SelectiveSearchTest) {
+    SearchOptions fullwidth;
+    fullwidth.pvs = false;
+    fullwidth.nullmove = false;
+    fullwidth.lmr = false;
+    fullwidth.futility = false;
+    fullwidth.reversefutility = false;
+    fullwidth.seepruning = false;
+
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Bc4 Nc6 3.Qh5 Nf6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    for (const auto& options : {SearchOptions(), fullwidth}) {
+        GreedyEngine engine(options);
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 3));
+        BOOST_REQUIRE(info.wait(&engine, 120000));
+        BOOST_CHECK(info.bestmove == "Qxf7");
+        BOOST_CHECK(info.bestscore == inff);
+    }
+
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6 4.Ba4")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    size_t fullwidth_nodes = 0;
+    {
+        GreedyEngine engine(fullwidth);
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 5));
+        BOOST_REQUIRE(info.wait(&engine, 120000));
+        const SearchStatistics counters = engine.Statistics();
+        BOOST_CHECK(counters.nullmoves == 0 && counters.lmrreductions == 0 && counters.pvsresearches == 0 &&
+                    counters.futility == 0 && counters.reversefutility == 0 && counters.seepruned == 0);
+        fullwidth_nodes = info.nodes;
+    }
+    {
+        GreedyEngine engine;
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 5));
+        BOOST_REQUIRE(info.wait(&engine, 120000));
+        const SearchStatistics counters = engine.Statistics();
+        BOOST_TEST_MESSAGE("Null moves " + std::to_string(counters.nullmoves) + "/" +
+                           std::to_string(counters.nullcutoffs) + ", LMR " + std::to_string(counters.lmrreductions) +
+                           "/" + std::to_string(counters.lmrresearches) + ", PVS re-searches " +
+                           std::to_string(counters.pvsresearches) + ", futility " + std::to_string(counters.futility) +
+                           ", reverse futility " + std::to_string(counters.reversefutility) + ", SEE " +
+                           std::to_string(counters.seepruned));
+        // A counter switched off by CHAI_SEARCH_STATS stays zero.
+        auto counted = [](SearchStat stat) { return SearchStatCounters::Enabled(stat); };
+        BOOST_CHECK(!counted(SearchStat::nullmoves) || counters.nullmoves > 0);
+        BOOST_CHECK(!counted(SearchStat::lmrreductions) || counters.lmrreductions > 0);
+        BOOST_CHECK(!counted(SearchStat::futility) || !counted(SearchStat::reversefutility) ||
+                    counters.futility + counters.reversefutility > 0);
+        BOOST_CHECK(!counted(SearchStat::seepruned) || counters.seepruned > 0);
+        BOOST_CHECK(info.nodes < fullwidth_nodes);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(PrincipalVariationTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    GreedyEngine engine;
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 4));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_CHECK(info.depths == std::vector<int>({1, 2, 3, 4}));
+    BOOST_REQUIRE(!info.pv.empty());
+    BOOST_CHECK(info.pv.size() <= 4);
+    BOOST_CHECK(info.pv.front() == info.bestmove);
+    for (const auto& m : info.pv) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m), "The principal variation move " + m + " is not legal");
+        BOOST_CHECK(machine->LastMoveNotation() == m);
+    }
+
+    infotest info0;
+    BOOST_REQUIRE(engine.Start(*machine, 0));
+    BOOST_REQUIRE(info0.wait(&engine, 1000));
+    BOOST_CHECK(info0.depths.empty());
+    BOOST_CHECK(info0.bestmove.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MultiPVTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    GreedyEngine single;
+    infotest info1;
+    BOOST_REQUIRE(single.Start(*machine, 4));
+    BOOST_REQUIRE(info1.wait(&single, 120000));
+    BOOST_CHECK(info1.lines.size() == 1);
+
+    SearchOptions options;
+    options.multipv = 3;
+    GreedyEngine engine(options);
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 4));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_TEST_MESSAGE("Multi-PV of 3 lines: " + std::to_string(info.nodes) + " nodes, single line: " +
+                       std::to_string(info1.nodes) + " nodes");
+    BOOST_REQUIRE(info.lines.size() == 3);
+    BOOST_CHECK(info.depths == std::vector<int>({1, 2, 3, 4}));
+    BOOST_CHECK(info.lines[1].second == info.pv);
+    BOOST_CHECK(info.pv.front() == info.bestmove);
+    BOOST_CHECK_EQUAL(info.lines[1].first, info.bestscore);
+    std::set<std::string> rootmoves;
+    for (int line = 1; line <= 3; ++line) {
+        const auto& pv = info.lines[line].second;
+        BOOST_REQUIRE(!pv.empty());
+        rootmoves.insert(pv.front());
+        if (line > 1) {
+            BOOST_CHECK(info.lines[line].first <= info.lines[line - 1].first);
+        }
+        boost::shared_ptr<IMachine> position = machine->SlightClone();
+        for (const auto& m : pv) {
+            BOOST_REQUIRE_MESSAGE(position->Move(m), "The move " + m + " of the line " + std::to_string(line) + " is not legal");
+        }
+    }
+    BOOST_CHECK(rootmoves.size() == 3);
+    // The lines share one search.
+    BOOST_CHECK(info.nodes < 3 * info1.nodes);
+}
+
+BOOST_AUTO_TEST_CASE(PonderTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    boost::shared_ptr<IMachine> expected = machine->SlightClone();
+    BOOST_REQUIRE(expected->Move("a6"));
+
+    GreedyEngine reference;
+    infotest info0;
+    BOOST_REQUIRE(reference.Start(*expected, 4));
+    BOOST_REQUIRE(info0.wait(&reference, 120000));
+
+    // The complete pondering search holds its results until the expected move is made.
+    GreedyEngine engine;
+    BOOST_REQUIRE(engine.Ponder(*expected, 4));
+    infotest held;
+    for (int i = 0; i < 6000 && held.depths.size() < 4; ++i) {
+        held.process(&engine, 10);
+    }
+    held.process(&engine, 100);
+    BOOST_CHECK(held.bestmove.empty());
+    BOOST_CHECK(held.depths == std::vector<int>({1, 2, 3, 4}));
+    engine.PonderHit();
+    infotest info;
+    BOOST_REQUIRE(info.wait(&engine, 1000));
+    BOOST_CHECK(info.bestmove == info0.bestmove);
+    BOOST_CHECK_EQUAL(info.bestscore, info0.bestscore);
+    BOOST_CHECK_EQUAL(info.nodes, info0.nodes);
+
+    // The hit in the middle of the search lets it go on as the real one.
+    boost::shared_ptr<IMachine> deeper = machine->SlightClone();
+    BOOST_REQUIRE(deeper->Move("Nf6"));
+    BOOST_REQUIRE(engine.Ponder(*deeper, 5));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    engine.PonderHit();
+    infotest hit;
+    BOOST_REQUIRE(hit.wait(&engine, 120000));
+    BOOST_CHECK(!hit.bestmove.empty());
+    BOOST_CHECK(hit.depths.back() == 5);
+
+    // The opponent made another move: the search is dropped quickly and reports nothing.
+    BOOST_REQUIRE(engine.Ponder(*expected, 30));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    const auto stopping = std::chrono::steady_clock::now();
+    engine.Stop();
+    const auto dropped = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stopping);
+    BOOST_TEST_MESSAGE("The latency of Stop dropping the pondering " + std::to_string(dropped.count()) + " microseconds");
+    BOOST_CHECK(dropped < std::chrono::milliseconds(SearchOptions().reportinterval + 200));
+    infotest missed;
+    BOOST_CHECK(!missed.wait(&engine, 100));
+    BOOST_CHECK(missed.bestmove.empty());
+    engine.PonderHit(); // too late, nothing to convert
+    BOOST_REQUIRE(engine.Start(*machine, 3));
+    infotest real;
+    BOOST_REQUIRE(real.wait(&engine, 120000));
+    BOOST_CHECK(!real.bestmove.empty());
+}
+
+BOOST_AUTO_TEST_CASE(ProgressTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    SearchOptions options;
+    options.reportnodes = 500;
+    GreedyEngine engine(options);
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 4));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_TEST_MESSAGE(std::to_string(info.nodes) + " nodes, " + std::to_string(info.nps) + " nodes per second, " +
+                       std::to_string(info.reports) + " reports");
+    BOOST_CHECK(info.reports == static_cast<int>(info.nodes / options.reportnodes) + 1);
+    BOOST_CHECK(info.nps > 0);
+    BOOST_CHECK(info.seldepth > 4);
+    BOOST_REQUIRE(!info.currmoves.empty());
+    for (const auto& m : info.currmoves) {
+        boost::shared_ptr<IMachine> position = machine->SlightClone();
+        BOOST_CHECK_MESSAGE(position->Move(m), "The current move " + m + " is not legal");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(InfoQueueTest) {
+    SpscQueue<int, 8> queue;
+    int value = 0;
+    BOOST_CHECK(queue.Empty());
+    BOOST_CHECK(!queue.TryPop(value));
+    BOOST_CHECK(!queue.Wait(10));
+    for (int i = 0; i < 8; ++i) {
+        BOOST_CHECK(queue.TryPush(i));
+    }
+    BOOST_CHECK(!queue.TryPush(8));
+    BOOST_CHECK(queue.Free() == 0);
+    BOOST_CHECK(queue.TryPop(value) && value == 0);
+    BOOST_CHECK(queue.Free() == 1);
+    for (int i = 1; i < 8; ++i) {
+        BOOST_CHECK(queue.TryPop(value) && value == i);
+    }
+    BOOST_CHECK(queue.Empty());
+
+    // The producer runs over the ring many times while the consumer sleeps in Wait.
+    const int count = 100000;
+    boost::thread producer([&queue]() {
+        for (int i = 1; i < count; ++i) {
+            while (!queue.TryPush(i)) {
+                boost::this_thread::yield();
+            }
+        }
+    });
+    int expected = 1;
+    bool ordered = true;
+    while (expected < count && queue.Wait(1000)) {
+        while (queue.TryPop(value)) {
+            ordered = ordered && value == expected;
+            ++expected;
+        }
+    }
+    producer.join();
+    BOOST_CHECK(ordered);
+    BOOST_CHECK_EQUAL(expected, count);
+    BOOST_CHECK(queue.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(InfoCoalescingTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+
+    // Progress of every node overflows the queue while nobody polls, the results must come through all the same.
+    SearchOptions options;
+    options.reportnodes = 1;
+    GreedyEngine engine(options);
+    BOOST_REQUIRE(engine.Start(*machine, 3));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    infotest info;
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_TEST_MESSAGE(std::to_string(info.nodes) + " nodes, " + std::to_string(info.reports) + " reports");
+    BOOST_CHECK(info.reports < static_cast<int>(info.nodes));
+    BOOST_CHECK(info.depths == std::vector<int>({1, 2, 3}));
+    BOOST_REQUIRE(!info.pv.empty());
+    BOOST_CHECK_EQUAL(info.pv.front(), info.bestmove);
+
+    // The lines of every root move fill the queue while nobody polls, the stopped search still closes with the best
+    // move and ReadyOk.
+    options.multipv = 20;
+    GreedyEngine lines(options);
+    BOOST_REQUIRE(lines.Start(*machine, 30));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+    lines.Stop();
+    infotest stopped;
+    BOOST_REQUIRE(stopped.wait(&lines, 1000));
+    BOOST_CHECK(!stopped.bestmove.empty());
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPoolTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+
+    // The same threads serve all the searches of the engine.
+    GreedyEngine engine;
+    std::chrono::microseconds total(0);
+    const int searches = 50;
+    for (int i = 0; i < searches; ++i) {
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, i % 2 + 1));
+        BOOST_REQUIRE(info.wait(&engine, 10000));
+        BOOST_CHECK(!info.bestmove.empty());
+        BOOST_CHECK(info.stats.startlatency.count() > 0);
+        total += info.stats.startlatency;
+    }
+    BOOST_TEST_MESSAGE("Average latency from start to the first node " + std::to_string(total.count() / searches) +
+                       " microseconds");
+    BOOST_CHECK(total < std::chrono::seconds(1) * searches);
+}
+
+BOOST_AUTO_TEST_CASE(SingleThreadTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bc4 Bc5 4.c3 Nf6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    // The moves made on the search thread or by the workers lead to the same tree, and so does a search repeated.
+    const int threads[] = {1, 3, 1};
+    std::vector<infotest> searches(3);
+    for (size_t i = 0; i < searches.size(); ++i) {
+        SearchOptions options;
+        options.threads = threads[i];
+        GreedyEngine engine(options);
+        BOOST_REQUIRE(engine.Start(*machine, 4));
+        BOOST_REQUIRE(searches[i].wait(&engine, 120000));
+        BOOST_CHECK(searches[i].nodes > 0);
+    }
+    for (const auto& info : searches) {
+        BOOST_CHECK_EQUAL(info.nodes, searches[0].nodes);
+        BOOST_CHECK(info.bestmove == searches[0].bestmove);
+        BOOST_CHECK(info.pv == searches[0].pv);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SearchStatsTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bc4 Bc5 4.c3 Nf6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    // A counter switched off by CHAI_SEARCH_STATS stays zero.
+    auto counted = [](SearchStat stat) { return SearchStatCounters::Enabled(stat); };
+    for (int threads : {1, 3}) {
+        SearchOptions options;
+        options.threads = threads;
+        GreedyEngine engine(options);
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 4));
+        BOOST_REQUIRE(info.wait(&engine, 120000));
+        BOOST_CHECK_EQUAL(info.statsreports, 1);
+        const SearchStatistics& stats = info.stats;
+        BOOST_CHECK_EQUAL(engine.Statistics().nodes, stats.nodes);
+        BOOST_CHECK(!counted(SearchStat::nodes) || stats.nodes == info.nodes);
+        BOOST_CHECK(!counted(SearchStat::evaluations) || stats.evaluations > 0);
+        BOOST_CHECK(!counted(SearchStat::betacutoffs) || stats.betacutoffs > 0);
+        BOOST_CHECK(stats.firstmovecutoffs <= stats.betacutoffs);
+        BOOST_CHECK(stats.FirstMoveCutoffRate() >= 0 && stats.FirstMoveCutoffRate() <= 1);
+        BOOST_CHECK(!counted(SearchStat::ttprobes) || stats.ttprobes > 0);
+        BOOST_CHECK(stats.tthits <= stats.ttprobes);
+        BOOST_CHECK(!counted(SearchStat::clones) || stats.clones > 0);
+        BOOST_CHECK(!counted(SearchStat::movesgenerated) || stats.movesgenerated > 0);
+        BOOST_CHECK(!counted(SearchStat::checks) || stats.checks > 0);
+        BOOST_CHECK_EQUAL(stats.aborts, 0u);
+        BOOST_TEST_MESSAGE("Threads " + std::to_string(threads) + ": nodes " + std::to_string(stats.nodes) +
+                           ", evaluations " + std::to_string(stats.evaluations) + ", cutoffs " +
+                           std::to_string(stats.betacutoffs) + " (" +
+                           std::to_string(static_cast<int>(stats.FirstMoveCutoffRate() * 100)) + "% by the first move)" +
+                           ", transpositions " + std::to_string(stats.tthits) + "/" + std::to_string(stats.ttprobes) +
+                           ", clones " + std::to_string(stats.clones) + ", moves " + std::to_string(stats.movesgenerated));
+    }
+
+    // The stopped search reports what it has given up.
+    {
+        GreedyEngine engine;
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 30));
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        engine.Stop();
+        BOOST_REQUIRE(info.wait(&engine, 1000));
+        BOOST_CHECK_EQUAL(info.statsreports, 1);
+        BOOST_CHECK(!counted(SearchStat::aborts) || info.stats.aborts > 0);
+    }
+
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Bc4 Nc6 3.Qh5 Nf6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    GreedyEngine engine;
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 2));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_CHECK(!counted(SearchStat::checkmates) || info.stats.checkmates > 0); // Qxf7
+}
+
+BOOST_AUTO_TEST_CASE(StopLatencyTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    // The abort is seen on the next node, the slack covers a loaded machine descheduling the threads.
+    const SearchOptions options;
+    const auto bound = std::chrono::milliseconds(options.reportinterval + 200);
+    GreedyEngine engine(options);
+    std::chrono::microseconds worst(0);
+    for (int delay : {1, 10, 50, 200}) {
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 30));
+        boost::this_thread::sleep(boost::posix_time::milliseconds(delay));
+        const auto stopping = std::chrono::steady_clock::now();
+        engine.Stop();
+        // The interrupted search still reports the best move of the last completed iteration.
+        BOOST_REQUIRE(info.wait(&engine, 1000));
+        const auto delivered = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stopping);
+        BOOST_CHECK(delay < 50 || !info.bestmove.empty());
+        BOOST_CHECK(info.stats.stoplatency.count() > 0);
+        BOOST_CHECK(info.stats.stoplatency <= delivered);
+        BOOST_CHECK(delivered < bound);
+        worst = std::max(worst, delivered);
+        // The abort has reached the search: nothing is searched after Stop returns.
+        infotest after;
+        after.process(&engine, 20);
+        BOOST_CHECK_EQUAL(after.nodes, 0u);
+        BOOST_CHECK_EQUAL(after.reports, 0);
+    }
+    BOOST_TEST_MESSAGE("The worst latency from Stop to the best move " + std::to_string(worst.count()) + " microseconds");
+}
+
+BOOST_AUTO_TEST_CASE(IncrementalEvalTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+
+    // The line passes positions with captures, en passant, castling and promotions with and without capture.
+    SearchOptions options;
+    options.evalcache = 0;
+    GreedyEngine engine(options);
+    for (auto m : split("1.e4 d5 2.exd5 c6 3.dxc6 e5 4.Nf3 Nf6 5.Bc4 e4 6.d4 Bd6 7.cxb7 O-O 8.O-O Qc7")) {
+        const Set set = machine->CurrentPlayer();
+        const Pieces pieces = machine->GetSet(set);
+        const Pieces xpieces = machine->GetSet(set == Set::white ? Set::black : Set::white);
+        const EvalAccumulator accumulator = engine.Accumulate(*machine);
+        for (const auto& piece : machine->GetSet(set)) {
+            for (const auto& to : machine->EnumMoves(piece.position)) {
+                const bool promotion = piece.type == Type::pawn && (to.rank() == '1' || to.rank() == '8');
+                for (auto type : promotion ? std::vector<Type>{Type::knight, Type::bishop, Type::rook, Type::queen}
+                                           : std::vector<Type>{Type::bad}) {
+                    boost::shared_ptr<IMachine> child = machine->SlightClone();
+                    BOOST_REQUIRE(child->Move(piece.type, piece.position, to, type));
+                    const float incremental =
+                        engine.EvalPosition(*child, engine.Accumulate(accumulator, set, {piece, to, type}, pieces, xpieces));
+                    const float full = engine.EvalPosition(*child);
+                    if (std::isinf(full)) {
+                        BOOST_CHECK(incremental == full);
+                    } else {
+                        BOOST_CHECK_MESSAGE(std::abs(incremental - full) < 0.0001f,
+                                            "The incremental evaluation differs after " + child->LastMoveNotation());
+                    }
+                }
+            }
+        }
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EvalPositionsTest) {
+    // Positions of random games, each game is played up to the end or to 120 plies.
+    std::vector<PositionSnapshot> snapshots;
+    std::vector<float> expected;
+    GreedyEngine engine;
+    std::mt19937 random(77);
+    for (int game = 0; game < 8; ++game) {
+        boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+        machine->Start();
+        for (int ply = 0; ply < 120; ++ply) {
+            snapshots.push_back(TakeSnapshot(*machine));
+            expected.push_back(engine.EvalPosition(*machine));
+            std::vector<std::pair<Piece, Position>> moves;
+            for (const auto& piece : machine->GetSet(machine->CurrentPlayer())) {
+                for (const auto& to : machine->EnumMoves(piece.position)) {
+                    moves.emplace_back(piece, to);
+                }
+            }
+            if (moves.empty()) {
+                break;
+            }
+            const auto& move = moves[random() % moves.size()];
+            const bool promotion = move.first.type == Type::pawn && (move.second.rank() == '1' || move.second.rank() == '8');
+            BOOST_REQUIRE(machine->Move(move.first.type, move.first.position, move.second,
+                                        promotion ? Type::queen : Type::bad));
+        }
+    }
+
+    std::vector<float> scalar(snapshots.size());
+    engine.EvalPositions(snapshots.data(), snapshots.size(), scalar.data(), EvalKernel::scalar);
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        if (std::isinf(expected[i])) {
+            BOOST_CHECK(scalar[i] == expected[i]);
+        } else {
+            BOOST_CHECK_SMALL(scalar[i] - expected[i], 0.0001f);
+        }
+    }
+
+    // The vector kernels give exactly the scalar scores, the throughput is measured on a large batch.
+    std::vector<PositionSnapshot> batch;
+    while (batch.size() < 100000) {
+        batch.insert(batch.end(), snapshots.begin(), snapshots.end());
+    }
+    std::vector<float> scores(batch.size());
+    for (auto kernel : {EvalKernel::scalar, EvalKernel::sse, EvalKernel::avx2}) {
+        if (!KernelSupported(kernel)) {
+            BOOST_TEST_MESSAGE("The evaluation kernel " + std::to_string(static_cast<int>(kernel)) + " is not supported");
+            continue;
+        }
+        std::vector<float> vector(snapshots.size());
+        engine.EvalPositions(snapshots.data(), snapshots.size(), vector.data(), kernel);
+        BOOST_CHECK(vector == scalar);
+        const auto start = std::chrono::steady_clock::now();
+        engine.EvalPositions(batch.data(), batch.size(), scores.data(), kernel);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        BOOST_TEST_MESSAGE("The evaluation kernel " + std::to_string(static_cast<int>(kernel)) + ": " +
+                           std::to_string(static_cast<size_t>(batch.size() / elapsed.count())) + " positions per second");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EvalCacheTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    // The cache changes nothing but the time.
+    SearchOptions nocache;
+    nocache.evalcache = 0;
+    GreedyEngine engine0(nocache);
+    infotest info0;
+    BOOST_REQUIRE(engine0.Start(*machine, 4));
+    BOOST_REQUIRE(info0.wait(&engine0, 120000));
+    BOOST_CHECK(engine0.EvalCacheStats().probes == 0);
+
+    GreedyEngine engine;
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 4));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    const HashStats stats = engine.EvalCacheStats();
+    BOOST_TEST_MESSAGE("Evaluation cache: " + std::to_string(stats.hits) + " hits of " + std::to_string(stats.probes) +
+                       " probes");
+    BOOST_CHECK(stats.hits > 0);
+    BOOST_CHECK(stats.hits < stats.probes);
+    BOOST_CHECK_EQUAL(info.bestmove, info0.bestmove);
+    BOOST_CHECK_EQUAL(info.bestscore, info0.bestscore);
+    BOOST_CHECK_EQUAL(info.nodes, info0.nodes);
+    BOOST_CHECK(info.pv == info0.pv);
+
+    // The hash usage reported is the one of the transposition table, not of the evaluation cache.
+    BOOST_CHECK(info0.hashfull > 0);
+    SearchOptions notable;
+    notable.transpositions = 0;
+    GreedyEngine engine1(notable);
+    infotest info1;
+    BOOST_REQUIRE(engine1.Start(*machine, 4));
+    BOOST_REQUIRE(info1.wait(&engine1, 120000));
+    BOOST_CHECK(engine1.EvalCacheStats().probes > 0);
+    BOOST_CHECK_EQUAL(info1.hashfull, 0);
+}
+
+BOOST_AUTO_TEST_CASE(PawnStructureTest) {
+    // The same pawns on the symmetric files, connected in the first position and isolated in the second one.
+    PositionSnapshot connected{{{Type::king, Position('e', '1')}, {Type::pawn, Position('b', '2')}, {Type::pawn, Position('c', '4')}},
+                               {{Type::king, Position('e', '8')}},
+                               Set::white, Status::normal, 0, 0};
+    PositionSnapshot isolated = connected;
+    isolated.white[2].position = Position('f', '4');
+    // One more pawn either doubles the b-pawn or stands isolated on the g-file.
+    PositionSnapshot doubled = connected;
+    doubled.white.push_back({Type::pawn, Position('b', '3')});
+    PositionSnapshot spread = connected;
+    spread.white.push_back({Type::pawn, Position('g', '3')});
+
+    GreedyEngine engine;
+    const PositionSnapshot snapshots[] = {connected, isolated, doubled, spread};
+    float scores[4];
+    engine.EvalPositions(snapshots, 4, scores);
+    BOOST_CHECK_SMALL(scores[0] - scores[1] - 2 * 0.12f, 0.0001f);
+    BOOST_CHECK_SMALL(scores[2] - scores[3] - (0.12f - 0.10f), 0.0001f);
+
+    // The structure cache changes nothing but the time.
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    SearchOptions nocache;
+    nocache.evalcache = 0;
+    nocache.pawncache = 0;
+    GreedyEngine engine0(nocache);
+    infotest info0;
+    BOOST_REQUIRE(engine0.Start(*machine, 4));
+    BOOST_REQUIRE(info0.wait(&engine0, 120000));
+    BOOST_CHECK(engine0.PawnCacheStats().probes == 0);
+
+    nocache.pawncache = SearchOptions().pawncache;
+    GreedyEngine engine1(nocache);
+    infotest info1;
+    BOOST_REQUIRE(engine1.Start(*machine, 4));
+    BOOST_REQUIRE(info1.wait(&engine1, 120000));
+    const HashStats stats = engine1.PawnCacheStats();
+    BOOST_TEST_MESSAGE("Pawn structure cache: " + std::to_string(stats.hits) + " hits of " +
+                       std::to_string(stats.probes) + " probes");
+    BOOST_CHECK(stats.hits > stats.probes / 2);
+    BOOST_CHECK_EQUAL(info1.bestmove, info0.bestmove);
+    BOOST_CHECK_EQUAL(info1.bestscore, info0.bestscore);
+    BOOST_CHECK_EQUAL(info1.nodes, info0.nodes);
+}
+
+BOOST_AUTO_TEST_CASE(OpeningBookTest) {
+    const std::string pgn = R"(
+[Event "First"]
+[Result "1-0"]
+
+1. e4 e5 2. Nf3 {the main line} Nc6 (2... d6 3. d4) 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 1-0
+
+[Event "Second"]
+[Result "1/2-1/2"]
+
+1.e4 e5 2.Nf3 Nc6 3.Bb5 $1 Nf6 4.O-O Nxe4 5.d4 Nd6 1/2-1/2
+
+[Event "Third"]
+
+1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5!? Be7 0-1
+)";
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    machine->Start();
+
+    BookBuilder builder(*machine, 8, 2);
+    BOOST_CHECK_EQUAL(builder.AddGames(pgn), 3);
+    const auto entries = builder.Entries();
+    BOOST_CHECK(std::is_sorted(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.key < b.key || (a.key == b.key && a.weight > b.weight);
+    }));
+
+    const auto bookfile = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.book");
+    BOOST_REQUIRE(builder.Write(bookfile.string()));
+    OpeningBook book;
+    BOOST_REQUIRE(book.Open(bookfile.string()));
+    BOOST_CHECK_EQUAL(book.Size(), entries.size());
+    // 1.e4 won once and drew once, 1.d4 lost.
+    const auto start = book.Probe(machine->PositionKey());
+    BOOST_REQUIRE(start.size() == 1);
+    Position from, to;
+    Type promotion;
+    UnpackBookMove(start[0].move, from, to, promotion);
+    BOOST_CHECK(from == Position('e', '2') && to == Position('e', '4') && promotion == Type::bad);
+    BOOST_CHECK_EQUAL(start[0].weight, 3);
+    BOOST_CHECK(book.Probe(machine->PositionKey() ^ 1).empty());
+
+    // The book moves are returned without a search, the positions out of the book are searched.
+    SearchOptions options;
+    options.book = bookfile.string();
+    GreedyEngine engine(options);
+    for (auto m : split("1.e4 e5 2.Nf3 Nc6 3.Bb5")) {
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 4));
+        BOOST_REQUIRE(info.wait(&engine, 1000));
+        BOOST_CHECK_EQUAL(info.bestmove, m);
+        BOOST_CHECK_EQUAL(info.nodes, 0);
+        BOOST_REQUIRE(machine->Move(m));
+    }
+    // After 3.Bb5 black lost the first game with 3...a6 and drew the second one with 3...Nf6.
+    infotest black;
+    BOOST_REQUIRE(engine.Start(*machine, 4));
+    BOOST_REQUIRE(black.wait(&engine, 1000));
+    BOOST_CHECK(black.bestmove == "Nf6");
+    BOOST_REQUIRE(machine->Move("Nf6"));
+    BOOST_REQUIRE(machine->Move("d3"));
+    infotest searched;
+    BOOST_REQUIRE(engine.Start(*machine, 3));
+    BOOST_REQUIRE(searched.wait(&engine, 120000));
+    BOOST_CHECK(searched.nodes > 1);
+
+    book.Close();
+    boost::filesystem::remove(bookfile);
+    BOOST_CHECK(!book.Open(bookfile.string()));
+}
+
+BOOST_AUTO_TEST_CASE(BitbaseTest) {
+    CHESSPOS(a5);
+    const auto directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bitbases-%%%%-%%%%");
+    BOOST_REQUIRE(boost::filesystem::create_directory(directory));
+
+    // KPK turns into the endgames of all the promotions, they are generated first.
+    BitbaseGenerator generator(2);
+    BOOST_REQUIRE(generator.Generate("KPK", directory.string()));
+    BOOST_CHECK(!generator.Generate("KPKP", directory.string()));
+    BOOST_REQUIRE(generator.Stats().size() == 5);
+    for (const auto& s : generator.Stats()) {
+        BOOST_TEST_MESSAGE(s.name + ": " + std::to_string(s.positions) + " positions, " + std::to_string(s.wins) +
+                           " wins, " + std::to_string(s.draws) + " draws, " + std::to_string(s.losses) + " losses in " +
+                           std::to_string(s.seconds) + " s, " + std::to_string(s.bytes) + " bytes");
+        BOOST_CHECK_EQUAL(s.positions, s.wins + s.draws + s.losses);
+        BOOST_CHECK(s.bytes > 0);
+    }
+    BOOST_CHECK(generator.Stats().back().name == "KPK");
+    for (const std::string name : {"KRK", "KPK"}) {
+        const auto values = generator.Values(name);
+        BOOST_CHECK_MESSAGE(values == generator.Solve(name), "The retrograde analysis of " + name +
+                                                                 " does not match the plain iteration");
+    }
+    const auto kbk = generator.Values("KBK");
+    BOOST_CHECK(std::none_of(kbk.begin(), kbk.end(), [](BitbaseValue v) { return v == BitbaseValue::win; }));
+
+    Bitbases bitbases;
+    BOOST_REQUIRE_EQUAL(bitbases.Load(directory.string()), 5);
+    auto probe = [&](const Pieces& white, const Pieces& black, Set player) {
+        BitbaseValue value = BitbaseValue::illegal;
+        BOOST_REQUIRE(bitbases.Probe(white, black, player, value));
+        return value;
+    };
+    const Pieces kqk = {{Type::king, e1}, {Type::queen, d1}};
+    BOOST_CHECK(probe(kqk, {{Type::king, e8}}, Set::white) == BitbaseValue::win);
+    BOOST_CHECK(probe(kqk, {{Type::king, e8}}, Set::black) == BitbaseValue::loss);
+    BOOST_CHECK(probe({{Type::king, e1}}, {{Type::king, e8}, {Type::queen, d8}}, Set::black) == BitbaseValue::win);
+    BOOST_CHECK(probe({{Type::king, e1}}, {{Type::king, e8}}, Set::white) == BitbaseValue::draw);
+    // The king in front of the pawn on the sixth rank wins with any side to move, the rook pawn is a draw.
+    BOOST_CHECK(probe({{Type::king, e6}, {Type::pawn, e5}}, {{Type::king, e8}}, Set::white) == BitbaseValue::win);
+    BOOST_CHECK(probe({{Type::king, e6}, {Type::pawn, e5}}, {{Type::king, e8}}, Set::black) == BitbaseValue::loss);
+    BOOST_CHECK(probe({{Type::king, e1}, {Type::pawn, a5}}, {{Type::king, a8}}, Set::white) == BitbaseValue::draw);
+    BitbaseValue value;
+    BOOST_CHECK(!bitbases.Probe({{Type::king, e1}, {Type::rook, a1}, {Type::knight, b1}}, {{Type::king, e8}}, Set::white,
+                                value));
+
+    const int probes = 100000;
+    const auto start = std::chrono::steady_clock::now();
+    size_t wins = 0;
+    for (int i = 0; i < probes; ++i) {
+        const Pieces black = {{Type::king, Position(static_cast<unsigned char>((i % 8) << 4 | 7))}};
+        wins += bitbases.Probe(kqk, black, Set::white, value) && value == BitbaseValue::win;
+    }
+    const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    BOOST_TEST_MESSAGE("Bitbase probe latency " + std::to_string(elapsed / probes) + " microseconds");
+    BOOST_CHECK(wins > 0);
+
+    // A game of random captures down to one of the endgames: the search gets the exact result at the horizon.
+    boost::shared_ptr<IMachine> machine;
+    std::string endgame;
+    for (unsigned seed = 1; seed < 1000 && !machine; ++seed) {
+        std::mt19937 random(seed);
+        boost::shared_ptr<IMachine> game = boost::make_shared<ChessMachine>();
+        game->Start();
+        for (int ply = 0; ply < 400 && game->CheckStatus() != Status::checkmate &&
+                          game->CheckStatus() != Status::stalemate; ++ply) {
+            const Set set = game->CurrentPlayer();
+            const Pieces pieces = game->GetSet(set);
+            const Pieces xpieces = game->GetSet(set == Set::white ? Set::black : Set::white);
+            if (pieces.size() + xpieces.size() <= 3) {
+                const std::string name = EndgameName(set == Set::white ? pieces : xpieces,
+                                                     set == Set::white ? xpieces : pieces);
+                if (name == "KQK" || name == "KRK" || name == "KPK" || name == "KKQ" || name == "KKR" ||
+                    name == "KKP") {
+                    machine = game;
+                    endgame = name;
+                }
+                break;
+            }
+            std::vector<std::pair<Piece, Position>> moves, captures;
+            for (const auto& piece : pieces) {
+                for (const auto& to : game->EnumMoves(piece.position)) {
+                    const bool capture = std::any_of(xpieces.begin(), xpieces.end(), [&](const Piece& p) {
+                        return p.position == to;
+                    });
+                    (capture ? captures : moves).push_back({piece, to});
+                }
+            }
+            const auto& choice = captures.empty() ? moves : captures;
+            const auto& move = choice[random() % choice.size()];
+            const bool promotion = move.first.type == Type::pawn && (move.second.rank() == '1' || move.second.rank() == '8');
+            BOOST_REQUIRE(game->Move(move.first.type, move.first.position, move.second,
+                                     promotion ? Type::queen : Type::bad));
+        }
+    }
+    BOOST_REQUIRE_MESSAGE(machine, "No game reached the endgames");
+    BOOST_TEST_MESSAGE("The search in the endgame " + endgame);
+    BOOST_REQUIRE(bitbases.Probe(*machine, value));
+
+    SearchOptions options;
+    options.bitbases = directory.string();
+    GreedyEngine engine(options);
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 3));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_CHECK(!SearchStatCounters::Enabled(SearchStat::bitbasehits) || engine.Statistics().bitbasehits > 0);
+    if (value == BitbaseValue::win) {
+        BOOST_CHECK(info.bestscore > 25.0f);
+    } else if (value == BitbaseValue::loss) {
+        BOOST_CHECK(info.bestscore < -25.0f);
+    } else {
+        BOOST_CHECK_EQUAL(info.bestscore, 0.0f);
+    }
+
+    boost::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(EvalParamsTest) {
+    const EvalParams params = EvalParams::Default();
+    const auto file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("weights-%%%%-%%%%.txt");
+    EvalParams changed = params;
+    changed.values[EvalParams::PieceIndex(Type::queen)] = 10;
+    changed.values[EvalParams::SquareIndex(EvalTable::knight, Set::white, d4)] = -0.125f;
+    BOOST_REQUIRE(changed.Write(file.string()));
+    EvalParams read = params;
+    BOOST_REQUIRE(read.Read(file.string()));
+    for (int i = 0; i < EvalParams::Size; ++i) {
+        BOOST_CHECK_CLOSE(read.values[i], changed.values[i], 1e-3);
+    }
+    BOOST_CHECK(!read.Read(file.string() + ".missing"));
+
+    // The tables are mirrored for black, so the weights of the start position cancel out.
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    machine->Start();
+    std::vector<std::pair<int, int>> features;
+    EvalParams::Features(machine->GetSet(Set::white), machine->GetSet(Set::black), features);
+    BOOST_CHECK(features.empty());
+    BOOST_CHECK_EQUAL(EvalParams::SquareIndex(EvalTable::pawn, Set::white, e2), EvalParams::SquareIndex(EvalTable::pawn, Set::black, e7));
+
+    // The engine evaluates with the weights of the file, white lost its queen here.
+    for (const char* move : {"e4", "e5", "Qh5", "Nc6", "Qxf7", "Kxf7"}) {
+        BOOST_REQUIRE(machine->Move(move));
+    }
+    EvalParams::Features(machine->GetSet(Set::white), machine->GetSet(Set::black), features);
+    BOOST_CHECK(std::find(features.begin(), features.end(), std::make_pair(EvalParams::PieceIndex(Type::queen), -1)) != features.end());
+    SearchOptions options;
+    options.evalcache = 0;
+    GreedyEngine standard(options);
+    options.evalparams = file.string();
+    GreedyEngine tuned(options);
+    BOOST_CHECK_CLOSE(standard.EvalPosition(*machine) - tuned.EvalPosition(*machine), 1.0f, 0.1);
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(NetworkTest) {
+    const int hidden = NetworkWeights::Hidden;
+    const int hidden2 = NetworkWeights::Hidden2;
+    std::mt19937 random(42);
+    auto uniform = [&](int range) { return std::uniform_int_distribution<int>(-range, range)(random); };
+    NetworkWeights weights;
+    weights.features.resize(static_cast<size_t>(NetworkWeights::Inputs) * hidden);
+    std::generate(weights.features.begin(), weights.features.end(), [&]() { return static_cast<int16_t>(uniform(24)); });
+    weights.biases.resize(hidden);
+    std::generate(weights.biases.begin(), weights.biases.end(), [&]() { return static_cast<int16_t>(uniform(64)); });
+    weights.weights2.resize(hidden2 * 2 * hidden);
+    std::generate(weights.weights2.begin(), weights.weights2.end(), [&]() { return static_cast<int8_t>(uniform(32)); });
+    weights.biases2.resize(hidden2);
+    std::generate(weights.biases2.begin(), weights.biases2.end(), [&]() { return uniform(2000); });
+    weights.weights3.resize(hidden2);
+    std::generate(weights.weights3.begin(), weights.weights3.end(), [&]() { return static_cast<int8_t>(uniform(64)); });
+    weights.bias3 = 100;
+    weights.outputscale = 1000;
+    const auto file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("network-%%%%-%%%%.bin");
+    BOOST_REQUIRE(weights.Write(file.string()));
+
+    // The plain forward pass straight from the weights.
+    auto reference = [&](const IMachine& position) {
+        std::array<std::array<int, NetworkWeights::Hidden>, 2> sums;
+        for (Set side : {Set::white, Set::black}) {
+            auto& sum = sums[side == Set::white ? 0 : 1];
+            std::copy(weights.biases.begin(), weights.biases.end(), sum.begin());
+            const Pieces own = position.GetSet(side);
+            const Position king = std::find_if(own.begin(), own.end(), [](const Piece& p) { return p.type == Type::king; })->position;
+            for (Set set : {Set::white, Set::black}) {
+                for (const auto& piece : position.GetSet(set)) {
+                    if (piece.type != Type::king) {
+                        const size_t feature = Network::Feature(side, king, set, piece.type, piece.position);
+                        for (int i = 0; i < hidden; ++i) {
+                            sum[i] += weights.features[feature * hidden + i];
+                        }
+                    }
+                }
+            }
+        }
+        const int player = position.CurrentPlayer() == Set::white ? 0 : 1;
+        auto clip = [](int v) { return std::max(0, std::min(127, v)); };
+        int output = weights.bias3;
+        for (int j = 0; j < hidden2; ++j) {
+            int sum = weights.biases2[j];
+            for (int i = 0; i < hidden; ++i) {
+                sum += clip(sums[player][i]) * weights.weights2[j * 2 * hidden + i] +
+                       clip(sums[1 - player][i]) * weights.weights2[j * 2 * hidden + hidden + i];
+            }
+            output += clip(sum >> NetworkWeights::Shift) * weights.weights3[j];
+        }
+        return static_cast<float>(output) / weights.outputscale;
+    };
+
+    // The incremental sums match the ones counted from the pieces after every move of the line, which passes
+    // captures, en passant, castling, king moves and promotions with and without capture.
+    SearchOptions options;
+    options.evalcache = 0;
+    options.network = file.string();
+    GreedyEngine engine(options);
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    machine->Start();
+    BOOST_CHECK_EQUAL(engine.EvalPosition(*machine), reference(*machine));
+    std::set<float> scores;
+    for (auto m : split("1.e4 d5 2.exd5 c6 3.dxc6 e5 4.Nf3 Nf6 5.Bc4 e4 6.d4 Bd6 7.cxb7 O-O 8.O-O Qc7")) {
+        const Set set = machine->CurrentPlayer();
+        const Pieces pieces = machine->GetSet(set);
+        const Pieces xpieces = machine->GetSet(set == Set::white ? Set::black : Set::white);
+        const EvalAccumulator accumulator = engine.Accumulate(*machine);
+        NetworkAccumulator sums;
+        engine.AccumulateNetwork(*machine, sums);
+        for (const auto& piece : pieces) {
+            for (const auto& to : machine->EnumMoves(piece.position)) {
+                const bool promotion = piece.type == Type::pawn && (to.rank() == '1' || to.rank() == '8');
+                for (auto type : promotion ? std::vector<Type>{Type::knight, Type::bishop, Type::rook, Type::queen}
+                                           : std::vector<Type>{Type::bad}) {
+                    boost::shared_ptr<IMachine> child = machine->SlightClone();
+                    BOOST_REQUIRE(child->Move(piece.type, piece.position, to, type));
+                    if (child->CheckStatus() == Status::checkmate || child->CheckStatus() == Status::stalemate) {
+                        continue;
+                    }
+                    NetworkAccumulator childsums;
+                    engine.AccumulateNetwork(sums, accumulator, set, {piece, to, type}, pieces, xpieces, childsums);
+                    const float incremental = engine.EvalPosition(
+                        *child, engine.Accumulate(accumulator, set, {piece, to, type}, pieces, xpieces), &childsums);
+                    BOOST_CHECK_MESSAGE(incremental == reference(*child),
+                                        "The incremental evaluation differs after " + child->LastMoveNotation());
+                    const PositionSnapshot snapshot = TakeSnapshot(*child);
+                    float batched;
+                    engine.EvalPositions(&snapshot, 1, &batched);
+                    BOOST_CHECK(batched == incremental);
+                    scores.insert(incremental);
+                }
+            }
+        }
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    BOOST_CHECK_GT(scores.size(), 100u); // the weights are not degenerate
+
+    // Both sides see the board from their own king, so the mirrored position with the colors swapped is the same.
+    PositionSnapshot position = TakeSnapshot(*machine);
+    PositionSnapshot mirrored = position;
+    mirrored.white.clear();
+    mirrored.black.clear();
+    for (const auto& p : position.white) {
+        mirrored.black.push_back({p.type, Position(p.position.file(), static_cast<char>('8' - p.position.y()))});
+    }
+    for (const auto& p : position.black) {
+        mirrored.white.push_back({p.type, Position(p.position.file(), static_cast<char>('8' - p.position.y()))});
+    }
+    mirrored.player = position.player == Set::white ? Set::black : Set::white;
+    std::array<float, 2> mirror;
+    engine.EvalPositions(&position, 1, &mirror[0]);
+    engine.EvalPositions(&mirrored, 1, &mirror[1]);
+    BOOST_CHECK_EQUAL(mirror[0], mirror[1]);
+
+    // The kernels give the same sums and scores.
+    Network network;
+    BOOST_REQUIRE(network.Open(file.string()));
+    NetworkAccumulator scalar, best;
+    network.SetKernel(EvalKernel::scalar);
+    network.Refresh(position.white, position.black, scalar);
+    const float scalarscore = network.Evaluate(scalar, position.player);
+    network.SetKernel(BestKernel());
+    network.Refresh(position.white, position.black, best);
+    BOOST_CHECK(scalar.values == best.values);
+    BOOST_CHECK_EQUAL(network.Evaluate(best, position.player), scalarscore);
+
+    // The search runs on the network.
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 3));
+    BOOST_REQUIRE(info.wait(&engine, 120000));
+    BOOST_CHECK(!info.bestmove.empty());
+    // The sums carried along the full width search give the score of the reference search counting them anew.
+    SearchOptions fullwidth = ReferenceOptions();
+    fullwidth.network = file.string();
+    GreedyEngine searcher(fullwidth);
+    boost::shared_ptr<IMachine> line = boost::make_shared<ChessMachine>();
+    line->Start();
+    for (auto m : split("1.e4 d5 2.exd5 c6 3.dxc6 e5 4.Nf3 Nf6 5.Bc4 e4 6.d4 Bd6 7.cxb7 O-O 8.O-O Qc7")) {
+        infotest searched;
+        BOOST_REQUIRE(searcher.Start(*line, 2));
+        BOOST_REQUIRE(searched.wait(&searcher, 120000));
+        size_t nodes = 0;
+        BOOST_CHECK_MESSAGE(std::abs(searched.bestscore - TestSearch(*line, 2, nodes, -inff, inff, engine).first) < 0.001f,
+                            "The search score differs before " + m);
+        BOOST_REQUIRE_MESSAGE(line->Move(m.c_str()), "Can't make move " + m);
+    }
+
+    // Another version is not loaded.
+    {
+        std::fstream patch(file.string(), std::ios::in | std::ios::out | std::ios::binary);
+        patch.seekp(8);
+        const uint32_t version = 2;
+        patch.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    }
+    Network other;
+    BOOST_CHECK(!other.Open(file.string()));
+    boost::filesystem::remove(file);
+    BOOST_CHECK(!other.Open(file.string()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,452 @@
+#include "engine.h"
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+void AddValue(std::atomic<float>& sum, float value) {
+  float old = sum.load(std::memory_order_relaxed);
+  while (!sum.compare_exchange_weak(old, old + value, std::memory_order_relaxed)) {
+  }
+}
+
+}
+
+void MctsEngine::Node::Reset(const MctsMove& m, float p) {
+  move = m;
+  prior = p;
+  terminalvalue = 0;
+  visits.store(0, std::memory_order_relaxed);
+  virtualloss.store(0, std::memory_order_relaxed);
+  valuesum.store(0, std::memory_order_relaxed);
+  state.store(leaf, std::memory_order_relaxed);
+  children = nullptr;
+  childcount = 0;
+}
+
+MctsEngine::Node* MctsEngine::NodeArena::Allocate(size_t count) {
+  const size_t at = used.fetch_add(count, std::memory_order_relaxed);
+  return at + count <= capacity ? &nodes[at] : nullptr;
+}
+
+MctsEngine::MctsEngine(const MctsOptions& opts, boost::shared_ptr<IEvaluator> eval)
+  : options(opts), evaluator(eval ? eval : boost::make_shared<GreedyEvaluator>(opts.scale)),
+    threads(opts.threads > 0 ? opts.threads : std::max(1, static_cast<int>(boost::thread::hardware_concurrency()))),
+    arena(new NodeArena(std::max<size_t>(1, opts.nodes))), spare(new NodeArena(std::max<size_t>(1, opts.nodes))),
+    root(nullptr), playouts(0), pending(0), collisions(0), maxdepth(0), aborted(false), infochannel(aborted, 1),
+    taskwork(new boost::asio::io_service::work(taskservice)),
+    searchthread(aborted, [this](boost::shared_ptr<IMachine> machine, int depth) { ThreadFun(machine, depth); }) {
+  if (options.batchsize > 0) {
+    broker.reset(new EvalBroker(evaluator, options.batchsize, std::chrono::microseconds(options.batchwait)));
+  }
+}
+
+MctsEngine::~MctsEngine() {
+  Stop();
+  taskwork.reset();
+  threadpool.join_all();
+}
+
+bool MctsEngine::Start(const IMachine& position, int depth) {
+  return StartSearch(position, depth, false);
+}
+
+bool MctsEngine::Ponder(const IMachine& position, int depth) {
+  return depth > 0 && StartSearch(position, depth, true);
+}
+
+bool MctsEngine::StartSearch(const IMachine& position, int depth, bool ponder) {
+  if (position.CheckStatus() == Status::normal || position.CheckStatus() == Status::check || (depth == 0 && position.CheckStatus() != Status::invalid)) {
+    Stop();
+    if (depth > 0 && threadpool.size() == 0) {
+      StartWorkers();
+    }
+    starttime = std::chrono::steady_clock::now();
+    searchthread.Start(position.SlightClone(), depth, ponder);
+    return true;
+  }
+  return false;
+}
+
+// The threads are started by the first search, so the engines used only to evaluate never start them.
+void MctsEngine::StartWorkers() {
+  for (int i = 0; i < threads; ++i) {
+    threadpool.create_thread(boost::bind(&boost::asio::io_service::run, &taskservice));
+  }
+}
+
+void MctsEngine::Stop() {
+  searchthread.Stop();
+}
+
+void MctsEngine::PonderHit() {
+  searchthread.PonderHit();
+}
+
+void MctsEngine::ProcessInfo(IInfoCall* cb) {
+  InfoRecord record;
+  while (infochannel.TryPop(record)) {
+    if (cb) {
+      DispatchInfo(record, *cb);
+    }
+  }
+}
+
+bool MctsEngine::WaitInfo(int milliseconds) {
+  return infochannel.Wait(milliseconds);
+}
+
+float MctsEngine::EvalPosition(const IMachine& position) const {
+  if (position.CheckStatus() == Status::checkmate) {
+    return -std::numeric_limits<float>::infinity();
+  }
+  const std::vector<MctsMove> moves = EnumMoves(position);
+  std::vector<float> priors(moves.size());
+  return Score(evaluator->Evaluate(position, moves, priors.data()));
+}
+
+void MctsEngine::EvalPositions(const PositionSnapshot* positions, size_t count, float* scores) const {
+  evaluator->Evaluate(positions, count, scores);
+  for (size_t i = 0; i < count; ++i) {
+    scores[i] = positions[i].status == Status::checkmate ? -std::numeric_limits<float>::infinity() : Score(scores[i]);
+  }
+}
+
+MctsStats MctsEngine::Stats() const {
+  boost::lock_guard<boost::mutex> lock(mutstats);
+  return laststats;
+}
+
+void MctsEngine::ThreadFun(boost::shared_ptr<IMachine> machine, int depth) {
+  stats = MctsStats();
+  playouts = 0;
+  pending = 0;
+  collisions = 0;
+  maxdepth = 0;
+  if (depth == 0) {
+    infochannel.Post(MakeInfo(InfoRecord::bestscore, 0, 0, EvalPosition(*machine)));
+    infochannel.Post(MakeInfo(InfoRecord::readyok));
+    return;
+  }
+
+  stats.reused = ReuseTree(*machine);
+  rootposition = machine;
+  const size_t limit = options.playouts * static_cast<size_t>(depth);
+  // The root is expanded before the threads start, so that they spread over its children at once.
+  while (root->state.load(std::memory_order_acquire) != expanded && !aborted && playouts < limit) {
+    Playout();
+    if (broker) {
+      broker->Flush();
+    }
+  }
+  std::atomic<int> running(threads);
+  for (int i = 0; i < threads; ++i) {
+    taskservice.post([this, limit, &running]() {
+      WorkerFun(limit);
+      --running;
+    });
+  }
+  auto nextreport = starttime + std::chrono::milliseconds(options.reportinterval);
+  while (running > 0) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    if (std::chrono::steady_clock::now() >= nextreport) {
+      nextreport += std::chrono::milliseconds(options.reportinterval);
+      ReportProgress(depth);
+    }
+  }
+  if (broker) {
+    broker->Flush();
+    stats.batches = broker->TakeHistograms();
+  }
+
+  // The most visited moves make the line, the value of the first one is the score of the position.
+  std::vector<const Node*> line;
+  for (const Node* node = root; node->state.load(std::memory_order_acquire) == expanded && line.size() < MaxPath; ) {
+    const Node* best = std::max_element(node->children, node->children + node->childcount, [](const Node& a, const Node& b) {
+      return a.visits < b.visits || (a.visits == b.visits && a.prior < b.prior);
+    });
+    if (!line.empty() && best->visits == 0) {
+      break;
+    }
+    line.push_back(best);
+    node = best;
+  }
+  const std::vector<std::string> notations = Notations(line);
+  // Only a move proven to checkmate is worth the infinite score, the values just close to 1 stay finite.
+  const float bestscore = line.empty() ? Score(-root->Value()) :
+                          line.front()->state == terminal && line.front()->terminalvalue < 0 ? std::numeric_limits<float>::infinity() :
+                          Score(line.front()->Value());
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - starttime;
+  stats.playouts = playouts;
+  stats.nodes = arena->Used();
+  stats.bytespernode = sizeof(Node);
+  stats.playoutspersecond = elapsed.count() > 0 ? stats.playouts / elapsed.count() : 0;
+  stats.collisions = collisions;
+
+  if (!searchthread.AwaitPonderHit()) {
+    return; // The opponent made another move, nobody waits for the results.
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(mutstats);
+    laststats = stats;
+  }
+  ReportProgress(depth);
+  infochannel.Post(MakeInfo(InfoRecord::principalvariation, 1, static_cast<int>(line.size()), bestscore, JoinLine(notations)));
+  infochannel.Post(MakeInfo(InfoRecord::bestscore, 0, 0, bestscore));
+  infochannel.Post(MakeInfo(InfoRecord::bestmove, 0, 0, 0, notations.empty() ? std::string() : notations.front()));
+  infochannel.Post(MakeInfo(InfoRecord::readyok));
+}
+
+void MctsEngine::WorkerFun(size_t limit) {
+  while (!aborted.load(std::memory_order_relaxed) &&
+         playouts.load(std::memory_order_relaxed) + pending.load(std::memory_order_relaxed) < limit) {
+    if (!Playout() && broker) {
+      boost::this_thread::yield(); // the leaves on the way wait for their batch
+    }
+  }
+}
+
+// One walk from the root to a leaf and back. Returns false if the leaf was being expanded by another thread, then the
+// playout is dropped without a trace.
+bool MctsEngine::Playout() {
+  std::array<Node*, MaxPath> path;
+  int length = 0;
+  boost::shared_ptr<IMachine> position = rootposition->SlightClone();
+  Node* node = root;
+  path[length++] = node;
+  while (node->state.load(std::memory_order_acquire) == expanded && length < MaxPath) {
+    node = Select(node);
+    node->virtualloss.fetch_add(options.virtualloss, std::memory_order_relaxed);
+    path[length++] = node;
+    if (!position->Move(node->move.type, node->move.from, node->move.to, node->move.promotion)) {
+      assert(!"Can't make move!");
+      break;
+    }
+  }
+
+  float value; // for the side to move at the leaf
+  int state = node->state.load(std::memory_order_acquire);
+  if (state == terminal) {
+    value = node->terminalvalue;
+  } else if (state == expanded) {
+    value = evaluator->Evaluate(*position, std::vector<MctsMove>(), nullptr); // the path is too long to go deeper
+  } else if (state == leaf && node->state.compare_exchange_strong(state, expanding, std::memory_order_acquire)) {
+    const Status status = position->CheckStatus();
+    if (status == Status::checkmate || status == Status::stalemate) {
+      node->terminalvalue = status == Status::checkmate ? -1.0f : 0.0f;
+      node->state.store(terminal, std::memory_order_release);
+      value = node->terminalvalue;
+    } else if (broker) {
+      // The leaf keeps its state and the path its virtual losses until the batch is back.
+      EvalRequest request;
+      request.moves = EnumMoves(*position);
+      request.position = position;
+      std::vector<Node*> line(path.begin(), path.begin() + length);
+      pending.fetch_add(1, std::memory_order_relaxed);
+      broker->Submit(std::move(request), [this, line](const EvalRequest& evaluated) {
+        Expand(line.back(), evaluated.moves, evaluated.priors.data());
+        Backup(line.data(), static_cast<int>(line.size()), evaluated.value);
+        pending.fetch_sub(1, std::memory_order_relaxed);
+      });
+      return true;
+    } else {
+      const std::vector<MctsMove> moves = EnumMoves(*position);
+      std::vector<float> priors(moves.size());
+      value = evaluator->Evaluate(*position, moves, priors.data());
+      Expand(node, moves, priors.data());
+    }
+  } else {
+    for (int i = 1; i < length; ++i) {
+      path[i]->virtualloss.fetch_sub(options.virtualloss, std::memory_order_relaxed);
+    }
+    collisions.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  Backup(path.data(), length, value);
+  return true;
+}
+
+// Adds the value for the side to move at the last node to the nodes of the path, taking back the virtual losses.
+void MctsEngine::Backup(Node* const* path, int length, float value) {
+  for (int i = length - 1; i >= 0; --i) {
+    value = -value; // for the side that made the move to the node
+    AddValue(path[i]->valuesum, value);
+    path[i]->visits.fetch_add(1, std::memory_order_relaxed);
+    if (i > 0) {
+      path[i]->virtualloss.fetch_sub(options.virtualloss, std::memory_order_relaxed);
+    }
+  }
+  int deepest = maxdepth.load(std::memory_order_relaxed);
+  while (deepest < length - 1 && !maxdepth.compare_exchange_weak(deepest, length - 1, std::memory_order_relaxed)) {
+  }
+  playouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+// PUCT: the value of the child for the side to move plus the exploration bonus, which grows with the prior and the
+// visits of the parent and falls with the visits of the child. The children not visited yet take the parent's value.
+MctsEngine::Node* MctsEngine::Select(Node* node) const {
+  const int parentvisits = node->visits.load(std::memory_order_relaxed) + node->virtualloss.load(std::memory_order_relaxed);
+  const float explore = options.cpuct * std::sqrt(static_cast<float>(std::max(1, parentvisits)));
+  const float unvisited = -node->Value();
+  Node* best = nullptr;
+  float bestscore = -std::numeric_limits<float>::infinity();
+  for (int i = 0; i < node->childcount; ++i) {
+    Node* child = &node->children[i];
+    const int loss = child->virtualloss.load(std::memory_order_relaxed);
+    const int visits = child->visits.load(std::memory_order_relaxed) + loss;
+    const float value = visits > 0 ? (child->valuesum.load(std::memory_order_relaxed) - loss) / visits : unvisited;
+    const float score = value + explore * child->prior / (1 + visits);
+    if (score > bestscore) {
+      bestscore = score;
+      best = child;
+    }
+  }
+  return best;
+}
+
+// Called for the node moved from 'leaf' to 'expanding' by the playout that reached it.
+void MctsEngine::Expand(Node* node, const std::vector<MctsMove>& moves, const float* priors) {
+  Node* children = arena->Allocate(moves.size());
+  if (!children) {
+    node->state.store(leaf, std::memory_order_release); // The arena is full, the leaf is just evaluated every time.
+    return;
+  }
+  for (size_t i = 0; i < moves.size(); ++i) {
+    children[i].Reset(moves[i], priors[i]);
+  }
+  node->children = children;
+  node->childcount = static_cast<int>(moves.size());
+  node->state.store(expanded, std::memory_order_release);
+}
+
+std::vector<MctsMove> MctsEngine::EnumMoves(const IMachine& position) const {
+  std::vector<MctsMove> moves;
+  for (const auto& piece : position.GetSet(position.CurrentPlayer())) {
+    for (const auto& move : position.EnumMoves(piece.position)) {
+      if (piece.type == Type::pawn && (move.rank() == '1' || move.rank() == '8')) {
+        for (auto type : { Type::knight, Type::bishop, Type::rook, Type::queen }) {
+          moves.push_back({ piece.type, piece.position, move, type });
+        }
+      } else {
+        moves.push_back({ piece.type, piece.position, move, Type::bad });
+      }
+    }
+  }
+  return moves;
+}
+
+// Looks for the position among the nodes of the previous tree up to two plies deep, its subtree becomes the new tree.
+// Returns the visits kept.
+size_t MctsEngine::ReuseTree(const IMachine& position) {
+  const uint64_t key = position.PositionKey();
+  Node* found = nullptr;
+  if (root && rootposition) {
+    if (rootposition->PositionKey() == key) {
+      found = root;
+    }
+    for (int i = 0; !found && root->state == expanded && i < root->childcount; ++i) {
+      Node* child = &root->children[i];
+      boost::shared_ptr<IMachine> reply = rootposition->SlightClone();
+      reply->Move(child->move.type, child->move.from, child->move.to, child->move.promotion);
+      if (reply->PositionKey() == key) {
+        found = child;
+      }
+      for (int j = 0; !found && child->state == expanded && j < child->childcount; ++j) {
+        Node* grandchild = &child->children[j];
+        boost::shared_ptr<IMachine> next = reply->SlightClone();
+        next->Move(grandchild->move.type, grandchild->move.from, grandchild->move.to, grandchild->move.promotion);
+        if (next->PositionKey() == key) {
+          found = grandchild;
+        }
+      }
+    }
+  }
+  if (found && found != root) {
+    spare->Clear();
+    root = CopyTree(found, *spare);
+    std::swap(arena, spare);
+  } else if (!found) {
+    root = nullptr;
+  }
+  if (!root) {
+    arena->Clear();
+    root = arena->Allocate(1);
+    root->Reset(MctsMove{ Type::bad, Position(), Position(), Type::bad }, 1.0f);
+  }
+  return root->visits;
+}
+
+// Copies the subtree depth first, the nodes that do not fit into the arena lose their children.
+MctsEngine::Node* MctsEngine::CopyTree(const Node* from, NodeArena& into) const {
+  Node* copy = into.Allocate(1);
+  if (!copy) {
+    return nullptr;
+  }
+  std::vector<std::pair<const Node*, Node*>> stack(1, std::make_pair(from, copy));
+  while (!stack.empty()) {
+    const Node* source = stack.back().first;
+    Node* target = stack.back().second;
+    stack.pop_back();
+    target->Reset(source->move, source->prior);
+    target->terminalvalue = source->terminalvalue;
+    target->visits.store(source->visits, std::memory_order_relaxed);
+    target->valuesum.store(source->valuesum, std::memory_order_relaxed);
+    target->state.store(source->state == terminal ? terminal : leaf, std::memory_order_relaxed);
+    if (source->state != expanded) {
+      continue;
+    }
+    Node* children = into.Allocate(source->childcount);
+    if (!children) {
+      continue;
+    }
+    target->children = children;
+    target->childcount = source->childcount;
+    target->state.store(expanded, std::memory_order_relaxed);
+    for (int i = 0; i < source->childcount; ++i) {
+      stack.push_back(std::make_pair(&source->children[i], &children[i]));
+    }
+  }
+  return copy;
+}
+
+std::vector<std::string> MctsEngine::Notations(const std::vector<const Node*>& line) const {
+  std::vector<std::string> notations;
+  boost::shared_ptr<IMachine> position = rootposition->SlightClone();
+  for (const Node* node : line) {
+    if (!position->Move(node->move.type, node->move.from, node->move.to, node->move.promotion)) {
+      assert(!"Can't make move!");
+      break;
+    }
+    notations.push_back(position->LastMoveNotation());
+  }
+  return notations;
+}
+
+// The value for the side to move turned back into pawns. The value is kept below 1, so the score is always finite: the
+// infinite scores are left to the proven mates.
+float MctsEngine::Score(float value) const {
+  const float limit = std::nextafter(1.0f, 0.0f);
+  return options.scale * std::atanh(std::max(-limit, std::min(limit, value)));
+}
+
+void MctsEngine::ReportProgress(int depth) {
+  const size_t searched = playouts;
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - starttime;
+  const int pps = elapsed.count() > 0 ? static_cast<int>(searched / elapsed.count()) : 0;
+  infochannel.Post(MakeInfo(InfoRecord::nodessearched, searched));
+  infochannel.Post(MakeInfo(InfoRecord::nodespersecond, pps));
+  infochannel.Post(MakeInfo(InfoRecord::searchdepth, maxdepth, depth));
+  infochannel.Post(MakeInfo(InfoRecord::hashfull, arena->Used() * 1000 / arena->Capacity()));
+}
+
+}
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include "evalbroker.h"
+#include "evaluator.h"
+
+#include <ChessEngineGreedy/engine.h>
+#include <ChessEngineGreedy/searchthread.h>
+
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+struct MctsOptions {
+    int threads = 0;           // playout threads, 0 takes one per core
+    size_t nodes = 1 << 20;    // capacity of the node arena, the tree stops growing when it is full
+    size_t playouts = 400;     // playouts per ply of the depth given to Start
+    float cpuct = 1.5f;        // weight of the prior and the visit count against the value in the selection
+    int virtualloss = 3;       // lost visits added to the nodes on the way of a running playout
+    float scale = 4.0f;        // pawns of the score giving the value tanh(1), to report the values as scores
+    int reportinterval = 100;  // milliseconds between the progress reports
+
+    // Leaves evaluated in batches by EvalBroker, the playout threads go on with other leaves while a batch is filled.
+    size_t batchsize = 0;      // leaves of a batch, 0 evaluates every leaf in the thread of its playout
+    int batchwait = 1000;      // microseconds the first leaf of a batch waits for the others
+};
+
+// Measures of the last search.
+struct MctsStats {
+    size_t playouts = 0;
+    size_t nodes = 0;          // allocated in the arena, the reused ones included
+    size_t bytespernode = 0;
+    double playoutspersecond = 0;
+    size_t reused = 0;         // visits of the subtree kept from the previous search
+    size_t collisions = 0;     // playouts dropped because another thread was expanding their leaf
+    BatchHistograms batches;   // of the broker, empty without it
+};
+
+/**
+  Monte Carlo tree search with the PUCT selection.
+
+  Every playout walks down the tree choosing the child with the best value plus the exploration bonus of its prior,
+  expands the leaf it reaches by the moves found there and backs the value of the evaluator up the path. The threads
+  share one tree: the visits and the values are atomic counters, and a playout adds virtual losses to the nodes on its
+  way, so that the other threads go elsewhere until it is backed up.
+
+  The nodes come from an arena allocated once. The tree of the previous search is kept, and when the next position is
+  found in it within two plies, its subtree is copied into the second arena and the search goes on from there.
+*/
+class MctsEngine : public IEngine {
+ public:
+    explicit MctsEngine(const MctsOptions& opts = MctsOptions(),
+                        boost::shared_ptr<IEvaluator> evaluator = boost::shared_ptr<IEvaluator>());
+    ~MctsEngine() override;
+
+    bool Start(const IMachine& position, int depth) override;
+    void Stop() override;
+    bool Ponder(const IMachine& position, int depth) override;
+    void PonderHit() override;
+    void ProcessInfo(IInfoCall* cb) override;
+    bool WaitInfo(int milliseconds) override;
+    float EvalPosition(const IMachine& position) const override;
+    void EvalPositions(const PositionSnapshot* positions, size_t count, float* scores) const override;
+
+    MctsStats Stats() const; // Measures of the last completed search.
+
+ private:
+    enum NodeState { leaf, expanding, expanded, terminal };
+
+    struct Node {
+        MctsMove move;                   // the move leading to the node
+        float prior;
+        float terminalvalue;             // for the side to move, of the checkmates and stalemates
+        std::atomic<int> visits;
+        std::atomic<int> virtualloss;
+        std::atomic<float> valuesum;     // for the side that made the move
+        std::atomic<int> state;
+        Node* children;                  // published by the release store of 'expanded'
+        int childcount;
+
+        void Reset(const MctsMove& m, float p);
+        float Value() const {            // for the side that made the move
+            const int n = visits.load(std::memory_order_relaxed);
+            return n > 0 ? valuesum.load(std::memory_order_relaxed) / n : 0.0f;
+        }
+    };
+
+    // Bump allocator of the nodes, shared by the threads without locks.
+    class NodeArena {
+     public:
+        explicit NodeArena(size_t size) : nodes(new Node[size]), capacity(size), used(0) {}
+        Node* Allocate(size_t count); // nullptr when the arena is full
+        void Clear() {
+            used = 0;
+        }
+        size_t Used() const {
+            return std::min(used.load(std::memory_order_relaxed), capacity);
+        }
+        size_t Capacity() const {
+            return capacity;
+        }
+
+     private:
+        std::unique_ptr<Node[]> nodes;
+        const size_t capacity;
+        std::atomic<size_t> used;
+    };
+
+    static const int MaxPath = 128;
+
+    bool StartSearch(const IMachine& position, int depth, bool ponder);
+    void StartWorkers();
+    void ThreadFun(boost::shared_ptr<IMachine> machine, int depth);
+    void WorkerFun(size_t limit);
+    bool Playout();
+    Node* Select(Node* node) const;
+    void Expand(Node* node, const std::vector<MctsMove>& moves, const float* priors);
+    void Backup(Node* const* path, int length, float value);
+    std::vector<MctsMove> EnumMoves(const IMachine& position) const;
+    size_t ReuseTree(const IMachine& position);
+    Node* CopyTree(const Node* from, NodeArena& into) const;
+    std::vector<std::string> Notations(const std::vector<const Node*>& line) const;
+    float Score(float value) const;
+    void ReportProgress(int depth);
+
+    const MctsOptions options;
+    boost::shared_ptr<IEvaluator> evaluator;
+    const int threads;
+    std::unique_ptr<EvalBroker> broker;
+
+    // The tree of the current search and of the previous one, the arenas swap when a subtree is reused.
+    std::unique_ptr<NodeArena> arena;
+    std::unique_ptr<NodeArena> spare;
+    Node* root;
+    boost::shared_ptr<IMachine> rootposition;
+
+    std::chrono::steady_clock::time_point starttime;
+    std::atomic<size_t> playouts;
+    std::atomic<size_t> pending; // leaves waiting for their batch
+    std::atomic<size_t> collisions;
+    std::atomic<int> maxdepth;
+    MctsStats stats;
+    MctsStats laststats;
+    mutable boost::mutex mutstats;
+
+    std::atomic<bool> aborted;
+    InfoChannel infochannel; // the search posts the one line of its end
+
+    // The playout threads start with the first search, live as long as the engine and wait for the next search.
+    boost::asio::io_service taskservice;
+    std::unique_ptr<boost::asio::io_service::work> taskwork;
+    boost::thread_group threadpool;
+
+    // The last member, so the search thread is gone before the members it uses.
+    SearchThread searchthread;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,127 @@
+#include "evalbroker.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const size_t WaitBuckets = 24; // up to 2^23 microseconds
+
+size_t WaitBucket(std::chrono::microseconds waited) {
+  size_t bucket = 0;
+  for (auto us = waited.count(); us > 0 && bucket + 1 < WaitBuckets; us >>= 1) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+}
+
+EvalBroker::EvalBroker(boost::shared_ptr<IEvaluator> eval, size_t size, std::chrono::microseconds wait)
+  : evaluator(eval), batchsize(std::max<size_t>(1, size)), maxwait(wait), running(0), flushing(0), shutdown(false) {
+  histograms.sizes.assign(batchsize + 1, 0);
+  histograms.waits.assign(WaitBuckets, 0);
+  thread = boost::thread(boost::bind(&EvalBroker::ThreadFun, this));
+}
+
+EvalBroker::~EvalBroker() {
+  Flush();
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    shutdown = true;
+  }
+  condsubmit.notify_all();
+  thread.join();
+}
+
+void EvalBroker::Submit(EvalRequest request, Callback done) {
+  bool wake;
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    queue.push_back(Pending{ std::move(request), std::move(done), std::chrono::steady_clock::now() });
+    // The broker sleeps until the first request of a batch arrives and then until the batch is full or due.
+    wake = queue.size() == 1 || queue.size() >= batchsize;
+  }
+  if (wake) {
+    condsubmit.notify_one();
+  }
+}
+
+void EvalBroker::Flush() {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  ++flushing;
+  condsubmit.notify_one();
+  while (!queue.empty() || running > 0) {
+    conddone.wait(lock);
+  }
+  --flushing;
+}
+
+BatchHistograms EvalBroker::TakeHistograms() {
+  boost::lock_guard<boost::mutex> lock(mutex);
+  BatchHistograms taken = histograms;
+  std::fill(histograms.sizes.begin(), histograms.sizes.end(), 0);
+  std::fill(histograms.waits.begin(), histograms.waits.end(), 0);
+  histograms.requests = 0;
+  histograms.batches = 0;
+  return taken;
+}
+
+void EvalBroker::ThreadFun() {
+  std::vector<Pending> batch;
+  std::vector<EvalRequest> requests;
+  boost::unique_lock<boost::mutex> lock(mutex);
+  while (!shutdown) {
+    if (queue.empty()) {
+      condsubmit.wait(lock);
+      continue;
+    }
+    if (queue.size() < batchsize && flushing == 0) {
+      const auto due = queue.front().submitted + maxwait;
+      if (std::chrono::steady_clock::now() < due) {
+        const auto left = std::chrono::duration_cast<std::chrono::microseconds>(due - std::chrono::steady_clock::now());
+        condsubmit.timed_wait(lock, boost::posix_time::microseconds(left.count() + 1));
+        continue;
+      }
+    }
+    const size_t count = std::min(batchsize, queue.size());
+    batch.clear();
+    std::move(queue.begin(), queue.begin() + count, std::back_inserter(batch));
+    queue.erase(queue.begin(), queue.begin() + count);
+    running = count;
+    const auto start = std::chrono::steady_clock::now();
+    Record(batch, start);
+    lock.unlock();
+
+    requests.clear();
+    for (auto& p : batch) {
+      requests.push_back(std::move(p.request));
+    }
+    evaluator->Evaluate(requests.data(), requests.size());
+    for (size_t i = 0; i < count; ++i) {
+      batch[i].done(requests[i]);
+    }
+
+    lock.lock();
+    running = 0;
+    if (queue.empty()) {
+      conddone.notify_all();
+    }
+  }
+}
+
+void EvalBroker::Record(const std::vector<Pending>& taken, std::chrono::steady_clock::time_point start) {
+  ++histograms.batches;
+  ++histograms.sizes[taken.size()];
+  for (const auto& p : taken) {
+    ++histograms.requests;
+    ++histograms.waits[WaitBucket(std::chrono::duration_cast<std::chrono::microseconds>(start - p.submitted))];
+  }
+}
+
+}
+}
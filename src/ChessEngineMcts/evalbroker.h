@@ -0,0 +1,68 @@
+#pragma once
+
+#include "evaluator.h"
+
+#include <boost/thread.hpp>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+struct BatchHistograms {
+    size_t requests = 0;
+    size_t batches = 0;
+    std::vector<size_t> sizes; // batches by their size
+    std::vector<size_t> waits; // requests by the microseconds they waited for their batch: 0, 1, 2-3, 4-7 and so on
+};
+
+/**
+  Gathers the leaves submitted by the search threads into the batches of the evaluator.
+
+  Submit returns at once, so the search thread goes on with other nodes while the leaf waits. The broker thread takes a
+  batch when it is full or when its oldest leaf has waited long enough, evaluates it and calls back every request in the
+  order of submission.
+*/
+class EvalBroker {
+ public:
+    typedef std::function<void(const EvalRequest& request)> Callback;
+
+    EvalBroker(boost::shared_ptr<IEvaluator> evaluator, size_t batchsize, std::chrono::microseconds maxwait);
+    EvalBroker(const EvalBroker&) = delete;
+    EvalBroker& operator=(const EvalBroker&) = delete;
+    ~EvalBroker();
+
+    void Submit(EvalRequest request, Callback done);
+    void Flush(); // Blocks until all the submitted requests are called back, the last batch is not waited for.
+    BatchHistograms TakeHistograms(); // The histograms since the last call.
+
+ private:
+    struct Pending {
+        EvalRequest request;
+        Callback done;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void ThreadFun();
+    void Record(const std::vector<Pending>& batch, std::chrono::steady_clock::time_point start);
+
+    boost::shared_ptr<IEvaluator> evaluator;
+    const size_t batchsize;
+    const std::chrono::microseconds maxwait;
+
+    boost::thread thread;
+    boost::mutex mutex;
+    boost::condition_variable condsubmit; // wakes up the broker thread
+    boost::condition_variable conddone;   // wakes up Flush
+    std::deque<Pending> queue;
+    size_t running; // requests of the batch being evaluated
+    int flushing;   // callers of Flush, they want the batches at once
+    bool shutdown;
+    BatchHistograms histograms;
+};
+
+} // namespace Chess
+} // namespace Chai
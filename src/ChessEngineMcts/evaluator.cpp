@@ -0,0 +1,83 @@
+#include "evaluator.h"
+
+#include <ChessEngineGreedy/engine.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+// Material of the pieces in pawns, as the priors see it.
+float Material(Type type) {
+  switch (type) {
+  case Type::pawn:    return 1.0f;
+  case Type::knight:  return 3.0f;
+  case Type::bishop:  return 3.0f;
+  case Type::rook:    return 5.0f;
+  case Type::queen:   return 9.0f;
+  default:            return 0.0f;
+  }
+}
+
+// The engine only evaluates, it needs neither the workers nor the transposition table.
+SearchOptions EvalOptions() {
+  SearchOptions options;
+  options.threads = 1;
+  options.transpositions = 0;
+  return options;
+}
+
+}
+
+void IEvaluator::Evaluate(EvalRequest* requests, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    requests[i].priors.resize(requests[i].moves.size());
+    requests[i].value = Evaluate(*requests[i].position, requests[i].moves, requests[i].priors.data());
+  }
+}
+
+GreedyEvaluator::GreedyEvaluator(float s, float t) : engine(new GreedyEngine(EvalOptions())), scale(s), temperature(t) {
+}
+
+GreedyEvaluator::~GreedyEvaluator() {
+}
+
+float GreedyEvaluator::Evaluate(const IMachine& position, const std::vector<MctsMove>& moves, float* priors) {
+  if (!moves.empty()) {
+    const Set set = position.CurrentPlayer();
+    const Pieces xpieces = position.GetSet(set == Set::white ? Set::black : Set::white);
+    float maxgain = 0;
+    for (size_t i = 0; i < moves.size(); ++i) {
+      const MctsMove& m = moves[i];
+      auto victim = std::find_if(xpieces.begin(), xpieces.end(), [&](const Piece& p) { return p.position == m.to; });
+      float gain = victim != xpieces.end() ? Material(victim->type) : 0.0f;
+      if (m.promotion != Type::bad) {
+        gain += Material(m.promotion) - Material(Type::pawn);
+      }
+      priors[i] = gain;
+      maxgain = std::max(maxgain, gain);
+    }
+    float sum = 0;
+    for (size_t i = 0; i < moves.size(); ++i) {
+      priors[i] = std::exp((priors[i] - maxgain) / temperature);
+      sum += priors[i];
+    }
+    for (size_t i = 0; i < moves.size(); ++i) {
+      priors[i] /= sum;
+    }
+  }
+  return std::tanh(engine->EvalPosition(position) / scale);
+}
+
+void GreedyEvaluator::Evaluate(const PositionSnapshot* positions, size_t count, float* values) {
+  engine->EvalPositions(positions, count, values);
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = std::tanh(values[i] / scale);
+  }
+}
+
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+class GreedyEngine;
+
+struct MctsMove {
+    Type type;
+    Position from;
+    Position to;
+    Type promotion;
+};
+
+// A leaf evaluated in a batch, the value and the priors are filled by the evaluator.
+struct EvalRequest {
+    boost::shared_ptr<IMachine> position;
+    std::vector<MctsMove> moves;
+    float value = 0;
+    std::vector<float> priors;
+};
+
+/**
+  Evaluation of the leaves of the tree search.
+
+  The value of a position is the expected result for the side to move, from -1 (loss) to 1 (win). The priors are the
+  probabilities of the legal moves being the best ones, summed up to one. Evaluate is called by all the search threads
+  at once.
+*/
+class IEvaluator {
+ public:
+    // The value of the position, the priors are written for the moves in their order.
+    virtual float Evaluate(const IMachine& position, const std::vector<MctsMove>& moves, float* priors) = 0;
+    // The values of many positions at once, without the priors.
+    virtual void Evaluate(const PositionSnapshot* positions, size_t count, float* values) = 0;
+    // The values and the priors of a batch of the leaves. The evaluators running in batches override it, the others
+    // evaluate the leaves one by one.
+    virtual void Evaluate(EvalRequest* requests, size_t count);
+
+    virtual ~IEvaluator() {}
+};
+
+/**
+  Static evaluation of GreedyEngine squashed into the value by tanh(score / scale). The priors favour the captures of
+  the heavier pieces and the promotions by the softmax of the material they win.
+*/
+class GreedyEvaluator : public IEvaluator {
+ public:
+    explicit GreedyEvaluator(float scale = 4.0f, float temperature = 2.0f);
+    ~GreedyEvaluator() override;
+
+    using IEvaluator::Evaluate;
+    float Evaluate(const IMachine& position, const std::vector<MctsMove>& moves, float* priors) override;
+    void Evaluate(const PositionSnapshot* positions, size_t count, float* values) override;
+
+ private:
+    std::unique_ptr<GreedyEngine> engine;
+    const float scale;       // pawns of the score giving the value tanh(1)
+    const float temperature; // pawns of the gain making a move e times more probable
+};
+
+} // namespace Chess
+} // namespace Chai
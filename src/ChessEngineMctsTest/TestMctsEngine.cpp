@@ -0,0 +1,294 @@
+#define BOOST_TEST_MODULE MyTest
+
+#include <ChessEngineMcts/engine.h>
+#include <ChessMachine/machine.h>
+#include <Common/machinetestutils.h>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <numeric>
+
+using namespace Chai::Chess;
+
+CHESSBOARD;
+
+class infotest : private InfoCallAdapter {
+ public:
+    std::string bestmove;
+    float bestscore = 0;
+    size_t nodes = 0;
+    int nps = 0;
+    int hashfull = 0;
+    std::vector<std::string> pv;
+
+    bool wait(IEngine* engine, int timeout) {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        while (!readyok && std::chrono::steady_clock::now() < end) {
+            engine->WaitInfo(10);
+            engine->ProcessInfo(this);
+        }
+        if (!readyok) {
+            engine->Stop();
+        }
+        return readyok;
+    }
+
+ private:
+    void NodesSearched(size_t n) override {
+        nodes = n;
+    }
+    void NodesPerSecond(int n) override {
+        nps = n;
+    }
+    void HashFull(int permill) override {
+        hashfull = permill;
+    }
+    void PrincipalVariation(int /*depth*/, float /*score*/, const std::vector<std::string>& notations, int line) override {
+        if (line == 1) {
+            pv = notations;
+        }
+    }
+    void ReadyOk() override {
+        readyok = true;
+    }
+    void BestMove(std::string notation) override {
+        bestmove = notation;
+    }
+    void BestScore(float score) override {
+        bestscore = score;
+    }
+
+    bool readyok = false;
+};
+
+// Counts the calls and gives every position the same value and every move the same prior.
+class countingevaluator : public IEvaluator {
+ public:
+    std::atomic<int> calls{0};
+    float value = 0.0f;
+
+    float Evaluate(const IMachine& /*position*/, const std::vector<MctsMove>& moves, float* priors) override {
+        ++calls;
+        for (size_t i = 0; i < moves.size(); ++i) {
+            priors[i] = 1.0f / moves.size();
+        }
+        return value;
+    }
+    void Evaluate(const PositionSnapshot* /*positions*/, size_t count, float* values) override {
+        std::fill(values, values + count, value);
+    }
+};
+
+// Remembers the sizes of the batches.
+class batchingevaluator : public countingevaluator {
+ public:
+    using countingevaluator::Evaluate;
+    std::vector<size_t> batches;
+
+    void Evaluate(EvalRequest* requests, size_t count) override {
+        batches.push_back(count); // called by the broker thread only
+        IEvaluator::Evaluate(requests, count);
+    }
+};
+
+boost::shared_ptr<IMachine> Play(const std::string& game) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    machine->Start();
+    for (auto m : split(game)) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    return machine;
+}
+
+BOOST_AUTO_TEST_SUITE(MctsEngineTest)
+
+BOOST_AUTO_TEST_CASE(StartTest) {
+    MctsOptions options;
+    options.threads = 1;
+    MctsEngine engine(options);
+
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE(!engine.Start(*machine, 0));
+    machine->Start();
+    BOOST_CHECK_SMALL(engine.EvalPosition(*machine), 0.001f);
+    {
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 0));
+        BOOST_REQUIRE(info.wait(&engine, 1000));
+        BOOST_CHECK(info.bestmove.empty());
+        BOOST_CHECK_SMALL(info.bestscore, 0.001f);
+    }
+    {
+        infotest info;
+        BOOST_REQUIRE(engine.Start(*machine, 1));
+        BOOST_REQUIRE(info.wait(&engine, 60000));
+        BOOST_CHECK(machine->SlightClone()->Move(info.bestmove));
+        BOOST_CHECK(!info.pv.empty() && info.pv.front() == info.bestmove);
+        BOOST_CHECK_EQUAL(info.nodes, options.playouts);
+    }
+
+    // Stop ends the search at once with the best move found so far.
+    {
+        MctsOptions endless = options;
+        endless.playouts = 100000000;
+        MctsEngine stopped(endless);
+        infotest info;
+        BOOST_REQUIRE(stopped.Start(*machine, 100));
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        stopped.Stop();
+        BOOST_REQUIRE(info.wait(&stopped, 1000));
+        BOOST_CHECK(machine->SlightClone()->Move(info.bestmove));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MateTest) {
+    boost::shared_ptr<IMachine> machine = Play("1.e4 e5 2.Bc4 Nc6 3.Qh5 Nf6");
+    MctsOptions options;
+    options.threads = 2;
+    MctsEngine engine(options);
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 2));
+    BOOST_REQUIRE(info.wait(&engine, 60000));
+    BOOST_CHECK_EQUAL(info.bestmove, "Qxf7");
+    BOOST_CHECK_EQUAL(info.bestscore, std::numeric_limits<float>::infinity());
+}
+
+BOOST_AUTO_TEST_CASE(TreeParallelismTest) {
+    boost::shared_ptr<IMachine> machine = Play("1.e4 e5 2.Nf3 Nc6 3.Bb5 a6");
+    MctsOptions options;
+    options.threads = 4;
+    options.playouts = 500;
+    MctsEngine engine(options);
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 2));
+    BOOST_REQUIRE(info.wait(&engine, 60000));
+    const MctsStats stats = engine.Stats();
+    // The threads check the limit before every playout, so every one of them may finish one more.
+    BOOST_CHECK_GE(stats.playouts, 2 * options.playouts);
+    BOOST_CHECK_LT(stats.playouts, 2 * options.playouts + options.threads);
+    BOOST_CHECK_EQUAL(info.nodes, stats.playouts);
+    BOOST_CHECK_GT(stats.nodes, stats.playouts);
+    BOOST_CHECK_GT(stats.bytespernode, 0u);
+    BOOST_CHECK_GT(stats.playoutspersecond, 0);
+    BOOST_CHECK_EQUAL(stats.reused, 0u);
+    BOOST_CHECK(machine->SlightClone()->Move(info.bestmove));
+}
+
+BOOST_AUTO_TEST_CASE(SubtreeReuseTest) {
+    boost::shared_ptr<IMachine> machine = Play("1.e4 e5 2.Nf3");
+    MctsOptions options;
+    options.threads = 2;
+    MctsEngine engine(options);
+    infotest first;
+    BOOST_REQUIRE(engine.Start(*machine, 3));
+    BOOST_REQUIRE(first.wait(&engine, 60000));
+    BOOST_REQUIRE(first.pv.size() >= 2);
+
+    // The expected line was played: both moves are found in the tree.
+    BOOST_REQUIRE(machine->Move(first.pv[0]));
+    BOOST_REQUIRE(machine->Move(first.pv[1]));
+    infotest second;
+    BOOST_REQUIRE(engine.Start(*machine, 1));
+    BOOST_REQUIRE(second.wait(&engine, 60000));
+    const MctsStats stats = engine.Stats();
+    BOOST_CHECK_GT(stats.reused, 0u);
+    BOOST_CHECK(machine->SlightClone()->Move(second.bestmove));
+
+    // An unrelated position starts a new tree.
+    infotest third;
+    BOOST_REQUIRE(engine.Start(*Play("1.d4 d5"), 1));
+    BOOST_REQUIRE(third.wait(&engine, 60000));
+    BOOST_CHECK_EQUAL(engine.Stats().reused, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(EvaluatorTest) {
+    boost::shared_ptr<countingevaluator> evaluator = boost::make_shared<countingevaluator>();
+    MctsOptions options;
+    options.threads = 1;
+    options.playouts = 50;
+    MctsEngine engine(options, evaluator);
+    boost::shared_ptr<IMachine> machine = Play("1.e4");
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 1));
+    BOOST_REQUIRE(info.wait(&engine, 60000));
+    BOOST_CHECK_EQUAL(evaluator->calls, 50);
+    BOOST_CHECK_SMALL(info.bestscore, 0.001f);
+
+    // The arena full of nodes stops the growth of the tree, not the search.
+    MctsOptions small = options;
+    small.nodes = 30;
+    MctsEngine full(small, evaluator);
+    infotest filled;
+    BOOST_REQUIRE(full.Start(*machine, 1));
+    BOOST_REQUIRE(filled.wait(&full, 60000));
+    BOOST_CHECK_EQUAL(full.Stats().playouts, 50u);
+    BOOST_CHECK_LE(full.Stats().nodes, 30u);
+    BOOST_CHECK_EQUAL(filled.hashfull, 1000);
+
+    // A won position is not a mate: the value of the evaluator saturated at 1 is reported as a finite score.
+    evaluator->value = 1.0f;
+    const float inf = std::numeric_limits<float>::infinity();
+    BOOST_CHECK(engine.EvalPosition(*machine) < inf);
+    infotest decided;
+    BOOST_REQUIRE(engine.Start(*machine, 1));
+    BOOST_REQUIRE(decided.wait(&engine, 60000));
+    BOOST_CHECK(decided.bestscore > -inf && decided.bestscore < inf);
+}
+
+BOOST_AUTO_TEST_CASE(EvalBrokerTest) {
+    boost::shared_ptr<batchingevaluator> evaluator = boost::make_shared<batchingevaluator>();
+    boost::shared_ptr<IMachine> machine = Play("1.e4");
+    {
+        // The full batches go at once, the rest waits for Flush.
+        EvalBroker broker(evaluator, 8, std::chrono::seconds(100));
+        std::vector<int> done;
+        for (int i = 0; i < 20; ++i) {
+            EvalRequest request;
+            request.position = machine->SlightClone();
+            request.moves.resize(2);
+            broker.Submit(std::move(request), [&done, i](const EvalRequest& evaluated) {
+                BOOST_CHECK_EQUAL(evaluated.priors.size(), 2u);
+                done.push_back(i);
+            });
+        }
+        broker.Flush();
+        BOOST_CHECK_EQUAL(done.size(), 20u);
+        BOOST_CHECK(std::is_sorted(done.begin(), done.end()));
+        BOOST_CHECK(evaluator->batches == std::vector<size_t>({8, 8, 4}));
+        const BatchHistograms histograms = broker.TakeHistograms();
+        BOOST_CHECK_EQUAL(histograms.requests, 20u);
+        BOOST_CHECK_EQUAL(histograms.batches, 3u);
+        BOOST_CHECK_EQUAL(histograms.sizes[8], 2u);
+        BOOST_CHECK_EQUAL(histograms.sizes[4], 1u);
+        BOOST_CHECK_EQUAL(std::accumulate(histograms.waits.begin(), histograms.waits.end(), size_t(0)), 20u);
+        BOOST_CHECK_EQUAL(broker.TakeHistograms().requests, 0u);
+    }
+
+    // The playout threads keep on selecting other leaves while theirs wait for the batch.
+    evaluator->batches.clear();
+    evaluator->calls = 0;
+    MctsOptions options;
+    options.threads = 2;
+    options.playouts = 200;
+    options.batchsize = 8;
+    MctsEngine engine(options, evaluator);
+    infotest info;
+    BOOST_REQUIRE(engine.Start(*machine, 1));
+    BOOST_REQUIRE(info.wait(&engine, 60000));
+    BOOST_CHECK(machine->SlightClone()->Move(info.bestmove));
+    const MctsStats stats = engine.Stats();
+    BOOST_CHECK_GE(stats.playouts, options.playouts);
+    BOOST_CHECK_LT(stats.playouts, options.playouts + options.threads);
+    BOOST_CHECK_EQUAL(stats.batches.requests, static_cast<size_t>(evaluator->calls));
+    BOOST_CHECK_EQUAL(stats.batches.batches, evaluator->batches.size());
+    BOOST_CHECK_GT(*std::max_element(evaluator->batches.begin(), evaluator->batches.end()), 1u);
+    BOOST_CHECK_LE(*std::max_element(evaluator->batches.begin(), evaluator->batches.end()), 8u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
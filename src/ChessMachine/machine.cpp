@@ -113,6 +113,14 @@ bool ChessMachine::Move(const std::string& notation) {
     return false;
 }
 
+bool ChessMachine::NullMove() {
+    if (CheckStatus() == Status::normal) {
+        states.push_back(states.back().MakeNullMove());
+        return true;
+    }
+    return false;
+}
+
 void ChessMachine::Undo() {
     if (!states.empty()) {
         states.pop_back();
@@ -237,6 +245,28 @@ std::string ChessMachine::LastMoveNotation() const {
     return lastmove;
 }
 
+int ChessMachine::SEE(Position from, Position to, Type promotion) const {
+    if (!states.empty()) {
+        const ChessState& laststate = states.back();
+        const auto& piece = laststate.pieces[from];
+        if (piece.valid()) {
+            return laststate.staticExchange({piece.type, from, to, promotion});
+        }
+    }
+    return 0;
+}
+
+bool ChessMachine::SEEAtLeast(Position from, Position to, int threshold, Type promotion) const {
+    if (!states.empty()) {
+        const ChessState& laststate = states.back();
+        const auto& piece = laststate.pieces[from];
+        if (piece.valid()) {
+            return laststate.staticExchangeAtLeast({piece.type, from, to, promotion}, threshold);
+        }
+    }
+    return threshold <= 0;
+}
+
 boost::shared_ptr<IMachine> ChessMachine::SlightClone() const {
     return boost::shared_ptr<IMachine>(new ChessMachine(*this));
 }
@@ -13,6 +13,7 @@ class ChessMachine : public IMachine {
     void Start() override;
     bool Move(Type type, Position from, Position to, Type promotion) override;
     bool Move(const std::string& notation) override;
+    bool NullMove() override;
     void Undo() override;
 
     Set CurrentPlayer() const override {
@@ -22,6 +23,11 @@ class ChessMachine : public IMachine {
     PieceMoves EnumMoves(Position from) const override;
     Status CheckStatus() const override;
     std::string LastMoveNotation() const override;
+    uint64_t PositionKey() const override {
+        return states.empty() ? 0 : states.back().hash;
+    }
+    int SEE(Position from, Position to, Type promotion) const override;
+    bool SEEAtLeast(Position from, Position to, int threshold, Type promotion) const override;
 
     boost::shared_ptr<IMachine> SlightClone() const override;
 
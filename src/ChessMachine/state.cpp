@@ -6,6 +6,110 @@ namespace Chess {
 
 CHESSBOARD;
 
+namespace {
+
+// Random keys of the Zobrist hash, the same in every run.
+struct ZobristKeys {
+    ZobristKeys() {
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+        auto next = [&seed]() { // SplitMix64
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        };
+        for (auto& key : pieces) {
+            key = next();
+        }
+        black = next();
+        for (auto& key : castling) {
+            key = next();
+        }
+        for (auto& key : enpassant) {
+            key = next();
+        }
+    }
+
+    std::array<uint64_t, 12 * 64> pieces; // [set and type][square]
+    uint64_t black;
+    std::array<uint64_t, 4> castling;  // white short and long, black short and long
+    std::array<uint64_t, 8> enpassant; // file of the pawn which can be taken
+};
+
+const ZobristKeys& Zobrist() {
+    static const ZobristKeys keys;
+    return keys;
+}
+
+int PieceKey(Set set, Type type) {
+    int index = 0;
+    switch (type) {
+        case Type::pawn: index = 0; break;
+        case Type::knight: index = 1; break;
+        case Type::bishop: index = 2; break;
+        case Type::rook: index = 3; break;
+        case Type::queen: index = 4; break;
+        default: index = 5; break;
+    }
+    return set == Set::white ? index : index + 6;
+}
+
+int ExchangeValue(Type type) {
+    switch (type) {
+        case Type::pawn: return 100;
+        case Type::knight: return 300;
+        case Type::bishop: return 300;
+        case Type::rook: return 500;
+        case Type::queen: return 900;
+        case Type::king: return 20000;
+        default: return 0;
+    }
+}
+
+uint64_t SquareBit(const Position& pos) {
+    return 1ull << pos.pos();
+}
+
+// Whether the piece attacks the target square, the sliding pieces are stopped by any piece of the occupancy.
+bool AttacksSquare(Type type, Set set, const Position& from, const Position& target, uint64_t occupied) {
+    const int dx = target.x() - from.x();
+    const int dy = target.y() - from.y();
+    switch (type) {
+        case Type::pawn: return abs(dx) == 1 && dy == (set == Set::white ? 1 : -1);
+        case Type::knight: return abs(dx * dy) == 2;
+        case Type::king: return std::max(abs(dx), abs(dy)) == 1;
+        case Type::bishop:
+            if (abs(dx) != abs(dy)) {
+                return false;
+            }
+            break;
+        case Type::rook:
+            if (dx != 0 && dy != 0) {
+                return false;
+            }
+            break;
+        case Type::queen:
+            if (abs(dx) != abs(dy) && dx != 0 && dy != 0) {
+                return false;
+            }
+            break;
+        default: return false;
+    }
+    if (dx == 0 && dy == 0) {
+        return false;
+    }
+    const int sx = (dx > 0) - (dx < 0);
+    const int sy = (dy > 0) - (dy < 0);
+    for (int x = from.x() + sx, y = from.y() + sy; x != target.x() || y != target.y(); x += sx, y += sy) {
+        if (occupied & (1ull << ((x << 3) + y))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 Board::Board(std::initializer_list<std::pair<Position, PieceState>> il) {
     for (const auto& p : il) {
         pieces[p.first.pos()] = p;
@@ -91,11 +195,22 @@ ChessState::ChessState()
               BROOK(a8), BKNIGHT(b8), BBISHOP(c8), BQUEEN(d8), BKING(e8), BBISHOP(f8), BKNIGHT(g8), BROOK(h8)}),
       activeSet(Set::white) {
     evalMoves({});
+    evalHash();
 }
 
 ChessState::ChessState(Set set, const StateMove& move, const Board& pieces)
     : pieces(pieces), lastMove(move), activeSet(set) {
     evalMoves(lastMove);
+    evalHash();
+}
+
+ChessState::ChessState(Set set, const Board& pieces) : pieces(pieces), activeSet(set) {
+    evalMoves({});
+    evalHash();
+}
+
+ChessState ChessState::MakeNullMove() const {
+    return {activeSet == Set::white ? Set::black : Set::white, pieces};
 }
 
 ChessState ChessState::MakeMove(const StateMove& move) const {
@@ -171,6 +286,127 @@ void ChessState::evalMoves(boost::optional<StateMove> xmove) {
     }
 }
 
+void ChessState::evalHash() {
+    const ZobristKeys& keys = Zobrist();
+    hash = activeSet == Set::black ? keys.black : 0;
+    for (const auto& piece : pieces) {
+        hash ^= keys.pieces[PieceKey(piece.second.set, piece.second.type) * 64 + piece.first.pos()];
+    }
+    // Castling rights are kept while neither the king nor the rook has moved.
+    int index = 0;
+    for (char rank : {'1', '8'}) {
+        const PieceState& king = pieces[{'e', rank}];
+        for (char file : {'h', 'a'}) {
+            const PieceState& rook = pieces[{file, rank}];
+            if (king.type == Type::king && !king.moved && rook.type == Type::rook && !rook.moved &&
+                rook.set == king.set) {
+                hash ^= keys.castling[index];
+            }
+            ++index;
+        }
+    }
+    // En passant counts only if some pawn can take the pawn just moved by two squares.
+    if (lastMove && lastMove->type == Type::pawn && abs(lastMove->from.rank() - lastMove->to.rank()) == 2) {
+        const Position passed = {lastMove->to.file(), static_cast<char>((lastMove->from.rank() + lastMove->to.rank()) / 2)};
+        for (const auto& piece : pieces) {
+            if (piece.second.set == activeSet && piece.second.type == Type::pawn && piece.second.isMove(passed)) {
+                hash ^= keys.enpassant[passed.x()];
+                break;
+            }
+        }
+    }
+}
+
+int ChessState::staticExchange(const StateMove& move) const {
+    // The swap list: gain[d] is the balance of the side making the capture d if the exchange stops right after it.
+    std::array<int, 33> gain;
+    uint64_t occupied = occupancy();
+    gain[0] = exchangeStart(move, occupied);
+    Type onsquare = move.promotion != Type::bad ? move.promotion : move.type;
+    Position from = move.from;
+    Set set = pieces[move.from].set;
+    int depth = 0;
+    do {
+        ++depth;
+        gain[depth] = ExchangeValue(onsquare) - gain[depth - 1];
+        occupied &= ~SquareBit(from);
+        set = set == Set::white ? Set::black : Set::white;
+        onsquare = leastAttacker(move.to, set, occupied, from);
+    } while (onsquare != Type::bad && depth < 32);
+    while (--depth > 0) {
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    }
+    return gain[0];
+}
+
+bool ChessState::staticExchangeAtLeast(const StateMove& move, int threshold) const {
+    uint64_t occupied = occupancy();
+    int swap = exchangeStart(move, occupied) - threshold;
+    if (swap < 0) {
+        return false; // Even the first capture left unanswered is not enough.
+    }
+    swap = ExchangeValue(move.promotion != Type::bad ? move.promotion : move.type) - swap;
+    if (swap <= 0) {
+        return true; // Losing the moved piece still keeps the threshold.
+    }
+    occupied &= ~SquareBit(move.from);
+    Set set = pieces[move.from].set;
+    bool result = true;
+    Position from;
+    for (;;) {
+        set = set == Set::white ? Set::black : Set::white;
+        const Type attacker = leastAttacker(move.to, set, occupied, from);
+        if (attacker == Type::bad) {
+            break;
+        }
+        result = !result;
+        occupied &= ~SquareBit(from);
+        if (attacker == Type::king) {
+            // The king captures only if the square is not defended any more.
+            const Set xset = set == Set::white ? Set::black : Set::white;
+            return leastAttacker(move.to, xset, occupied, from) != Type::bad ? !result : result;
+        }
+        swap = ExchangeValue(attacker) - swap;
+        if (swap < (result ? 1 : 0)) {
+            break;
+        }
+    }
+    return result;
+}
+
+uint64_t ChessState::occupancy() const {
+    uint64_t occupied = 0;
+    for (const auto& piece : pieces) {
+        occupied |= SquareBit(piece.first);
+    }
+    return occupied;
+}
+
+// The value taken by the move itself, the pawn taken en passant leaves the occupancy.
+int ChessState::exchangeStart(const StateMove& move, uint64_t& occupied) const {
+    int value = move.promotion != Type::bad ? ExchangeValue(move.promotion) - ExchangeValue(Type::pawn) : 0;
+    if (pieces.test(move.to)) {
+        value += ExchangeValue(pieces[move.to].type);
+    } else if (move.type == Type::pawn && move.from.file() != move.to.file()) {
+        occupied &= ~SquareBit({move.to.file(), move.from.rank()});
+        value += ExchangeValue(Type::pawn);
+    }
+    return value;
+}
+
+Type ChessState::leastAttacker(const Position& target, Set set, uint64_t occupied, Position& from) const {
+    Type least = Type::bad;
+    for (const auto& piece : pieces) {
+        if (piece.second.set == set && (occupied & SquareBit(piece.first)) &&
+            (least == Type::bad || ExchangeValue(piece.second.type) < ExchangeValue(least)) &&
+            AttacksSquare(piece.second.type, set, piece.first, target, occupied)) {
+            least = piece.second.type;
+            from = piece.first;
+        }
+    }
+    return least;
+}
+
 PieceMoves ChessState::pieceMoves(const Board& pieces, const Position& pos, boost::optional<StateMove> xmove,
                                   const SetMoves& xmoves) {
     static const std::vector<MoveVector> Lshape_moves = {{-1, +2}, {+1, +2}, {-1, -2}, {+1, -2},
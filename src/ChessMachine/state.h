@@ -163,15 +163,28 @@ class ChessState {
     ChessState();
 
     ChessState MakeMove(const StateMove& move) const;
+    ChessState MakeNullMove() const;
+
+    // Static exchange evaluation: the material won by the move in centipawns when both sides go on capturing on the
+    // target square with the least valuable attacker and may stop at any time. X-ray attackers join the exchange as the
+    // pieces in front of them leave, pins are not taken into account.
+    int staticExchange(const StateMove& move) const;
+    bool staticExchangeAtLeast(const StateMove& move, int threshold) const; // Stops as soon as the answer is known.
 
     Board pieces;
     boost::optional<StateMove> lastMove;
     Set activeSet;
+    uint64_t hash;
 
  private:
     ChessState(Set set, const StateMove& move, const Board& pieces);
+    ChessState(Set set, const Board& pieces);
 
     void evalMoves(boost::optional<StateMove> xmove);
+    void evalHash();
+    uint64_t occupancy() const;
+    int exchangeStart(const StateMove& move, uint64_t& occupied) const;
+    Type leastAttacker(const Position& target, Set set, uint64_t occupied, Position& from) const;
     static PieceMoves pieceMoves(const Board& pieces, const Position& pos, boost::optional<StateMove> xmove,
                                  const SetMoves& xmoves = SetMoves());
     static bool addMoveIf(const Board& pieces, PieceMoves& moves, const Position& pos, Set set = Set::unknown,
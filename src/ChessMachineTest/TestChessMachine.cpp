@@ -7,6 +7,8 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <random>
+
 using namespace Chai::Chess;
 
 CHESSBOARD;
@@ -731,4 +733,130 @@ Kc7 57.Ke4 Kc6 58.Ke5 Kc7 59.Qd6+ Kb7 60.Kd5 Kc8 61.Kc6 *");
     }
 }
 
+BOOST_AUTO_TEST_CASE(NullMoveTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_REQUIRE_MESSAGE(machine, "Can't create ChessMachine!");
+    BOOST_CHECK(!machine->NullMove());
+
+    machine->Start();
+    BOOST_REQUIRE(machine->NullMove());
+    BOOST_CHECK(machine->CurrentPlayer() == Set::black);
+    BOOST_CHECK(machine->CheckStatus() == Status::normal);
+    BOOST_CHECK(machine->LastMoveNotation().empty());
+    BOOST_CHECK(equal(machine->EnumMoves(e7), {e6, e5}));
+    machine->Undo();
+    BOOST_CHECK(machine->CurrentPlayer() == Set::white);
+
+    for (auto m : split("1.e4 a6 2.e5 d5")) {
+        BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+    }
+    BOOST_CHECK(equal(machine->EnumMoves(e5), {e6, d6}));
+    BOOST_REQUIRE(machine->NullMove());
+    BOOST_REQUIRE(machine->NullMove());
+    BOOST_CHECK_MESSAGE(equal(machine->EnumMoves(e5), {e6}), "En passant is not possible after the null move");
+    machine->Undo();
+    machine->Undo();
+    BOOST_CHECK(equal(machine->EnumMoves(e5), {e6, d6}));
+
+    BOOST_REQUIRE(machine->Move("Qh5"));
+    BOOST_REQUIRE(machine->Move("a5"));
+    BOOST_REQUIRE(machine->Move("Qxf7"));
+    BOOST_REQUIRE(machine->CheckStatus() == Status::check);
+    BOOST_CHECK_MESSAGE(!machine->NullMove(), "The null move is impossible in check");
+    BOOST_CHECK(machine->CurrentPlayer() == Set::black);
+}
+
+BOOST_AUTO_TEST_CASE(PositionKeyTest) {
+    auto play = [](const std::string& moves) {
+        boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+        machine->Start();
+        for (auto m : split(moves)) {
+            BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+        }
+        return machine;
+    };
+    const auto start = play("");
+    BOOST_CHECK(start->PositionKey() != 0);
+    BOOST_CHECK(boost::make_shared<ChessMachine>()->PositionKey() == 0);
+
+    // Transpositions give the same key.
+    BOOST_CHECK(play("1.Nf3 Nf6 2.Nc3 Nc6")->PositionKey() == play("1.Nc3 Nc6 2.Nf3 Nf6")->PositionKey());
+    BOOST_CHECK(play("1.Nf3 Nf6 2.Ng1 Ng8")->PositionKey() == start->PositionKey());
+
+    // The same pieces with another player to move or other rights are different positions.
+    BOOST_CHECK(play("1.Nf3")->PositionKey() != play("1.Nf3 Nf6 2.Ng1")->PositionKey());
+    BOOST_CHECK(play("1.e4 e5 2.Ke2 Ke7 3.Ke1 Ke8")->PositionKey() != play("1.e4 e5")->PositionKey());
+    BOOST_CHECK(play("1.e4 e5 2.Nf3 Nf6 3.Rg1 Rg8 4.Rh1 Rh8")->PositionKey() != play("1.e4 e5 2.Nf3 Nf6")->PositionKey());
+    BOOST_CHECK(play("1.e4 a6 2.e5 d5")->PositionKey() != play("1.e4 a6 2.e5 d5 3.Nf3 Nf6 4.Ng1 Ng8")->PositionKey());
+    // En passant is not a right if there is no pawn to take.
+    BOOST_CHECK(play("1.e4 a6 2.e5 h5")->PositionKey() == play("1.e4 a6 2.e5 h5 3.Nf3 Nf6 4.Ng1 Ng8")->PositionKey());
+
+    boost::shared_ptr<IMachine> machine = play("1.e4");
+    const uint64_t key = machine->PositionKey();
+    BOOST_REQUIRE(machine->NullMove());
+    BOOST_CHECK(machine->PositionKey() != key);
+    machine->Undo();
+    BOOST_CHECK(machine->PositionKey() == key);
+}
+
+BOOST_AUTO_TEST_CASE(StaticExchangeTest) {
+    auto play = [](const std::string& moves) {
+        boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+        machine->Start();
+        for (auto m : split(moves)) {
+            BOOST_REQUIRE_MESSAGE(machine->Move(m.c_str()), "Can't make move " + m);
+        }
+        return machine;
+    };
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    BOOST_CHECK(machine->SEE(e2, e4) == 0);
+
+    machine = play("1.e4 d5");
+    BOOST_CHECK_EQUAL(machine->SEE(e4, d5), 0); // Qxd5 takes the pawn back
+    BOOST_CHECK_EQUAL(machine->SEE(g1, f3), 0);
+
+    machine = play("1.e4 e5 2.Qh5 Nc6");
+    BOOST_CHECK_EQUAL(machine->SEE(h5, f7), 100 - 900);
+    BOOST_CHECK_EQUAL(machine->SEE(h5, e5), 100 - 900);
+    BOOST_CHECK_EQUAL(machine->SEE(h5, g6), -900);
+    BOOST_CHECK(machine->SEEAtLeast(h5, h7, -800));
+    BOOST_CHECK(!machine->SEEAtLeast(h5, h7, -799));
+
+    // The queen behind the bishop takes part in the exchange.
+    machine = play("1.d4 d5 2.c4 Nf6 3.e3 e6 4.Bd3 Ne4 5.Qc2 Nd7");
+    BOOST_CHECK_EQUAL(machine->SEE(d3, e4), 300 - 300 + 100);
+    BOOST_CHECK(machine->SEEAtLeast(d3, e4, 100));
+    BOOST_CHECK(!machine->SEEAtLeast(d3, e4, 101));
+    BOOST_CHECK_EQUAL(machine->SEE(c4, d5), 0);
+
+    // The threshold query agrees with the full evaluation in random games.
+    std::mt19937 random(37);
+    for (int game = 0; game < 4; ++game) {
+        machine->Start();
+        for (int ply = 0; ply < 100; ++ply) {
+            std::vector<std::pair<Piece, Position>> moves;
+            for (const auto& piece : machine->GetSet(machine->CurrentPlayer())) {
+                for (const auto& to : machine->EnumMoves(piece.position)) {
+                    moves.emplace_back(piece, to);
+                }
+            }
+            if (moves.empty()) {
+                break;
+            }
+            for (const auto& move : moves) {
+                const bool promotion = move.first.type == Type::pawn && (move.second.rank() == '1' || move.second.rank() == '8');
+                const Type type = promotion ? Type::queen : Type::bad;
+                const int see = machine->SEE(move.first.position, move.second, type);
+                for (int threshold : {-900, -200, -100, 0, 1, 100, 200, 800}) {
+                    BOOST_CHECK_EQUAL(machine->SEEAtLeast(move.first.position, move.second, threshold, type), see >= threshold);
+                }
+            }
+            const auto& move = moves[random() % moves.size()];
+            const bool promotion = move.first.type == Type::pawn && (move.second.rank() == '1' || move.second.rank() == '8');
+            BOOST_REQUIRE(machine->Move(move.first.type, move.first.position, move.second,
+                                        promotion ? Type::queen : Type::bad));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
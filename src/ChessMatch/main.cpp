@@ -0,0 +1,181 @@
+#include "match.h"
+
+#include <ChessEngineGreedy/engine.h>
+#include <ChessEngineMcts/engine.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+using namespace Chai::Chess;
+
+namespace {
+
+void Usage() {
+  std::cerr << "Usage: ChessMatchRunner <engine> <engine> [--games N] [--concurrency N] [--openings FILE] [--pgn FILE]\n"
+               "                        [--depth N] [--movetime MS] [--gametime MS] [--inc MS] [--nodes N]\n"
+               "                        [--maxplies N] [--sprt ELO0 ELO1] [--alpha X] [--beta X]\n"
+               "An engine is greedy or mcts followed by comma separated settings: name=, depth=, movetime=, gametime=,\n"
+               "inc=, nodes=, threads= and evalparams=, network=, book=, bitbases= of greedy or cpuct= of mcts.\n"
+               "The games played at once share the cores: unless threads= is given, an engine takes the cores divided\n"
+               "by the concurrency, a single thread when every core plays a game.\n";
+}
+
+// The limits and the threads of the command line apply to both engines unless their settings change them.
+bool ParseEngine(const std::string& spec, const TimeControl& limits, int threads, MatchEngine& engine) {
+  std::istringstream stream(spec);
+  std::string type, item;
+  std::getline(stream, type, ',');
+  if (type != "greedy" && type != "mcts") {
+    return false;
+  }
+  engine.name = type;
+  engine.limits = limits;
+  SearchOptions greedy;
+  MctsOptions mcts;
+  greedy.threads = threads;
+  mcts.threads = threads;
+  while (std::getline(stream, item, ',')) {
+    const size_t equal = item.find('=');
+    if (equal == std::string::npos) {
+      return false;
+    }
+    const std::string key = item.substr(0, equal);
+    const std::string value = item.substr(equal + 1);
+    if (key == "name") {
+      engine.name = value;
+    } else if (key == "depth") {
+      engine.limits.depth = std::atoi(value.c_str());
+    } else if (key == "movetime") {
+      engine.limits.movetime = std::atoi(value.c_str());
+    } else if (key == "gametime") {
+      engine.limits.gametime = std::atoi(value.c_str());
+    } else if (key == "inc") {
+      engine.limits.increment = std::atoi(value.c_str());
+    } else if (key == "nodes") {
+      engine.limits.nodes = static_cast<size_t>(std::atol(value.c_str()));
+    } else if (key == "threads") {
+      greedy.threads = std::atoi(value.c_str());
+      mcts.threads = greedy.threads;
+    } else if (type == "greedy" && key == "evalparams") {
+      greedy.evalparams = value;
+    } else if (type == "greedy" && key == "network") {
+      greedy.network = value;
+    } else if (type == "greedy" && key == "book") {
+      greedy.book = value;
+    } else if (type == "greedy" && key == "bitbases") {
+      greedy.bitbases = value;
+    } else if (type == "mcts" && key == "cpuct") {
+      mcts.cpuct = static_cast<float>(std::atof(value.c_str()));
+    } else {
+      return false;
+    }
+  }
+  if (engine.limits.nodes > 0) {
+    // The node limit is checked at the progress reports.
+    greedy.reportnodes = std::max<size_t>(1000, engine.limits.nodes / 20);
+  }
+  if (type == "greedy") {
+    engine.create = [greedy]() { return boost::shared_ptr<IEngine>(boost::make_shared<GreedyEngine>(greedy)); };
+  } else {
+    engine.create = [mcts]() { return boost::shared_ptr<IEngine>(boost::make_shared<MctsEngine>(mcts)); };
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    Usage();
+    return 1;
+  }
+  MatchOptions options;
+  TimeControl limits;
+  std::string openings;
+  for (int i = 3; i < argc; i += 2) {
+    const char* arg = argv[i];
+    if (i + 1 == argc) {
+      Usage();
+      return 1;
+    }
+    const char* value = argv[i + 1];
+    if (std::strcmp(arg, "--games") == 0) {
+      options.games = std::atoi(value);
+    } else if (std::strcmp(arg, "--concurrency") == 0) {
+      options.concurrency = std::atoi(value);
+    } else if (std::strcmp(arg, "--openings") == 0) {
+      openings = value;
+    } else if (std::strcmp(arg, "--pgn") == 0) {
+      options.pgn = value;
+    } else if (std::strcmp(arg, "--depth") == 0) {
+      limits.depth = std::atoi(value);
+    } else if (std::strcmp(arg, "--movetime") == 0) {
+      limits.movetime = std::atoi(value);
+    } else if (std::strcmp(arg, "--gametime") == 0) {
+      limits.gametime = std::atoi(value);
+    } else if (std::strcmp(arg, "--inc") == 0) {
+      limits.increment = std::atoi(value);
+    } else if (std::strcmp(arg, "--nodes") == 0) {
+      limits.nodes = static_cast<size_t>(std::atol(value));
+    } else if (std::strcmp(arg, "--maxplies") == 0) {
+      options.maxplies = std::atoi(value);
+    } else if (std::strcmp(arg, "--sprt") == 0 && i + 2 < argc) {
+      options.sprt = true;
+      options.elo0 = std::atof(value);
+      options.elo1 = std::atof(argv[i + 2]);
+      ++i;
+    } else if (std::strcmp(arg, "--alpha") == 0) {
+      options.alpha = std::atof(value);
+    } else if (std::strcmp(arg, "--beta") == 0) {
+      options.beta = std::atof(value);
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (limits.depth == 0 && limits.movetime == 0 && limits.gametime == 0 && limits.nodes == 0) {
+    limits.movetime = 100;
+  }
+  // Only one engine of a game thinks at a time, so the games at once split the cores between them.
+  const int cores = std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+  const int threads = std::max(1, cores / (options.concurrency > 0 ? options.concurrency : cores));
+  MatchEngine first, second;
+  if (!ParseEngine(argv[1], limits, threads, first) || !ParseEngine(argv[2], limits, threads, second)) {
+    Usage();
+    return 1;
+  }
+  if (first.name == second.name) {
+    first.name += " 1";
+    second.name += " 2";
+  }
+  if (!openings.empty()) {
+    options.openings = ReadOpenings(openings);
+    if (options.openings.empty()) {
+      std::cerr << "No openings in " << openings << "\n";
+      return 1;
+    }
+  }
+
+  MatchRunner runner(options, first, second);
+  const MatchResult result = runner.Run([&](const GameRecord& game, const MatchResult& r) {
+    std::cout << "game " << game.round << " " << game.white << " - " << game.black << " "
+              << (game.result > 0 ? "1-0" : game.result < 0 ? "0-1" : "1/2-1/2") << " (" << game.termination << ")  "
+              << "+" << r.wins << " =" << r.draws << " -" << r.losses << "  elo " << r.elo << " +/- " << r.elomargin;
+    if (options.sprt) {
+      std::cout << "  llr " << r.llr << " [" << r.lower << ", " << r.upper << "]";
+    }
+    std::cout << std::endl;
+  });
+  std::cout << first.name << " vs " << second.name << ": +" << result.wins << " =" << result.draws << " -"
+            << result.losses << ", elo " << result.elo << " +/- " << result.elomargin << "\n";
+  if (options.sprt) {
+    std::cout << "SPRT: " << (result.decision == SprtDecision::h1 ? "H1 accepted"
+                              : result.decision == SprtDecision::h0 ? "H0 accepted" : "not decided") << "\n";
+  }
+  return 0;
+}
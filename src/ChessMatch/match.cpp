@@ -0,0 +1,374 @@
+#include "match.h"
+
+#include <ChessMachine/machine.h>
+
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const int SearchDepth = 64; // of the searches limited by the time or the nodes only
+const int PollMilliseconds = 5;
+
+// Collects the messages of the search of one move.
+class MoveListener : public InfoCallAdapter {
+ public:
+    size_t nodes = 0;
+    bool readyok = false;
+    std::string bestmove;
+    float bestscore = 0;
+
+ private:
+    void NodesSearched(size_t n) override {
+        nodes = n;
+    }
+    void ReadyOk() override {
+        readyok = true;
+    }
+    void BestMove(std::string notation) override {
+        bestmove = notation;
+    }
+    void BestScore(float score) override {
+        bestscore = score;
+    }
+};
+
+double ExpectedScore(double elo) {
+  return 1 / (1 + std::pow(10.0, -elo / 400));
+}
+
+double Elo(double score) {
+  return -400 * std::log10(1 / score - 1);
+}
+
+// Mean and variance of the score of one game.
+bool ScoreStats(int wins, int draws, int losses, double& score, double& variance) {
+  const double games = wins + draws + losses;
+  if (games == 0) {
+    return false;
+  }
+  score = (wins + 0.5 * draws) / games;
+  variance = (wins * (1 - score) * (1 - score) + draws * (0.5 - score) * (0.5 - score) + losses * score * score) / games;
+  return variance > 0;
+}
+
+// Kings alone or with a single knight or bishop.
+bool InsufficientMaterial(const Pieces& white, const Pieces& black) {
+  if (white.size() + black.size() > 3) {
+    return false;
+  }
+  for (const auto& pieces : { white, black }) {
+    for (const auto& piece : pieces) {
+      if (piece.type != Type::king && piece.type != Type::knight && piece.type != Type::bishop) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+const char* ResultText(int result) {
+  return result > 0 ? "1-0" : result < 0 ? "0-1" : "1/2-1/2";
+}
+
+}
+
+double SprtLlr(int wins, int draws, int losses, double elo0, double elo1) {
+  // While all the games ended the same, a draw more gives the variance, so that a run of wins decides the test too.
+  double score, variance;
+  if (!ScoreStats(wins, draws, losses, score, variance) && !ScoreStats(wins, draws + 1, losses, score, variance)) {
+    return 0;
+  }
+  const double s0 = ExpectedScore(elo0);
+  const double s1 = ExpectedScore(elo1);
+  return (wins + draws + losses) * (s1 - s0) * (2 * score - s0 - s1) / (2 * variance);
+}
+
+void EloEstimate(int wins, int draws, int losses, double& elo, double& margin) {
+  double score, variance;
+  if (!ScoreStats(wins, draws, losses, score, variance)) {
+    elo = wins > losses ? std::numeric_limits<double>::infinity() : wins < losses ? -std::numeric_limits<double>::infinity() : 0;
+    margin = std::numeric_limits<double>::infinity();
+    return;
+  }
+  const double deviation = 1.96 * std::sqrt(variance / (wins + draws + losses));
+  elo = Elo(score);
+  const double low = std::max(1e-9, score - deviation);
+  const double high = std::min(1 - 1e-9, score + deviation);
+  margin = (Elo(high) - Elo(low)) / 2;
+}
+
+std::vector<std::string> ParseMoves(const std::string& line) {
+  std::vector<std::string> moves;
+  std::istringstream stream(line);
+  std::string token;
+  while (stream >> token) {
+    // "1.e4", "1...e5" and "1." alike, the move number goes.
+    const size_t dots = token.find_last_of('.');
+    if (dots != std::string::npos) {
+      token = token.substr(dots + 1);
+    }
+    if (token.empty() || token == "*" || token == "1-0" || token == "0-1" || token == "1/2-1/2") {
+      continue;
+    }
+    while (!token.empty() && (token.back() == '+' || token.back() == '#' || token.back() == '!' || token.back() == '?')) {
+      token.pop_back();
+    }
+    moves.push_back(token);
+  }
+  return moves;
+}
+
+std::vector<std::vector<std::string>> ReadOpenings(const std::string& filename) {
+  std::vector<std::vector<std::string>> openings;
+  std::ifstream file(filename);
+  std::string line;
+  while (std::getline(file, line)) {
+    const size_t comment = line.find('#');
+    std::vector<std::string> moves = ParseMoves(line.substr(0, comment));
+    if (!moves.empty()) {
+      openings.push_back(moves);
+    }
+  }
+  return openings;
+}
+
+std::string ToPgn(const GameRecord& game, const std::string& event) {
+  std::ostringstream pgn;
+  std::string date = boost::gregorian::to_iso_extended_string(boost::gregorian::day_clock::local_day());
+  std::replace(date.begin(), date.end(), '-', '.');
+  pgn << "[Event \"" << event << "\"]\n"
+      << "[Site \"?\"]\n"
+      << "[Date \"" << date << "\"]\n"
+      << "[Round \"" << game.round << "\"]\n"
+      << "[White \"" << game.white << "\"]\n"
+      << "[Black \"" << game.black << "\"]\n"
+      << "[Result \"" << ResultText(game.result) << "\"]\n"
+      << "[PlyCount \"" << game.moves.size() << "\"]\n"
+      << "[Termination \"" << game.termination << "\"]\n\n";
+  size_t column = 0;
+  auto write = [&](const std::string& text) {
+    if (column > 0 && column + 1 + text.size() > 79) {
+      pgn << "\n";
+      column = 0;
+    } else if (column > 0) {
+      pgn << " ";
+      ++column;
+    }
+    pgn << text;
+    column += text.size();
+  };
+  for (size_t ply = 0; ply < game.moves.size(); ++ply) {
+    write(ply % 2 == 0 ? std::to_string(ply / 2 + 1) + ". " + game.moves[ply] : game.moves[ply]);
+  }
+  write(ResultText(game.result));
+  pgn << "\n\n";
+  return pgn.str();
+}
+
+MatchRunner::MatchRunner(const MatchOptions& opts, const MatchEngine& one, const MatchEngine& two)
+  : options(opts), first(one), second(two), next(0), total(0), decided(false) {}
+
+MatchResult MatchRunner::Run(const Progress& report) {
+  const int openings = std::max<int>(1, static_cast<int>(options.openings.size()));
+  total = options.games > 0 ? options.games : 2 * openings;
+  next = 0;
+  decided = false;
+  result = MatchResult();
+  result.lower = std::log(options.beta / (1 - options.alpha));
+  result.upper = std::log((1 - options.beta) / options.alpha);
+  progress = report;
+  if (!options.pgn.empty()) {
+    pgn.open(options.pgn, std::ios::app);
+  }
+  const int concurrency = std::min(total, options.concurrency > 0 ? options.concurrency
+                                                                  : std::max(1, static_cast<int>(boost::thread::hardware_concurrency())));
+  boost::thread_group workers;
+  for (int i = 0; i < concurrency; ++i) {
+    workers.create_thread(boost::bind(&MatchRunner::WorkerFun, this));
+  }
+  workers.join_all();
+  if (pgn.is_open()) {
+    pgn.close();
+  }
+  return result;
+}
+
+void MatchRunner::WorkerFun() {
+  static const std::vector<std::string> start;
+  for (;;) {
+    int game;
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      if (decided || next >= total) {
+        return;
+      }
+      game = next++;
+    }
+    // Both colors of an opening follow each other, so a stopped match is still balanced.
+    const auto& opening = options.openings.empty() ? start : options.openings[(game / 2) % options.openings.size()];
+    const bool firstwhite = game % 2 == 0;
+    const GameRecord record = Play(opening, firstwhite, game + 1);
+    Count(record, firstwhite);
+  }
+}
+
+void MatchRunner::Count(const GameRecord& game, bool firstwhite) {
+  boost::lock_guard<boost::mutex> lock(mutex);
+  const int points = firstwhite ? game.result : -game.result;
+  (points > 0 ? result.wins : points < 0 ? result.losses : result.draws)++;
+  EloEstimate(result.wins, result.draws, result.losses, result.elo, result.elomargin);
+  if (options.sprt) {
+    result.llr = SprtLlr(result.wins, result.draws, result.losses, options.elo0, options.elo1);
+    if (result.decision == SprtDecision::none) {
+      result.decision = result.llr >= result.upper ? SprtDecision::h1 : result.llr <= result.lower ? SprtDecision::h0 : SprtDecision::none;
+      decided = result.decision != SprtDecision::none;
+    }
+  }
+  if (pgn.is_open()) {
+    pgn << ToPgn(game, options.event) << std::flush;
+  }
+  if (progress) {
+    progress(game, result);
+  }
+}
+
+GameRecord MatchRunner::Play(const std::vector<std::string>& opening, bool firstwhite, int round) const {
+  GameRecord game;
+  game.round = round;
+  const MatchEngine* players[2] = { firstwhite ? &first : &second, firstwhite ? &second : &first };
+  game.white = players[0]->name;
+  game.black = players[1]->name;
+
+  boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+  machine->Start();
+  std::map<uint64_t, int> seen;
+  int quiet = 0; // plies since the last capture or pawn move
+  auto played = [&](const std::string& notation) {
+    game.moves.push_back(notation);
+    const bool pawn = notation[0] >= 'a' && notation[0] <= 'h';
+    quiet = pawn || notation.find('x') != std::string::npos ? 0 : quiet + 1;
+    ++seen[machine->PositionKey()];
+  };
+  ++seen[machine->PositionKey()];
+  for (const auto& move : opening) {
+    if (!machine->Move(move)) {
+      break; // the game goes on from the position reached
+    }
+    played(machine->LastMoveNotation());
+  }
+
+  const boost::shared_ptr<IEngine> engines[2] = { players[0]->create(), players[1]->create() };
+  int clocks[2] = { players[0]->limits.gametime, players[1]->limits.gametime };
+  int resigning = 0; // plies in a row the white score is beyond the resign score, negative for black
+  int drawing = 0;
+  for (;;) {
+    const Status status = machine->CheckStatus();
+    const int side = machine->CurrentPlayer() == Set::white ? 0 : 1;
+    auto over = [&](int result, const char* termination) {
+      game.result = result;
+      game.termination = termination;
+    };
+    if (status == Status::checkmate) {
+      over(side == 0 ? -1 : 1, "checkmate");
+    } else if (status == Status::stalemate) {
+      over(0, "stalemate");
+    } else if (seen[machine->PositionKey()] >= 3) {
+      over(0, "threefold repetition");
+    } else if (quiet >= 100) {
+      over(0, "fifty moves");
+    } else if (InsufficientMaterial(machine->GetSet(Set::white), machine->GetSet(Set::black))) {
+      over(0, "insufficient material");
+    } else if (static_cast<int>(game.moves.size()) >= options.maxplies) {
+      over(0, "adjudication: maximal length");
+    }
+    if (!game.termination.empty()) {
+      break;
+    }
+
+    const TimeControl& limits = players[side]->limits;
+    const Reply move = Think(*engines[side], *machine, limits, clocks[side]);
+    if (!move.replied) {
+      over(side == 0 ? -1 : 1, "no reply");
+      break;
+    }
+    if (move.notation.empty() || !machine->Move(move.notation)) {
+      over(side == 0 ? -1 : 1, "illegal move");
+      break;
+    }
+    played(machine->LastMoveNotation());
+    if (limits.gametime > 0) {
+      clocks[side] += limits.increment - move.milliseconds;
+      if (clocks[side] < 0) {
+        over(side == 0 ? -1 : 1, "time forfeit");
+        break;
+      }
+    }
+
+    const float white = side == 0 ? move.score : -move.score;
+    if (std::abs(white) >= options.resignscore) {
+      resigning = (white > 0) == (resigning > 0) ? resigning + (white > 0 ? 1 : -1) : (white > 0 ? 1 : -1);
+    } else {
+      resigning = 0;
+    }
+    drawing = std::abs(white) <= options.drawscore && static_cast<int>(game.moves.size()) >= options.drawfromply ? drawing + 1 : 0;
+    if (options.resignmoves > 0 && std::abs(resigning) >= 2 * options.resignmoves) {
+      over(resigning > 0 ? 1 : -1, "adjudication: resign");
+      break;
+    }
+    if (options.drawmoves > 0 && drawing >= 2 * options.drawmoves) {
+      over(0, "adjudication: draw");
+      break;
+    }
+  }
+  return game;
+}
+
+MatchRunner::Reply MatchRunner::Think(IEngine& engine, const IMachine& position, const TimeControl& limits, int clock) const {
+  Reply move;
+  int budget = limits.movetime;
+  if (limits.gametime > 0) {
+    const int share = std::max(1, clock / TimeControl::MovesToGo + limits.increment);
+    budget = budget > 0 ? std::min(budget, share) : share;
+  }
+  MoveListener listener;
+  const auto started = std::chrono::steady_clock::now();
+  if (!engine.Start(position, limits.depth > 0 ? limits.depth : SearchDepth)) {
+    return move;
+  }
+  bool stopped = false;
+  std::chrono::steady_clock::time_point deadline; // of the reply after Stop
+  while (!listener.readyok) {
+    engine.WaitInfo(PollMilliseconds);
+    engine.ProcessInfo(&listener);
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - started);
+    if (!stopped && !listener.readyok &&
+        ((budget > 0 && elapsed.count() >= budget) || (limits.nodes > 0 && listener.nodes >= limits.nodes))) {
+      engine.Stop(); // the best move found so far follows
+      stopped = true;
+      deadline = now + std::chrono::milliseconds(options.replytime);
+    } else if (stopped && !listener.readyok && now >= deadline) {
+      move.replied = false;
+      return move;
+    }
+  }
+  move.notation = listener.bestmove;
+  move.score = listener.bestscore;
+  move.milliseconds = static_cast<int>(
+    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+  return move;
+}
+
+}
+}
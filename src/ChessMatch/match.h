@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+// Limits of every move, the search stops at the first one reached. Zero switches a limit off.
+struct TimeControl {
+    int depth = 0;        // plies passed to IEngine::Start, 0 for the deepest search
+    int movetime = 0;     // milliseconds per move
+    int gametime = 0;     // milliseconds per game, a move gets the rest of the clock by MovesToGo and the increment
+    int increment = 0;    // milliseconds added to the clock after every move
+    size_t nodes = 0;     // nodes per move, as reported by IInfoCall::NodesSearched
+
+    static const int MovesToGo = 30;
+};
+
+struct MatchEngine {
+    std::string name;
+    std::function<boost::shared_ptr<IEngine>()> create; // called for every game, the games do not share the engines
+    TimeControl limits;
+};
+
+struct MatchOptions {
+    int concurrency = 0;   // games played at once, 0 for the number of the cores
+    int games = 0;         // 0 for every opening twice, with either engine white
+    std::vector<std::vector<std::string>> openings; // moves in SAN, the start position if there are none
+
+    // Adjudication: the game is over when both engines agree on the result for long enough.
+    int maxplies = 400;         // draw after so many plies
+    float resignscore = 6.0f;   // pawns, the loser is at least this behind in the scores of both engines
+    int resignmoves = 4;        // moves of each side in a row
+    float drawscore = 0.1f;     // pawns, both engines see at most this much
+    int drawmoves = 8;          // moves of each side in a row
+    int drawfromply = 60;       // the draw is not adjudicated before this ply
+    int replytime = 2000;       // milliseconds an engine has to send the best move after Stop, or it loses
+
+    // Sequential probability ratio test of the first engine being elo1 better against elo0, checked after every game.
+    bool sprt = false;
+    double elo0 = 0;
+    double elo1 = 5;
+    double alpha = 0.05;
+    double beta = 0.05;
+
+    std::string pgn; // the file of the games, empty for none
+    std::string event = "Chai match";
+};
+
+struct GameRecord {
+    int round = 0;
+    std::string white;
+    std::string black;
+    std::vector<std::string> moves; // SAN of the opening and the game
+    int result = 0;                 // for white: 1 win, 0 draw, -1 loss
+    std::string termination;
+};
+
+// Not decided yet, the first engine is at most elo0 better (H0) or at least elo1 better (H1).
+enum class SprtDecision : char { none, h0, h1 };
+
+struct MatchResult {
+    int wins = 0;   // of the first engine
+    int draws = 0;
+    int losses = 0;
+    double elo = 0;        // of the first engine against the second one
+    double elomargin = 0;  // 95% confidence
+    double llr = 0;        // log likelihood ratio of the test and its bounds
+    double lower = 0;
+    double upper = 0;
+    SprtDecision decision = SprtDecision::none;
+
+    int Games() const {
+        return wins + draws + losses;
+    }
+};
+
+// The log likelihood ratio of the results under elo1 against elo0, with the normal approximation of the score.
+double SprtLlr(int wins, int draws, int losses, double elo0, double elo1);
+// The Elo difference of the score and its margin of 95% confidence.
+void EloEstimate(int wins, int draws, int losses, double& elo, double& margin);
+
+std::vector<std::string> ParseMoves(const std::string& line);         // SAN moves, the numbers and results skipped
+std::vector<std::vector<std::string>> ReadOpenings(const std::string& filename); // one line of moves per opening
+std::string ToPgn(const GameRecord& game, const std::string& event);
+
+/**
+  Plays the games of two engines against each other on all the cores.
+
+  Every opening is played twice, once with either engine white. The workers take the next game as they finish one,
+  every game gets new engines from the factories. The results are counted and the games written in the order they end.
+  Once the sequential test is decided no more games are started, the ones being played are finished and counted.
+*/
+class MatchRunner {
+ public:
+    typedef std::function<void(const GameRecord& game, const MatchResult& result)> Progress;
+
+    MatchRunner(const MatchOptions& options, const MatchEngine& first, const MatchEngine& second);
+
+    MatchResult Run(const Progress& progress = Progress());
+    GameRecord Play(const std::vector<std::string>& opening, bool firstwhite, int round) const;
+
+ private:
+    struct Reply {
+        std::string notation; // empty if the engine found no move
+        float score = 0;      // for the side to move
+        int milliseconds = 0;
+        bool replied = true;  // false if the engine did not finish the search after Stop
+    };
+    Reply Think(IEngine& engine, const IMachine& position, const TimeControl& limits, int clock) const;
+    void WorkerFun();
+    void Count(const GameRecord& game, bool firstwhite);
+
+    const MatchOptions options;
+    const MatchEngine first;
+    const MatchEngine second;
+
+    boost::mutex mutex;
+    int next;
+    int total;
+    bool decided;
+    MatchResult result;
+    Progress progress;
+    std::ofstream pgn;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,234 @@
+#define BOOST_TEST_MODULE MyTest
+
+#include <ChessEngineGreedy/engine.h>
+#include <ChessMachine/machine.h>
+#include <ChessMatch/match.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <fstream>
+
+using namespace Chai::Chess;
+
+namespace {
+
+// Plays the first legal move at once and reports a fixed score for itself, or no move at all, or nothing at all.
+class scriptedengine : public IEngine {
+ public:
+    explicit scriptedengine(float s, bool m = true, bool r = true) : score(s), moves(m), replies(r) {}
+
+    bool Start(const IMachine& position, int /*depth*/) override {
+        bestmove.clear();
+        for (const auto& piece : position.GetSet(position.CurrentPlayer())) {
+            for (Position to : position.EnumMoves(piece.position)) {
+                boost::shared_ptr<IMachine> clone = position.SlightClone();
+                const bool promotion = piece.type == Type::pawn && (to.rank() == '1' || to.rank() == '8');
+                if (bestmove.empty() && moves && clone->Move(piece.type, piece.position, to, promotion ? Type::queen : Type::bad)) {
+                    bestmove = clone->LastMoveNotation();
+                }
+            }
+        }
+        ready = true;
+        ++searches;
+        return true;
+    }
+    void Stop() override {
+    }
+    bool Ponder(const IMachine& /*position*/, int /*depth*/) override {
+        return false;
+    }
+    void PonderHit() override {
+    }
+    void ProcessInfo(IInfoCall* cb) override {
+        if (ready && replies) {
+            ready = false;
+            cb->BestScore(score);
+            cb->BestMove(bestmove);
+            cb->ReadyOk();
+        }
+    }
+    bool WaitInfo(int /*milliseconds*/) override {
+        return ready;
+    }
+    float EvalPosition(const IMachine& /*position*/) const override {
+        return 0;
+    }
+    void EvalPositions(const PositionSnapshot* /*positions*/, size_t count, float* scores) const override {
+        std::fill(scores, scores + count, 0.0f);
+    }
+
+    static std::atomic<int> searches;
+
+ private:
+    const float score;
+    const bool moves;
+    const bool replies;
+    std::string bestmove;
+    bool ready = false;
+};
+
+std::atomic<int> scriptedengine::searches{0};
+
+MatchEngine Scripted(const std::string& name, float score, bool moves = true, bool replies = true) {
+    MatchEngine engine;
+    engine.name = name;
+    engine.create = [score, moves, replies]() {
+        return boost::shared_ptr<IEngine>(boost::make_shared<scriptedengine>(score, moves, replies));
+    };
+    return engine;
+}
+
+MatchEngine Greedy(const std::string& name, int depth) {
+    MatchEngine engine;
+    engine.name = name;
+    engine.limits.depth = depth;
+    engine.create = []() { return boost::shared_ptr<IEngine>(boost::make_shared<GreedyEngine>()); };
+    return engine;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(MatchTest)
+
+BOOST_AUTO_TEST_CASE(SprtTest) {
+    // Score 0.7 with the variance 0.16 of a game: 500 * (s1 - s0) * (1.4 - s0 - s1) / 0.32.
+    const double s1 = 1 / (1 + std::pow(10.0, -10 / 400.0));
+    BOOST_CHECK_CLOSE(SprtLlr(300, 100, 100, 0, 10), 500 * (s1 - 0.5) * (1.4 - 0.5 - s1) / 0.32, 1e-6);
+    BOOST_CHECK(SprtLlr(100, 100, 100, 0, 10) < 0);
+    BOOST_CHECK_EQUAL(SprtLlr(0, 0, 0, 0, 10), 0);
+    BOOST_CHECK(SprtLlr(50, 0, 0, 0, 10) > std::log(0.95 / 0.05));
+
+    double elo, margin;
+    EloEstimate(10, 10, 10, elo, margin);
+    BOOST_CHECK_SMALL(elo, 1e-9);
+    BOOST_CHECK(margin > 0);
+    EloEstimate(30, 0, 10, elo, margin);
+    BOOST_CHECK_CLOSE(elo, -400 * std::log10(1 / 0.75 - 1), 1e-6);
+    double wider;
+    EloEstimate(3, 0, 1, elo, wider);
+    BOOST_CHECK(wider > margin);
+}
+
+BOOST_AUTO_TEST_CASE(OpeningsTest) {
+    BOOST_CHECK((ParseMoves("1.e4 e5 2.Nf3 Nc6 3.Bb5+ 1-0") == std::vector<std::string>{"e4", "e5", "Nf3", "Nc6", "Bb5"}));
+    BOOST_CHECK((ParseMoves("1. d4 d5 2. c4 ") == std::vector<std::string>{"d4", "d5", "c4"}));
+    BOOST_CHECK((ParseMoves("1...e5") == std::vector<std::string>{"e5"}));
+
+    const auto file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("openings-%%%%-%%%%.txt");
+    {
+        std::ofstream out(file.string());
+        out << "# Openings\n1.e4 e5 2.Nf3\n\n1.d4 Nf6 # Indian\n";
+    }
+    const auto openings = ReadOpenings(file.string());
+    BOOST_REQUIRE_EQUAL(openings.size(), 2);
+    BOOST_CHECK_EQUAL(openings[0].size(), 3);
+    BOOST_CHECK_EQUAL(openings[1].back(), "Nf6");
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(AdjudicationTest) {
+    MatchOptions options;
+    options.resignmoves = 3;
+    options.drawmoves = 0;
+
+    // Both engines agree that the first one wins, whichever color it has.
+    MatchRunner runner(options, Scripted("strong", 10), Scripted("weak", -10));
+    GameRecord game = runner.Play({"e4", "e5"}, true, 1);
+    BOOST_CHECK_EQUAL(game.result, 1);
+    BOOST_CHECK_EQUAL(game.termination, "adjudication: resign");
+    BOOST_CHECK_EQUAL(game.moves.size(), 2 + 6);
+    game = runner.Play({}, false, 2);
+    BOOST_CHECK_EQUAL(game.result, -1);
+    BOOST_CHECK_EQUAL(game.white, "weak");
+
+    // One engine alone does not decide.
+    options.maxplies = 20;
+    MatchRunner limited(options, Scripted("first", 10), Scripted("second", 10));
+    game = limited.Play({}, true, 1);
+    BOOST_CHECK_EQUAL(game.result, 0);
+    BOOST_CHECK(game.termination == "adjudication: maximal length" || game.termination == "threefold repetition");
+
+    // Quiet scores late in the game are a draw.
+    options.maxplies = 400;
+    options.drawmoves = 2;
+    options.drawfromply = 10;
+    MatchRunner drawn(options, Scripted("first", 0), Scripted("second", 0));
+    game = drawn.Play({}, true, 1);
+    BOOST_CHECK_EQUAL(game.result, 0);
+    BOOST_CHECK_EQUAL(game.termination, "adjudication: draw");
+    BOOST_CHECK_EQUAL(game.moves.size(), 10 + 2 * 2 - 1);
+
+    // A missing move loses.
+    MatchRunner broken(options, Scripted("first", 0), Scripted("second", 0, false));
+    game = broken.Play({}, true, 1);
+    BOOST_CHECK_EQUAL(game.result, 1);
+    BOOST_CHECK_EQUAL(game.termination, "illegal move");
+    BOOST_CHECK_EQUAL(game.moves.size(), 1);
+
+    // An engine silent after Stop loses once its reply time is over.
+    options.replytime = 50;
+    MatchEngine silent = Scripted("silent", 0, true, false);
+    silent.limits.movetime = 10;
+    MatchRunner hung(options, silent, Scripted("second", 0));
+    game = hung.Play({}, true, 1);
+    BOOST_CHECK_EQUAL(game.result, -1);
+    BOOST_CHECK_EQUAL(game.termination, "no reply");
+    BOOST_CHECK(game.moves.empty());
+}
+
+BOOST_AUTO_TEST_CASE(SprtStopTest) {
+    // The test accepts H1 after a few won games and the rest of the games are not started.
+    MatchOptions options;
+    options.games = 1000;
+    options.concurrency = 4;
+    options.resignmoves = 1;
+    options.sprt = true;
+    options.elo0 = 0;
+    options.elo1 = 100;
+    MatchRunner runner(options, Scripted("strong", 10), Scripted("weak", -10));
+    int reports = 0;
+    const MatchResult result = runner.Run([&](const GameRecord&, const MatchResult&) { ++reports; });
+    BOOST_CHECK(result.decision == SprtDecision::h1);
+    BOOST_CHECK_EQUAL(result.wins, result.Games());
+    BOOST_CHECK(result.Games() < 100);
+    BOOST_CHECK_EQUAL(reports, result.Games());
+    BOOST_CHECK(result.llr >= result.upper);
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentMatchTest) {
+    // Games of the real engine played at once, written to PGN and read back by the book builder.
+    const auto pgn = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("match-%%%%-%%%%.pgn");
+    MatchOptions options;
+    options.concurrency = 2;
+    options.maxplies = 30;
+    options.openings = {{"e4", "e5", "Nf3", "Nc6"}, {"d4", "d5"}};
+    options.pgn = pgn.string();
+    MatchRunner runner(options, Greedy("deeper", 2), Greedy("shallow", 1));
+    std::vector<int> rounds;
+    const MatchResult result = runner.Run([&](const GameRecord& game, const MatchResult&) {
+        rounds.push_back(game.round);
+        BOOST_CHECK(!game.termination.empty());
+        BOOST_CHECK(game.moves.size() <= 30);
+    });
+    BOOST_CHECK_EQUAL(result.Games(), 4);
+    std::sort(rounds.begin(), rounds.end());
+    BOOST_CHECK((rounds == std::vector<int>{1, 2, 3, 4}));
+    BOOST_CHECK(result.decision == SprtDecision::none);
+
+    boost::shared_ptr<IMachine> start = boost::make_shared<ChessMachine>();
+    start->Start();
+    BookBuilder builder(*start, 40, 1);
+    BOOST_REQUIRE(builder.AddFile(pgn.string()));
+    BOOST_CHECK_EQUAL(builder.Games(), 4);
+    std::ifstream file(pgn.string());
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    BOOST_CHECK(text.find("[White \"deeper\"]") != std::string::npos);
+    BOOST_CHECK(text.find("[Black \"deeper\"]") != std::string::npos);
+    BOOST_CHECK(text.find("1. e4 e5 2. Nf3 Nc6") != std::string::npos);
+    boost::filesystem::remove(pgn);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
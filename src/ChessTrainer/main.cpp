@@ -0,0 +1,80 @@
+#include "trainer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace Chai::Chess;
+
+namespace {
+
+void Usage() {
+  std::cerr << "Usage: ChessTrain <records> <network> [--epochs N] [--batch N] [--threads N] [--rate X] [--sgd]\n"
+               "                  [--lambda X] [--scale X] [--seed N] [--report N]\n"
+               "Trains the evaluation network on a record file and writes it for the engine to load.\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    Usage();
+    return 1;
+  }
+  TrainerOptions options;
+  for (int i = 3; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (std::strcmp(arg, "--sgd") == 0) {
+      options.adam = false;
+      continue;
+    }
+    if (!value) {
+      Usage();
+      return 1;
+    }
+    if (std::strcmp(arg, "--epochs") == 0) {
+      options.epochs = std::atoi(value);
+    } else if (std::strcmp(arg, "--batch") == 0) {
+      options.batchsize = static_cast<size_t>(std::atol(value));
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      options.threads = std::atoi(value);
+    } else if (std::strcmp(arg, "--rate") == 0) {
+      options.learningrate = static_cast<float>(std::atof(value));
+    } else if (std::strcmp(arg, "--lambda") == 0) {
+      options.lambda = static_cast<float>(std::atof(value));
+    } else if (std::strcmp(arg, "--scale") == 0) {
+      options.scale = static_cast<float>(std::atof(value));
+    } else if (std::strcmp(arg, "--seed") == 0) {
+      options.seed = static_cast<uint32_t>(std::atol(value));
+    } else if (std::strcmp(arg, "--report") == 0) {
+      options.reportsteps = static_cast<size_t>(std::atol(value));
+    } else {
+      Usage();
+      return 1;
+    }
+    ++i;
+  }
+
+  {
+    RecordLoader check(argv[1], 1, 0);
+    if (!check.Valid()) {
+      std::cerr << "Not a record file: " << argv[1] << "\n";
+      return 1;
+    }
+    std::cout << check.Size() << " positions\n";
+  }
+  Trainer trainer(options);
+  auto print = [](const TrainerStats& s) {
+    std::cout << "steps " << s.steps << " samples " << s.samples << " loss " << s.loss << " samples/s "
+              << static_cast<size_t>(s.samplespersecond) << " efficiency " << s.efficiency << " stalls " << s.stalls
+              << "\n";
+  };
+  const TrainerStats stats = trainer.Train(argv[1], print);
+  print(stats);
+  if (!trainer.Write(argv[2])) {
+    std::cerr << "Cannot write " << argv[2] << "\n";
+    return 1;
+  }
+  return 0;
+}
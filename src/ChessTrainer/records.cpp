@@ -0,0 +1,201 @@
+#include "records.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const char RecordMagic[8] = { 'C', 'h', 'a', 'i', 'D', 'a', 't', 'a' };
+const uint32_t RecordVersion = 1;
+
+const size_t ChunkBatches = 16; // batches shuffled together
+
+static_assert(sizeof(TrainingRecord) == 32, "The records are packed into 32 bytes");
+
+uint8_t TypeCode(Type type) {
+  switch (type) {
+  case Type::pawn:    return 1;
+  case Type::knight:  return 2;
+  case Type::bishop:  return 3;
+  case Type::rook:    return 4;
+  case Type::queen:   return 5;
+  case Type::king:    return 6;
+  default:            return 0;
+  }
+}
+
+Type CodeType(uint8_t code) {
+  static const Type types[] = { Type::bad, Type::pawn, Type::knight, Type::bishop, Type::rook, Type::queen, Type::king, Type::bad };
+  return types[code & 7];
+}
+
+Position SquareOf(int pos) {
+  return Position((pos >> 3) << 4 | (pos & 7));
+}
+
+}
+
+TrainingRecord PackRecord(const Pieces& white, const Pieces& black, Set player, int result, int score) {
+  TrainingRecord record = {};
+  uint8_t codes[64] = {};
+  for (const auto& piece : white) {
+    codes[piece.position.pos()] = TypeCode(piece.type);
+  }
+  for (const auto& piece : black) {
+    codes[piece.position.pos()] = static_cast<uint8_t>(8 | TypeCode(piece.type));
+  }
+  int count = 0;
+  for (int pos = 0; pos < 64 && count < 32; ++pos) {
+    if (codes[pos] != 0) {
+      record.occupancy |= uint64_t(1) << pos;
+      record.pieces[count / 2] |= static_cast<uint8_t>(codes[pos] << (count % 2 ? 4 : 0));
+      ++count;
+    }
+  }
+  record.player = player == Set::white ? 0 : 1;
+  record.result = static_cast<int8_t>(std::max(-1, std::min(1, result)));
+  record.score = static_cast<int16_t>(std::max(-32767, std::min(32767, score)));
+  return record;
+}
+
+void UnpackRecord(const TrainingRecord& record, Pieces& white, Pieces& black, Set& player) {
+  white.clear();
+  black.clear();
+  int count = 0;
+  for (uint64_t bits = record.occupancy; bits != 0 && count < 32; bits &= bits - 1, ++count) {
+    int pos = 0;
+    while (!(bits & (uint64_t(1) << pos))) {
+      ++pos;
+    }
+    const uint8_t code = (record.pieces[count / 2] >> (count % 2 ? 4 : 0)) & 0x0f;
+    Pieces& pieces = code & 8 ? black : white;
+    if (CodeType(code) != Type::bad && pieces.size() < pieces.capacity()) {
+      pieces.push_back(Piece{ CodeType(code), SquareOf(pos) });
+    }
+  }
+  player = record.player == 0 ? Set::white : Set::black;
+}
+
+bool RecordWriter::Open(const std::string& filename) {
+  file.open(filename, std::ios::binary | std::ios::trunc);
+  count = 0;
+  RecordHeader header = {};
+  std::memcpy(header.magic, RecordMagic, sizeof(RecordMagic));
+  header.version = RecordVersion;
+  header.recordsize = sizeof(TrainingRecord);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  return static_cast<bool>(file);
+}
+
+void RecordWriter::Add(const TrainingRecord& record) {
+  file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+  ++count;
+}
+
+bool RecordWriter::Close() {
+  const uint64_t written = count;
+  file.seekp(offsetof(RecordHeader, count));
+  file.write(reinterpret_cast<const char*>(&written), sizeof(written));
+  file.close();
+  return !file.fail();
+}
+
+RecordLoader::RecordLoader(const std::string& filename, size_t batch, int epochs, size_t ahead, uint32_t seed)
+  : batchsize(std::max<size_t>(1, batch)), prefetch(std::max<size_t>(1, ahead)), valid(false), size(0), done(false),
+    stopped(false), stalls(0) {
+  std::ifstream file(filename, std::ios::binary);
+  RecordHeader header = {};
+  if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+      std::memcmp(header.magic, RecordMagic, sizeof(RecordMagic)) == 0 && header.version == RecordVersion &&
+      header.recordsize == sizeof(TrainingRecord)) {
+    valid = true;
+    size = static_cast<size_t>(header.count);
+  }
+  if (!valid || size == 0) {
+    done = true;
+    return;
+  }
+  thread = boost::thread(boost::bind(&RecordLoader::ThreadFun, this, filename, epochs, seed));
+}
+
+RecordLoader::~RecordLoader() {
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    stopped = true;
+  }
+  condspace.notify_all();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+bool RecordLoader::Next(std::vector<TrainingRecord>& batch) {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  if (ready.empty() && !done) {
+    ++stalls;
+  }
+  while (ready.empty() && !done) {
+    condready.wait(lock);
+  }
+  if (ready.empty()) {
+    return false;
+  }
+  batch.swap(ready.front());
+  ready.pop_front();
+  lock.unlock();
+  condspace.notify_one();
+  return true;
+}
+
+size_t RecordLoader::Stalls() const {
+  boost::lock_guard<boost::mutex> lock(mutex);
+  return stalls;
+}
+
+void RecordLoader::ThreadFun(const std::string& filename, int epochs, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::vector<TrainingRecord> chunk;
+  std::ifstream file(filename, std::ios::binary);
+  for (int epoch = 0; epoch < epochs && file; ++epoch) {
+    file.clear();
+    file.seekg(sizeof(RecordHeader));
+    for (size_t left = size; left > 0 && file;) {
+      // Reading the next chunk while the trainer works on the batches of the previous one.
+      chunk.resize(std::min(left, batchsize * ChunkBatches));
+      file.read(reinterpret_cast<char*>(chunk.data()), chunk.size() * sizeof(TrainingRecord));
+      chunk.resize(static_cast<size_t>(file.gcount()) / sizeof(TrainingRecord));
+      left -= std::min(left, chunk.size());
+      std::shuffle(chunk.begin(), chunk.end(), random);
+      for (size_t first = 0; first < chunk.size(); first += batchsize) {
+        std::vector<TrainingRecord> batch(chunk.begin() + first, chunk.begin() + std::min(chunk.size(), first + batchsize));
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (ready.size() >= prefetch && !stopped) {
+          condspace.wait(lock);
+        }
+        if (stopped) {
+          return;
+        }
+        ready.push_back(std::move(batch));
+        lock.unlock();
+        condready.notify_one();
+      }
+      if (chunk.empty()) {
+        break;
+      }
+    }
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    done = true;
+  }
+  condready.notify_all();
+}
+
+}
+}
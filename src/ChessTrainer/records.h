@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Interfaces/chessmachine.h>
+
+#include <boost/thread.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+/**
+  A training position packed into 32 bytes: the occupied squares and the codes of their pieces in the order of the
+  squares, two codes in a byte. The numbers are in the byte order of the machine that wrote the file.
+*/
+struct TrainingRecord {
+    uint64_t occupancy;  // bits by Position::pos
+    uint8_t pieces[16];  // 1-6 the white pawn, knight, bishop, rook, queen and king, 9-14 the black ones
+    uint8_t player;      // 0 white, 1 black
+    int8_t result;       // of the game for white: 1 win, 0 draw, -1 loss
+    int16_t score;       // centipawns for the side to move found by a search, 0 if unknown
+    uint32_t unused;
+};
+
+struct RecordHeader {
+    char magic[8]; // "ChaiData"
+    uint32_t version;
+    uint32_t recordsize;
+    uint64_t count;
+};
+
+TrainingRecord PackRecord(const Pieces& white, const Pieces& black, Set player, int result, int score = 0);
+void UnpackRecord(const TrainingRecord& record, Pieces& white, Pieces& black, Set& player);
+
+// Appends the records to a new file, the count in the header is written by Close.
+class RecordWriter {
+ public:
+    bool Open(const std::string& filename);
+    void Add(const TrainingRecord& record);
+    bool Close();
+    size_t Count() const {
+        return count;
+    }
+
+ private:
+    std::ofstream file;
+    size_t count = 0;
+};
+
+/**
+  Streams the records of a file as the shuffled minibatches of the given number of epochs.
+
+  The loader thread reads the file ahead in chunks of several batches, shuffles every chunk and keeps a few batches
+  ready, so the trainer waits for the disk only if it is faster than the reading.
+*/
+class RecordLoader {
+ public:
+    RecordLoader(const std::string& filename, size_t batchsize, int epochs, size_t prefetch = 4, uint32_t seed = 1);
+    RecordLoader(const RecordLoader&) = delete;
+    RecordLoader& operator=(const RecordLoader&) = delete;
+    ~RecordLoader();
+
+    bool Valid() const { // false if the file is missing or is not a record file
+        return valid;
+    }
+    size_t Size() const { // records in the file
+        return size;
+    }
+    bool Next(std::vector<TrainingRecord>& batch); // false after the last batch of the last epoch
+    size_t Stalls() const; // batches the trainer waited for
+
+ private:
+    void ThreadFun(const std::string& filename, int epochs, uint32_t seed);
+
+    const size_t batchsize;
+    const size_t prefetch;
+    bool valid;
+    size_t size;
+
+    boost::thread thread;
+    mutable boost::mutex mutex;
+    boost::condition_variable condready; // a batch is ready or the loader is done
+    boost::condition_variable condspace; // the trainer took a batch or stopped
+    std::deque<std::vector<TrainingRecord>> ready;
+    bool done;
+    bool stopped;
+    size_t stalls;
+};
+
+} // namespace Chess
+} // namespace Chai
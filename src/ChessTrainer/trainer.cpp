@@ -0,0 +1,439 @@
+#include "trainer.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const int Inputs = NetworkWeights::Inputs;
+const int Hidden = NetworkWeights::Hidden;
+const int Hidden2 = NetworkWeights::Hidden2;
+
+const float ActivationScale = 127;                               // of the clipped sums in the file
+const float WeightScale = static_cast<float>(1 << NetworkWeights::Shift); // of the second and third layer weights
+const float WeightLimit = 127 / WeightScale;                    // keeps the quantized weights in int8
+const float FeatureLimit = 32767 / ActivationScale;
+const float NoLimit = 1e30f;
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+float Sigmoid(float x) {
+  return 1 / (1 + std::exp(-x));
+}
+
+float Clip(float x) {
+  return std::max(0.0f, std::min(1.0f, x));
+}
+
+template <typename T>
+T Round(float x, float limit) {
+  return static_cast<T>(std::lround(std::max(-limit, std::min(limit, x))));
+}
+
+Position FindKing(const Pieces& pieces) {
+  auto king = std::find_if(pieces.begin(), pieces.end(), [](const Piece& p) { return p.type == Type::king; });
+  return king != pieces.end() ? king->position : Position();
+}
+
+}
+
+// The work of a sample, kept by the forward pass for the backward one.
+struct Trainer::Activations {
+    bool valid;
+    int active[2][32];
+    int counts[2];
+    float sums[2][Hidden];
+    float input[2 * Hidden]; // the side to move first
+    float z[Hidden2];
+    float hidden[Hidden2];
+    float output;
+    float target; // expected result of the side to move
+};
+
+struct Trainer::Gradients {
+    std::vector<float> features; // valid in the touched rows only
+    std::vector<uint8_t> touched;
+    std::vector<int> rows;
+    std::vector<float> biases;
+    std::vector<float> weights2;
+    std::vector<float> biases2;
+    std::vector<float> weights3;
+    float bias3 = 0;
+    double loss = 0;
+    double busy = 0;
+};
+
+Trainer::Trainer(const TrainerOptions& opts)
+  : options(opts), threads(opts.threads > 0 ? opts.threads : std::max(1u, boost::thread::hardware_concurrency())),
+    steps(0), rate(opts.learningrate), start(static_cast<unsigned>(threads + 1)), finish(static_cast<unsigned>(threads + 1)),
+    batch(nullptr), phase(0), quit(false), busy(0), wall(0) {
+  std::mt19937 random(options.seed);
+  auto init = [&](Parameter& p, size_t size, float low, float high) {
+    std::uniform_real_distribution<float> d(low, high);
+    p.values.resize(size);
+    for (auto& w : p.values) {
+      w = low == high ? low : d(random);
+    }
+    if (options.adam) {
+      p.m.assign(size, 0);
+      p.v.assign(size, 0);
+    }
+  };
+  // About thirty features are on, so the sums start spread around the middle of [0, 1].
+  init(features, static_cast<size_t>(Inputs) * Hidden, -0.05f, 0.05f);
+  init(biases, Hidden, 0.5f, 0.5f);
+  init(weights2, Hidden2 * 2 * Hidden, -1.0f / 16, 1.0f / 16);
+  init(biases2, Hidden2, 0.25f, 0.25f);
+  init(weights3, Hidden2, -0.5f, 0.5f);
+  init(bias3, 1, 0, 0);
+
+  touched.assign(Inputs, 0);
+  for (size_t i = 0; i < threads; ++i) {
+    std::unique_ptr<Gradients> g(new Gradients);
+    g->features.assign(static_cast<size_t>(Inputs) * Hidden, 0);
+    g->touched.assign(Inputs, 0);
+    g->biases.assign(Hidden, 0);
+    g->weights2.assign(Hidden2 * 2 * Hidden, 0);
+    g->biases2.assign(Hidden2, 0);
+    g->weights3.assign(Hidden2, 0);
+    gradients.push_back(std::move(g));
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers.create_thread(boost::bind(&Trainer::WorkerFun, this, i));
+  }
+}
+
+Trainer::~Trainer() {
+  quit = true;
+  start.wait();
+  workers.join_all();
+}
+
+TrainerStats Trainer::Train(const std::string& records, const Progress& progress) {
+  TrainerStats stats;
+  RecordLoader loader(records, options.batchsize, options.epochs, options.prefetch, options.seed);
+  std::vector<TrainingRecord> minibatch;
+  const auto started = std::chrono::steady_clock::now();
+  const double busystart = busy;
+  const double wallstart = wall;
+  double loss = 0;
+  size_t reported = 0;
+  auto report = [&]() {
+    stats.stalls = loader.Stalls();
+    stats.seconds = Seconds(started);
+    stats.samplespersecond = stats.seconds > 0 ? stats.samples / stats.seconds : 0;
+    stats.efficiency = wall > wallstart ? (busy - busystart) / (threads * (wall - wallstart)) : 0;
+    stats.loss = stats.steps > reported ? loss / (stats.steps - reported) : stats.loss;
+    loss = 0;
+    reported = stats.steps;
+  };
+  while (loader.Next(minibatch)) {
+    loss += Step(minibatch);
+    stats.samples += minibatch.size();
+    ++stats.steps;
+    if (options.reportsteps > 0 && stats.steps % options.reportsteps == 0) {
+      report();
+      if (progress) {
+        progress(stats);
+      }
+    }
+  }
+  report();
+  return stats;
+}
+
+float Trainer::Step(const std::vector<TrainingRecord>& records) {
+  if (records.empty()) {
+    return 0;
+  }
+  ++steps;
+  if (options.adam) {
+    rate = options.learningrate * std::sqrt(1 - std::pow(options.beta2, static_cast<float>(steps))) /
+           (1 - std::pow(options.beta1, static_cast<float>(steps)));
+  }
+  const auto started = std::chrono::steady_clock::now();
+  batch = &records;
+  phase = 0;
+  start.wait();
+  finish.wait();
+
+  // The rows touched by any thread are reduced and updated by the threads in turns, the small layers meanwhile here.
+  for (const auto& g : gradients) {
+    for (int row : g->rows) {
+      if (!touched[row]) {
+        touched[row] = 1;
+        rows.push_back(row);
+      }
+    }
+  }
+  phase = 1;
+  start.wait();
+  Reduce(records.size());
+  finish.wait();
+  wall += Seconds(started);
+
+  double loss = 0;
+  for (auto& g : gradients) {
+    loss += g->loss;
+    busy += g->busy;
+    g->loss = 0;
+    g->busy = 0;
+    g->rows.clear();
+  }
+  for (int row : rows) {
+    touched[row] = 0;
+  }
+  rows.clear();
+  return static_cast<float>(loss / records.size());
+}
+
+float Trainer::Loss(const std::vector<TrainingRecord>& records) const {
+  double loss = 0;
+  for (const auto& record : records) {
+    loss += Forward(record, nullptr);
+  }
+  return records.empty() ? 0 : static_cast<float>(loss / records.size());
+}
+
+float Trainer::Evaluate(const TrainingRecord& record) const {
+  Activations a;
+  Forward(record, &a);
+  return a.output;
+}
+
+NetworkWeights Trainer::Quantize() const {
+  NetworkWeights weights;
+  const float biasscale = ActivationScale * WeightScale; // the sums of the next layers are products of both
+  weights.features.resize(features.values.size());
+  std::transform(features.values.begin(), features.values.end(), weights.features.begin(),
+                 [](float w) { return Round<int16_t>(w * ActivationScale, 32767); });
+  weights.biases.resize(Hidden);
+  std::transform(biases.values.begin(), biases.values.end(), weights.biases.begin(),
+                 [](float w) { return Round<int16_t>(w * ActivationScale, 32767); });
+  weights.weights2.resize(weights2.values.size());
+  std::transform(weights2.values.begin(), weights2.values.end(), weights.weights2.begin(),
+                 [](float w) { return Round<int8_t>(w * WeightScale, 127); });
+  weights.biases2.resize(Hidden2);
+  // The shift of the engine rounds down, half of its step in the biases makes it round to the nearest.
+  std::transform(biases2.values.begin(), biases2.values.end(), weights.biases2.begin(), [biasscale](float w) {
+    return Round<int32_t>(w * biasscale, 1e9f) + (1 << (NetworkWeights::Shift - 1));
+  });
+  weights.weights3.resize(Hidden2);
+  std::transform(weights3.values.begin(), weights3.values.end(), weights.weights3.begin(),
+                 [](float w) { return Round<int8_t>(w * WeightScale, 127); });
+  weights.bias3 = Round<int32_t>(bias3.values[0] * biasscale, 1e9f);
+  weights.outputscale = static_cast<int32_t>(biasscale);
+  return weights;
+}
+
+void Trainer::WorkerFun(size_t index) {
+  Gradients& g = *gradients[index];
+  for (;;) {
+    start.wait();
+    if (quit) {
+      return;
+    }
+    const auto started = std::chrono::steady_clock::now();
+    if (phase == 0) {
+      const size_t size = batch->size();
+      for (size_t i = index * size / threads; i < (index + 1) * size / threads; ++i) {
+        g.loss += Backward((*batch)[i], g);
+      }
+    } else {
+      const float scale = 1.0f / batch->size();
+      for (size_t i = index; i < rows.size(); i += threads) {
+        const size_t row = static_cast<size_t>(rows[i]);
+        float sum[Hidden] = {};
+        for (auto& t : gradients) {
+          if (t->touched[row]) {
+            float* values = t->features.data() + row * Hidden;
+            for (int j = 0; j < Hidden; ++j) {
+              sum[j] += values[j];
+              values[j] = 0;
+            }
+            t->touched[row] = 0;
+          }
+        }
+        for (int j = 0; j < Hidden; ++j) {
+          Update(features, row * Hidden + j, sum[j] * scale, FeatureLimit);
+        }
+      }
+    }
+    g.busy += Seconds(started);
+    finish.wait();
+  }
+}
+
+double Trainer::Forward(const TrainingRecord& record, Activations* activations) const {
+  Activations local;
+  Activations& a = activations ? *activations : local;
+  Pieces white, black;
+  Set player;
+  UnpackRecord(record, white, black, player);
+  a.output = 0;
+  const std::array<Position, 2> kings = { FindKing(white), FindKing(black) };
+  a.valid = kings[0].isValid() && kings[1].isValid();
+  if (!a.valid) {
+    return 0; // not a position, it is left out
+  }
+  for (int side = 0; side < 2; ++side) {
+    const Set s = side == 0 ? Set::white : Set::black;
+    a.counts[side] = 0;
+    std::copy(biases.values.begin(), biases.values.end(), a.sums[side]);
+    for (Set set : { Set::white, Set::black }) {
+      for (const auto& piece : set == Set::white ? white : black) {
+        if (piece.type != Type::king) {
+          const int feature = Network::Feature(s, kings[side], set, piece.type, piece.position);
+          a.active[side][a.counts[side]++] = feature;
+          const float* row = features.values.data() + static_cast<size_t>(feature) * Hidden;
+          for (int i = 0; i < Hidden; ++i) {
+            a.sums[side][i] += row[i];
+          }
+        }
+      }
+    }
+  }
+  const int own = player == Set::white ? 0 : 1;
+  for (int i = 0; i < Hidden; ++i) {
+    a.input[i] = Clip(a.sums[own][i]);
+    a.input[Hidden + i] = Clip(a.sums[1 - own][i]);
+  }
+  float output = bias3.values[0];
+  for (int j = 0; j < Hidden2; ++j) {
+    const float* w = weights2.values.data() + j * 2 * Hidden;
+    float z = biases2.values[j];
+    for (int i = 0; i < 2 * Hidden; ++i) {
+      z += w[i] * a.input[i];
+    }
+    a.z[j] = z;
+    a.hidden[j] = Clip(z);
+    output += weights3.values[j] * a.hidden[j];
+  }
+  a.output = output;
+
+  float target = (record.result + 1) / 2.0f;
+  if (player == Set::black) {
+    target = 1 - target;
+  }
+  a.target = options.lambda * target + (1 - options.lambda) * Sigmoid(record.score / 100.0f / options.scale);
+  const float error = Sigmoid(output / options.scale) - a.target;
+  return error * error;
+}
+
+double Trainer::Backward(const TrainingRecord& record, Gradients& g) const {
+  Activations a;
+  const double loss = Forward(record, &a);
+  if (!a.valid) {
+    return 0;
+  }
+  const float p = Sigmoid(a.output / options.scale);
+  const float doutput = 2 * (p - a.target) * p * (1 - p) / options.scale;
+
+  g.bias3 += doutput;
+  float dinput[2 * Hidden] = {};
+  for (int j = 0; j < Hidden2; ++j) {
+    g.weights3[j] += doutput * a.hidden[j];
+    if (a.z[j] <= 0 || a.z[j] >= 1) {
+      continue;
+    }
+    const float dz = doutput * weights3.values[j];
+    g.biases2[j] += dz;
+    const float* w = weights2.values.data() + j * 2 * Hidden;
+    float* gw = g.weights2.data() + j * 2 * Hidden;
+    for (int i = 0; i < 2 * Hidden; ++i) {
+      gw[i] += dz * a.input[i];
+      dinput[i] += dz * w[i];
+    }
+  }
+  const int own = record.player == 0 ? 0 : 1;
+  for (int side = 0; side < 2; ++side) {
+    const float* dclipped = dinput + (side == own ? 0 : Hidden);
+    float dsums[Hidden];
+    for (int i = 0; i < Hidden; ++i) {
+      dsums[i] = a.sums[side][i] > 0 && a.sums[side][i] < 1 ? dclipped[i] : 0;
+      g.biases[i] += dsums[i];
+    }
+    for (int k = 0; k < a.counts[side]; ++k) {
+      const int feature = a.active[side][k];
+      float* row = g.features.data() + static_cast<size_t>(feature) * Hidden;
+      if (!g.touched[feature]) {
+        g.touched[feature] = 1;
+        g.rows.push_back(feature);
+      }
+      for (int i = 0; i < Hidden; ++i) {
+        row[i] += dsums[i];
+      }
+    }
+  }
+  return loss;
+}
+
+void Trainer::Reduce(size_t count) {
+  const float scale = 1.0f / count;
+  for (size_t i = 0; i < biases.values.size(); ++i) {
+    float sum = 0;
+    for (auto& g : gradients) {
+      sum += g->biases[i];
+      g->biases[i] = 0;
+    }
+    Update(biases, i, sum * scale, FeatureLimit);
+  }
+  for (size_t i = 0; i < weights2.values.size(); ++i) {
+    float sum = 0;
+    for (auto& g : gradients) {
+      sum += g->weights2[i];
+      g->weights2[i] = 0;
+    }
+    Update(weights2, i, sum * scale, WeightLimit);
+  }
+  for (size_t i = 0; i < biases2.values.size(); ++i) {
+    float sum = 0;
+    for (auto& g : gradients) {
+      sum += g->biases2[i];
+      g->biases2[i] = 0;
+    }
+    Update(biases2, i, sum * scale, NoLimit);
+  }
+  for (size_t i = 0; i < weights3.values.size(); ++i) {
+    float sum = 0;
+    for (auto& g : gradients) {
+      sum += g->weights3[i];
+      g->weights3[i] = 0;
+    }
+    Update(weights3, i, sum * scale, WeightLimit);
+  }
+  float sum = 0;
+  for (auto& g : gradients) {
+    sum += g->bias3;
+    g->bias3 = 0;
+  }
+  Update(bias3, 0, sum * scale, NoLimit);
+}
+
+void Trainer::Update(Parameter& p, size_t index, float gradient, float limit) {
+  float& w = p.values[index];
+  if (options.adam) {
+    // The rows of the first layer are only updated in the steps that touch them, the moments wait meanwhile.
+    float& m = p.m[index];
+    float& v = p.v[index];
+    m = options.beta1 * m + (1 - options.beta1) * gradient;
+    v = options.beta2 * v + (1 - options.beta2) * gradient * gradient;
+    w -= rate * m / (std::sqrt(v) + options.epsilon);
+  } else {
+    w -= options.learningrate * gradient;
+  }
+  w = std::max(-limit, std::min(limit, w));
+}
+
+}
+}
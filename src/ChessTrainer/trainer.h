@@ -0,0 +1,116 @@
+#pragma once
+
+#include "records.h"
+
+#include <ChessEngineGreedy/network.h>
+
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+struct TrainerOptions {
+    int threads = 0;              // 0 for the number of the cores
+    size_t batchsize = 1024;
+    int epochs = 1;
+    bool adam = true;             // plain SGD otherwise
+    float learningrate = 0.001f;
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+    float scale = 4.0f;           // pawns of the score that make the expected result sigmoid(1)
+    float lambda = 1.0f;          // weight of the game result against the score of the record
+    uint32_t seed = 1;            // of the initial weights and the shuffling
+    size_t prefetch = 4;          // batches read ahead
+    size_t reportsteps = 100;     // steps between the progress reports
+};
+
+struct TrainerStats {
+    size_t samples = 0;
+    size_t steps = 0;
+    size_t stalls = 0;            // batches the trainer waited for the loader
+    double seconds = 0;
+    double samplespersecond = 0;
+    double efficiency = 0;        // busy time of the threads over their time in the gradient passes, 1 for perfect scaling
+    double loss = 0;              // mean over the steps since the previous report
+};
+
+/**
+  Trains the evaluation network on the positions of a record file.
+
+  The network is kept in floats with the meaning of the quantized one: the first layer sums are clipped into [0, 1],
+  which is [0, 127] in the file, the second layer weights are scaled by 2^Shift and the output is in pawns. The expected
+  result sigmoid(score / scale) of the side to move is fitted to the game result with the squared error.
+
+  Every minibatch is split between the threads, each of them sums the gradients of its samples into its own buffers.
+  The first layer gradients are sparse, so the threads keep the list of the rows they touched and only these rows are
+  reduced and updated by Adam after the step.
+*/
+class Trainer {
+ public:
+    typedef std::function<void(const TrainerStats& stats)> Progress;
+
+    explicit Trainer(const TrainerOptions& options);
+    Trainer(const Trainer&) = delete;
+    Trainer& operator=(const Trainer&) = delete;
+    ~Trainer();
+
+    TrainerStats Train(const std::string& records, const Progress& progress = Progress()); // all the epochs
+    float Step(const std::vector<TrainingRecord>& batch);                                  // the mean loss before the step
+    float Loss(const std::vector<TrainingRecord>& records) const;
+    float Evaluate(const TrainingRecord& record) const; // the score in pawns for the side to move
+
+    NetworkWeights Quantize() const;
+    bool Write(const std::string& filename) const {
+        return Quantize().Write(filename);
+    }
+
+ private:
+    struct Parameter {
+        std::vector<float> values;
+        std::vector<float> m; // moments of Adam
+        std::vector<float> v;
+    };
+    struct Activations;
+    struct Gradients;
+
+    void WorkerFun(size_t index);
+    double Backward(const TrainingRecord& record, Gradients& gradients) const;
+    double Forward(const TrainingRecord& record, Activations* activations) const; // the loss
+    void Reduce(size_t count);
+    void Update(Parameter& p, size_t index, float gradient, float limit);
+
+    const TrainerOptions options;
+    const size_t threads;
+    Parameter features; // [input][hidden]
+    Parameter biases;   // [hidden]
+    Parameter weights2; // [hidden2][2 * hidden]
+    Parameter biases2;  // [hidden2]
+    Parameter weights3; // [hidden2]
+    Parameter bias3;    // [1]
+    size_t steps;
+    float rate; // of the current step with the bias correction of Adam
+
+    std::vector<std::unique_ptr<Gradients>> gradients; // of every thread
+    std::vector<int> rows;                             // touched by the step
+    std::vector<uint8_t> touched;
+
+    boost::thread_group workers;
+    boost::barrier start;
+    boost::barrier finish;
+    const std::vector<TrainingRecord>* batch;
+    int phase; // 0 the gradients of the batch, 1 their reduction
+    bool quit;
+    double busy; // seconds of all the threads in the gradient passes
+    double wall; // seconds of the gradient passes
+};
+
+} // namespace Chess
+} // namespace Chai
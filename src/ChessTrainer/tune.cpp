@@ -0,0 +1,71 @@
+#include "tuner.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace Chai::Chess;
+
+namespace {
+
+void Usage() {
+  std::cerr << "Usage: ChessTune <records> <weights> [--start FILE] [--iterations N] [--threads N] [--rate X]\n"
+               "                 [--scale X] [--report N]\n"
+               "Fits the material and square weights to the game results and writes them for SearchOptions::evalparams.\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    Usage();
+    return 1;
+  }
+  TunerOptions options;
+  EvalParams start = EvalParams::Default();
+  for (int i = 3; i < argc; i += 2) {
+    if (i + 1 == argc) {
+      Usage();
+      return 1;
+    }
+    const char* arg = argv[i];
+    const char* value = argv[i + 1];
+    if (std::strcmp(arg, "--start") == 0) {
+      if (!start.Read(value)) {
+        std::cerr << "Cannot read the weights " << value << "\n";
+        return 1;
+      }
+    } else if (std::strcmp(arg, "--iterations") == 0) {
+      options.iterations = std::atoi(value);
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      options.threads = std::atoi(value);
+    } else if (std::strcmp(arg, "--rate") == 0) {
+      options.learningrate = static_cast<float>(std::atof(value));
+    } else if (std::strcmp(arg, "--scale") == 0) {
+      options.scale = static_cast<float>(std::atof(value));
+    } else if (std::strcmp(arg, "--report") == 0) {
+      options.reportiterations = std::atoi(value);
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+
+  Tuner tuner(options);
+  if (tuner.Load(argv[1]) == 0) {
+    std::cerr << "No positions in " << argv[1] << "\n";
+    return 1;
+  }
+  std::cout << tuner.Stats().positions << " positions extracted in " << tuner.Stats().extractseconds << " s\n";
+  const EvalParams tuned = tuner.Tune(start, [](const TunerStats& s, const EvalParams&) {
+    std::cout << "iteration " << s.iterations << " loss " << s.loss << " scale " << s.scale << " iterations/s "
+              << s.iterationspersecond << "\n";
+  });
+  std::cout << "loss " << tuner.Stats().loss << " after " << tuner.Stats().iterations << " iterations in "
+            << tuner.Stats().seconds << " s\n";
+  if (!tuned.Write(argv[2])) {
+    std::cerr << "Cannot write " << argv[2] << "\n";
+    return 1;
+  }
+  return 0;
+}
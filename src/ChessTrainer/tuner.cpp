@@ -0,0 +1,234 @@
+#include "tuner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace Chai {
+namespace Chess {
+
+namespace {
+
+const size_t ExtractBatch = 256; // positions evaluated together
+
+// The positions extracted by one thread, appended to the others in their order.
+struct Extracted {
+    std::vector<uint32_t> lengths;
+    std::vector<uint16_t> indices;
+    std::vector<int8_t> counts;
+    std::vector<float> constants;
+    std::vector<float> results;
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double Sigmoid(double x) {
+  return 1 / (1 + std::exp(-x));
+}
+
+SearchOptions RestOptions() {
+  SearchOptions options;
+  options.evalcache = 0;
+  options.pawncache = 0;
+  options.transpositions = 0;
+  options.threads = 1;
+  return options;
+}
+
+}
+
+Tuner::Tuner(const TunerOptions& opts)
+  : options(opts), threads(opts.threads > 0 ? opts.threads : std::max(1u, boost::thread::hardware_concurrency())),
+    rest(RestOptions(), EvalParams::Zero()), start(static_cast<unsigned>(threads)), finish(static_cast<unsigned>(threads)),
+    job(nullptr), jobcount(0), quit(false) {
+  offsets.push_back(0);
+  for (size_t t = 1; t < threads; ++t) {
+    workers.create_thread(boost::bind(&Tuner::WorkerFun, this, t));
+  }
+}
+
+Tuner::~Tuner() {
+  quit = true;
+  if (threads > 1) {
+    start.wait();
+  }
+  workers.join_all();
+}
+
+void Tuner::Parallel(size_t count, const Job& fun) const {
+  if (threads == 1 || count < threads) {
+    fun(0, count, 0);
+    return;
+  }
+  job = &fun;
+  jobcount = count;
+  start.wait();
+  fun(0, count / threads, 0);
+  finish.wait();
+}
+
+void Tuner::WorkerFun(size_t index) {
+  for (;;) {
+    start.wait();
+    if (quit) {
+      return;
+    }
+    (*job)(index * jobcount / threads, (index + 1) * jobcount / threads, index);
+    finish.wait();
+  }
+}
+
+size_t Tuner::Load(const std::string& filename) {
+  const auto started = std::chrono::steady_clock::now();
+  const size_t before = Size();
+  RecordLoader loader(filename, 1 << 16, 1);
+  std::vector<TrainingRecord> batch;
+  while (loader.Next(batch)) {
+    Add(batch); // the loader reads the next batch meanwhile
+  }
+  stats.extractseconds += Seconds(started);
+  return Size() - before;
+}
+
+void Tuner::Add(const std::vector<TrainingRecord>& records) {
+  std::vector<Extracted> parts(threads);
+  Parallel(records.size(), [&](size_t begin, size_t end, size_t t) {
+    Extracted& part = parts[t];
+    std::vector<PositionSnapshot> snapshots;
+    std::vector<float> scores(ExtractBatch);
+    std::vector<std::pair<int, int>> features;
+    for (size_t first = begin; first < end; first += ExtractBatch) {
+      snapshots.clear();
+      for (size_t i = first; i < std::min(end, first + ExtractBatch); ++i) {
+        PositionSnapshot snapshot;
+        UnpackRecord(records[i], snapshot.white, snapshot.black, snapshot.player);
+        snapshot.status = Status::normal;
+        snapshots.push_back(snapshot);
+      }
+      rest.EvalPositions(snapshots.data(), snapshots.size(), scores.data());
+      for (size_t i = 0; i < snapshots.size(); ++i) {
+        const PositionSnapshot& snapshot = snapshots[i];
+        EvalParams::Features(snapshot.white, snapshot.black, features);
+        part.lengths.push_back(static_cast<uint32_t>(features.size()));
+        for (const auto& f : features) {
+          part.indices.push_back(static_cast<uint16_t>(f.first));
+          part.counts.push_back(static_cast<int8_t>(f.second));
+        }
+        part.constants.push_back(snapshot.player == Set::white ? scores[i] : -scores[i]);
+        part.results.push_back((records[first + i].result + 1) / 2.0f);
+      }
+    }
+  });
+  for (const auto& part : parts) {
+    for (uint32_t length : part.lengths) {
+      offsets.push_back(offsets.back() + length);
+    }
+    indices.insert(indices.end(), part.indices.begin(), part.indices.end());
+    counts.insert(counts.end(), part.counts.begin(), part.counts.end());
+    constants.insert(constants.end(), part.constants.begin(), part.constants.end());
+    results.insert(results.end(), part.results.begin(), part.results.end());
+  }
+  stats.positions = Size();
+}
+
+float Tuner::Score(size_t position, const EvalParams& params) const {
+  float score = constants[position];
+  for (uint32_t k = offsets[position]; k < offsets[position + 1]; ++k) {
+    score += counts[k] * params.values[indices[k]];
+  }
+  return score;
+}
+
+double Tuner::Loss(const EvalParams& params, float scale) const {
+  return Pass(params, scale, nullptr);
+}
+
+float Tuner::FitScale(const EvalParams& params) const {
+  // The loss has a single minimum in the scale, found by the golden section search.
+  const double ratio = (std::sqrt(5.0) - 1) / 2;
+  double low = 0.25, high = 16;
+  double a = high - ratio * (high - low), b = low + ratio * (high - low);
+  double la = Loss(params, static_cast<float>(a)), lb = Loss(params, static_cast<float>(b));
+  while (high - low > 0.01) {
+    if (la < lb) {
+      high = b;
+      b = a;
+      lb = la;
+      a = high - ratio * (high - low);
+      la = Loss(params, static_cast<float>(a));
+    } else {
+      low = a;
+      a = b;
+      la = lb;
+      b = low + ratio * (high - low);
+      lb = Loss(params, static_cast<float>(b));
+    }
+  }
+  return static_cast<float>((low + high) / 2);
+}
+
+EvalParams Tuner::Tune(const EvalParams& start, const Progress& progress) {
+  EvalParams params = start;
+  stats.scale = options.scale > 0 ? options.scale : FitScale(start);
+  std::vector<double> gradient;
+  std::vector<double> m(EvalParams::Size, 0), v(EvalParams::Size, 0);
+  const auto started = std::chrono::steady_clock::now();
+  for (int iteration = 1; iteration <= options.iterations; ++iteration) {
+    stats.loss = Pass(params, stats.scale, &gradient);
+    const double rate = options.learningrate * std::sqrt(1 - std::pow(options.beta2, iteration)) /
+                        (1 - std::pow(options.beta1, iteration));
+    for (int i = 0; i < EvalParams::Size; ++i) {
+      m[i] = options.beta1 * m[i] + (1 - options.beta1) * gradient[i];
+      v[i] = options.beta2 * v[i] + (1 - options.beta2) * gradient[i] * gradient[i];
+      params.values[i] -= static_cast<float>(rate * m[i] / (std::sqrt(v[i]) + options.epsilon));
+    }
+    stats.iterations = iteration;
+    stats.seconds = Seconds(started);
+    stats.iterationspersecond = stats.seconds > 0 ? iteration / stats.seconds : 0;
+    if (progress && options.reportiterations > 0 && iteration % options.reportiterations == 0) {
+      progress(stats, params);
+    }
+  }
+  stats.loss = Loss(params, stats.scale);
+  return params;
+}
+
+double Tuner::Pass(const EvalParams& params, float scale, std::vector<double>* gradient) const {
+  const size_t size = Size();
+  std::vector<double> losses(threads, 0);
+  std::vector<std::vector<double>> gradients(gradient ? threads : 0, std::vector<double>(EvalParams::Size, 0));
+  Parallel(size, [&](size_t begin, size_t end, size_t t) {
+    double loss = 0;
+    double* g = gradient ? gradients[t].data() : nullptr;
+    for (size_t i = begin; i < end; ++i) {
+      const double p = Sigmoid(Score(i, params) / scale);
+      const double error = p - results[i];
+      loss += error * error;
+      if (g) {
+        const double d = 2 * error * p * (1 - p) / scale;
+        for (uint32_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+          g[indices[k]] += d * counts[k];
+        }
+      }
+    }
+    losses[t] = loss;
+  });
+  if (gradient) {
+    gradient->assign(EvalParams::Size, 0);
+    for (const auto& g : gradients) {
+      for (int i = 0; i < EvalParams::Size; ++i) {
+        (*gradient)[i] += g[i] / std::max<size_t>(1, size);
+      }
+    }
+  }
+  double loss = 0;
+  for (double l : losses) {
+    loss += l;
+  }
+  return size > 0 ? loss / size : 0;
+}
+
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "records.h"
+
+#include <ChessEngineGreedy/engine.h>
+#include <ChessEngineGreedy/evalparams.h>
+
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Chai {
+namespace Chess {
+
+struct TunerOptions {
+    int threads = 0;              // 0 for the number of the cores
+    int iterations = 1000;        // full passes over the positions
+    float learningrate = 0.001f;  // of Adam, in pawns
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+    float scale = 0;              // pawns of the score that make the expected result sigmoid(1), 0 fits it first
+    int reportiterations = 100;   // iterations between the progress reports
+};
+
+struct TunerStats {
+    size_t positions = 0;
+    double extractseconds = 0;    // of the feature extraction
+    int iterations = 0;
+    double seconds = 0;           // of the iterations
+    double iterationspersecond = 0;
+    float scale = 0;
+    double loss = 0;              // of the current weights
+};
+
+/**
+  Fits the material and square weights of the evaluation to the game results, the Texel way: the expected result
+  sigmoid(score / scale) of white is fitted to the result of its game with the squared error.
+
+  The score of white is linear in the weights, so every position is reduced once to the counts of the weights it uses
+  and the rest of its score, kept apart by evaluating it with all the weights zero. The records carry no moves, so the
+  mobility is left out of the rest. Every iteration is then a pass over these sparse vectors in the memory, split
+  between the threads, instead of evaluating the positions again. The threads are started once and wait for the next
+  pass at a barrier, the calling thread takes the first part of every pass.
+*/
+class Tuner {
+ public:
+    typedef std::function<void(const TunerStats& stats, const EvalParams& params)> Progress;
+
+    explicit Tuner(const TunerOptions& options);
+    ~Tuner();
+
+    size_t Load(const std::string& records); // the positions read, they are added to the loaded ones
+    void Add(const std::vector<TrainingRecord>& records);
+    size_t Size() const {
+        return constants.size();
+    }
+
+    float Score(size_t position, const EvalParams& params) const; // of white in pawns, the way the engine counts it
+    double Loss(const EvalParams& params, float scale) const;
+    float FitScale(const EvalParams& params) const; // the scale with the least loss
+    EvalParams Tune(const EvalParams& start, const Progress& progress = Progress());
+    const TunerStats& Stats() const {
+        return stats;
+    }
+
+ private:
+    typedef std::function<void(size_t begin, size_t end, size_t thread)> Job;
+
+    double Pass(const EvalParams& params, float scale, std::vector<double>* gradient) const; // the loss of all
+    void Parallel(size_t count, const Job& fun) const;
+    void WorkerFun(size_t index);
+
+    const TunerOptions options;
+    const size_t threads;
+    GreedyEngine rest; // evaluates with all the tuned weights zero
+    TunerStats stats;
+
+    // The positions as rows of a sparse matrix, the counts of the weights in the score of white.
+    std::vector<uint32_t> offsets; // of the first weight of every position and one past the last
+    std::vector<uint16_t> indices;
+    std::vector<int8_t> counts;
+    std::vector<float> constants; // the rest of the score of white in pawns
+    std::vector<float> results;   // of white: 1, 0.5 or 0
+
+    boost::thread_group workers; // all the threads but the calling one
+    mutable boost::barrier start;
+    mutable boost::barrier finish;
+    mutable const Job* job; // of the current pass
+    mutable size_t jobcount;
+    bool quit;
+};
+
+} // namespace Chess
+} // namespace Chai
@@ -0,0 +1,251 @@
+#define BOOST_TEST_MODULE MyTest
+
+#include <ChessMachine/machine.h>
+#include <ChessTrainer/trainer.h>
+#include <ChessTrainer/tuner.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+
+using namespace Chai::Chess;
+
+namespace {
+
+int Material(const Pieces& pieces) {
+    int material = 0;
+    for (const auto& piece : pieces) {
+        material += piece.type == Type::king ? 0 : static_cast<int>(piece.type);
+    }
+    return material;
+}
+
+// Positions of random games labelled by the material, which the network has to learn from the piece squares.
+std::vector<TrainingRecord> RandomRecords(size_t count, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<TrainingRecord> records;
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    while (records.size() < count) {
+        machine->Start();
+        const int plies = std::uniform_int_distribution<int>(10, 80)(random);
+        for (int ply = 0; ply < plies; ++ply) {
+            std::vector<std::pair<Position, Position>> moves;
+            for (const auto& piece : machine->GetSet(machine->CurrentPlayer())) {
+                for (Position to : machine->EnumMoves(piece.position)) {
+                    moves.emplace_back(piece.position, to);
+                }
+            }
+            if (moves.empty()) {
+                break;
+            }
+            const auto move = moves[std::uniform_int_distribution<size_t>(0, moves.size() - 1)(random)];
+            const Pieces own = machine->GetSet(machine->CurrentPlayer());
+            const Type type = std::find_if(own.begin(), own.end(), [&](const Piece& p) { return p.position == move.first; })->type;
+            const bool promotion = type == Type::pawn && (move.second.rank() == '1' || move.second.rank() == '8');
+            BOOST_REQUIRE(machine->Move(type, move.first, move.second, promotion ? Type::queen : Type::bad));
+        }
+        const Pieces white = machine->GetSet(Set::white);
+        const Pieces black = machine->GetSet(Set::black);
+        const int balance = Material(white) - Material(black);
+        records.push_back(PackRecord(white, black, machine->CurrentPlayer(), balance > 0 ? 1 : balance < 0 ? -1 : 0,
+                                     balance * 100));
+    }
+    return records;
+}
+
+boost::filesystem::path WriteRecords(const std::vector<TrainingRecord>& records) {
+    const auto file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("records-%%%%-%%%%.bin");
+    RecordWriter writer;
+    BOOST_REQUIRE(writer.Open(file.string()));
+    for (const auto& record : records) {
+        writer.Add(record);
+    }
+    BOOST_REQUIRE(writer.Close());
+    return file;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(TrainerTest)
+
+BOOST_AUTO_TEST_CASE(RecordTest) {
+    boost::shared_ptr<IMachine> machine = boost::make_shared<ChessMachine>();
+    machine->Start();
+    for (const char* move : {"e4", "d5", "exd5", "Qxd5", "Nc3"}) {
+        BOOST_REQUIRE(machine->Move(move));
+    }
+    const TrainingRecord record = PackRecord(machine->GetSet(Set::white), machine->GetSet(Set::black), Set::black, -1, -150);
+    Pieces white, black;
+    Set player;
+    UnpackRecord(record, white, black, player);
+    auto sorted = [](Pieces pieces) {
+        std::set<std::pair<int, int>> squares;
+        for (const auto& piece : pieces) {
+            squares.emplace(piece.position.pos(), static_cast<int>(piece.type));
+        }
+        return squares;
+    };
+    BOOST_CHECK(sorted(white) == sorted(machine->GetSet(Set::white)));
+    BOOST_CHECK(sorted(black) == sorted(machine->GetSet(Set::black)));
+    BOOST_CHECK(player == Set::black);
+    BOOST_CHECK_EQUAL(record.result, -1);
+    BOOST_CHECK_EQUAL(record.score, -150);
+    BOOST_CHECK_EQUAL(white.size(), 15);
+    BOOST_CHECK_EQUAL(black.size(), 15);
+}
+
+BOOST_AUTO_TEST_CASE(LoaderTest) {
+    const std::vector<TrainingRecord> records = RandomRecords(250, 1);
+    const auto file = WriteRecords(records);
+
+    // Every epoch passes all the records once, in batches of the given size but the last one.
+    RecordLoader loader(file.string(), 32, 3, 2);
+    BOOST_REQUIRE(loader.Valid());
+    BOOST_CHECK_EQUAL(loader.Size(), records.size());
+    std::multiset<uint64_t> seen;
+    std::vector<TrainingRecord> batch;
+    size_t batches = 0;
+    while (loader.Next(batch)) {
+        BOOST_CHECK(batch.size() <= 32);
+        for (const auto& record : batch) {
+            seen.insert(record.occupancy ^ (uint64_t(record.pieces[0]) << 1) ^ (uint64_t(record.pieces[15]) << 9));
+        }
+        ++batches;
+    }
+    BOOST_CHECK_EQUAL(seen.size(), 3 * records.size());
+    BOOST_CHECK_EQUAL(batches, 3 * ((records.size() + 31) / 32));
+    for (const auto& record : records) {
+        BOOST_CHECK_EQUAL(seen.count(record.occupancy ^ (uint64_t(record.pieces[0]) << 1) ^ (uint64_t(record.pieces[15]) << 9)) % 3, 0);
+    }
+    BOOST_CHECK(!loader.Next(batch));
+
+    // The loader stops reading when it is destroyed before the end.
+    {
+        RecordLoader early(file.string(), 8, 100, 1);
+        BOOST_CHECK(early.Next(batch));
+    }
+    BOOST_CHECK(!RecordLoader(file.string() + ".missing", 8, 1).Valid());
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadsTest) {
+    // The threads sum the same gradients in another order only.
+    const std::vector<TrainingRecord> records = RandomRecords(200, 2);
+    TrainerOptions options;
+    options.threads = 1;
+    Trainer single(options);
+    options.threads = 3;
+    Trainer parallel(options);
+    for (int step = 0; step < 3; ++step) {
+        BOOST_CHECK_CLOSE(single.Step(records), parallel.Step(records), 1e-3);
+    }
+    for (size_t i = 0; i < records.size(); i += 10) {
+        BOOST_CHECK_SMALL(single.Evaluate(records[i]) - parallel.Evaluate(records[i]), 1e-3f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TrainTest) {
+    const std::vector<TrainingRecord> records = RandomRecords(1000, 3);
+    const auto file = WriteRecords(records);
+    TrainerOptions options;
+    options.threads = 2;
+    options.batchsize = 100;
+    options.epochs = 20;
+    options.reportsteps = 50;
+    Trainer trainer(options);
+    const float before = trainer.Loss(records);
+    size_t reports = 0;
+    const TrainerStats stats = trainer.Train(file.string(), [&](const TrainerStats&) { ++reports; });
+    BOOST_CHECK_EQUAL(stats.samples, 20 * records.size());
+    BOOST_CHECK_EQUAL(stats.steps, 200);
+    BOOST_CHECK_EQUAL(reports, 4);
+    BOOST_CHECK(stats.samplespersecond > 0);
+    BOOST_CHECK(stats.efficiency > 0 && stats.efficiency <= 1.01);
+    const float after = trainer.Loss(records);
+    BOOST_TEST_MESSAGE("loss " << before << " -> " << after);
+    BOOST_CHECK(after < before / 2);
+
+    // The engine loads the weights and gets the scores of the trainer up to the rounding of the int8 weights.
+    const auto network = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("network-%%%%-%%%%.bin");
+    BOOST_REQUIRE(trainer.Write(network.string()));
+    Network loaded;
+    BOOST_REQUIRE(loaded.Open(network.string()));
+    double squares = 0;
+    for (const auto& record : records) {
+        Pieces white, black;
+        Set player;
+        UnpackRecord(record, white, black, player);
+        NetworkAccumulator accumulator;
+        loaded.Refresh(white, black, accumulator);
+        const float error = loaded.Evaluate(accumulator, player) - trainer.Evaluate(record);
+        BOOST_CHECK_SMALL(error, 0.3f);
+        squares += error * error;
+    }
+    BOOST_CHECK(std::sqrt(squares / records.size()) < 0.1);
+    boost::filesystem::remove(file);
+    boost::filesystem::remove(network);
+}
+
+BOOST_AUTO_TEST_CASE(TunerTest) {
+    const std::vector<TrainingRecord> records = RandomRecords(1000, 4);
+    TunerOptions options;
+    options.threads = 3;
+    options.iterations = 100;
+    options.learningrate = 0.01f;
+    Tuner tuner(options);
+    tuner.Add(records);
+    BOOST_REQUIRE_EQUAL(tuner.Size(), records.size());
+
+    // The sparse rows give the scores of the engine with the same weights, the hand-set ones and any others.
+    std::mt19937 random(5);
+    EvalParams perturbed = EvalParams::Default();
+    for (auto& value : perturbed.values) {
+        value += std::uniform_real_distribution<float>(-0.2f, 0.2f)(random);
+    }
+    for (const EvalParams& params : {EvalParams::Default(), perturbed}) {
+        GreedyEngine engine(SearchOptions(), params);
+        std::vector<PositionSnapshot> snapshots(records.size());
+        for (size_t i = 0; i < records.size(); ++i) {
+            UnpackRecord(records[i], snapshots[i].white, snapshots[i].black, snapshots[i].player);
+            snapshots[i].status = Status::normal;
+        }
+        std::vector<float> scores(records.size());
+        engine.EvalPositions(snapshots.data(), snapshots.size(), scores.data());
+        for (size_t i = 0; i < records.size(); ++i) {
+            const float white = snapshots[i].player == Set::white ? scores[i] : -scores[i];
+            BOOST_CHECK_SMALL(tuner.Score(i, params) - white, 1e-3f);
+        }
+    }
+
+    // The threads only split the passes.
+    options.threads = 1;
+    Tuner single(options);
+    single.Add(records);
+    BOOST_CHECK_CLOSE(single.Loss(perturbed, 2), tuner.Loss(perturbed, 2), 1e-6);
+
+    const EvalParams start = EvalParams::Default();
+    const float scale = tuner.FitScale(start);
+    BOOST_CHECK(tuner.Loss(start, scale) <= tuner.Loss(start, scale * 1.2f));
+    BOOST_CHECK(tuner.Loss(start, scale) <= tuner.Loss(start, scale / 1.2f));
+    const double before = tuner.Loss(start, scale);
+    int reports = 0;
+    const EvalParams tuned = tuner.Tune(start, [&](const TunerStats&, const EvalParams&) { ++reports; });
+    BOOST_CHECK_EQUAL(reports, 1);
+    BOOST_CHECK_EQUAL(tuner.Stats().iterations, 100);
+    BOOST_CHECK_CLOSE(tuner.Stats().scale, scale, 1e-3);
+    BOOST_TEST_MESSAGE("tuned loss " << before << " -> " << tuner.Stats().loss);
+    BOOST_CHECK(tuner.Stats().loss < before);
+
+    // The records are read from the file as well.
+    const auto file = WriteRecords(records);
+    BOOST_CHECK_EQUAL(tuner.Load(file.string()), records.size());
+    BOOST_CHECK_EQUAL(tuner.Size(), 2 * records.size());
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
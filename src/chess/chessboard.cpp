@@ -58,6 +58,8 @@ void Chessboard::stopGame()
     killTimer(engineTimer);
     engineTimer = 0;
   }
+  engineMove.clear();
+  ponderMove.clear();
   chessEngine.reset();
 }
 
@@ -211,7 +213,8 @@ void Chessboard::drawChesspieces(QPainter& painter)
 void Chessboard::drawChessMoves(QPainter& painter)
 {
   using namespace Chai::Chess;
-  auto piece = chessPieces.find(dragPos != BADPOS ? dragPos : hotPos);
+  const Position from = dragPos != BADPOS ? dragPos : hotPos;
+  auto piece = chessPieces.find(from);
   if (piece != chessPieces.end())
   {
     painter.save();
@@ -223,7 +226,7 @@ void Chessboard::drawChessMoves(QPainter& painter)
     const qreal scalel = 0.5;
     const qreal adjxl = startCell.width() * (1 - scalel) / 2;
     const qreal adjyl = startCell.height() * (1 - scalel) / 2;
-    for (auto p : chessMachine->EnumMoves(dragPos != BADPOS ? dragPos : hotPos)) {
+    for (auto p : chessMachine->EnumMoves(from)) {
       QRectF rec;
       if (boardLayout == BlackTop) {
         rec.setX(startCell.left() + startCell.width() * p.x());
@@ -238,7 +241,8 @@ void Chessboard::drawChessMoves(QPainter& painter)
       {
         rec.adjust(adjxl, adjyl, -adjxl, -adjyl);
         painter.save();
-        QPen pen(Qt::red);
+        // Captures losing material by the exchange on the square are crossed out in gray.
+        QPen pen(chessMachine->SEEAtLeast(from, p, 0) ? Qt::red : Qt::darkGray);
         pen.setCapStyle(Qt::RoundCap);
         pen.setWidthF(startCell.width() * 0.2);
         painter.setPen(pen);
@@ -303,6 +307,15 @@ void Chessboard::afterMove(bool shownot)
     }
   }
 
+  // The search of the expected move goes on as the real one, the search of another move is dropped with its messages.
+  const bool ponderhit = shownot && !ponderMove.empty() && chessMachine->LastMoveNotation() == ponderMove;
+  if (chessEngine && !ponderMove.empty() && !ponderhit) {
+    chessEngine->Stop();
+    chessEngine->ProcessInfo(nullptr);
+  }
+  ponderMove.clear();
+  engineMove.clear();
+
   if (shownot) {
     QString notation = QString::fromStdString(chessMachine->LastMoveNotation());
     switch (chessMachine->CheckStatus())
@@ -334,7 +347,10 @@ void Chessboard::afterMove(bool shownot)
     emit bestScore("...");
     emit bestMove("...");
     emit readyOk(false);
-    if (chessEngine->Start(*chessMachine, maxDepth)) {
+    if (ponderhit) {
+      chessEngine->PonderHit();
+      engineTimer = startTimer(300);
+    } else if (chessEngine->Start(*chessMachine, maxDepth)) {
       engineTimer = startTimer(300);
     }
   } else {
@@ -449,6 +465,19 @@ void Chessboard::timerEvent(QTimerEvent * event)
   if (event->timerId() == engineTimer && chessEngine) {
     chessEngine->ProcessInfo(this);
     //QApplication::beep();
+    if (!engineTimer) {
+      startPonder(); // the search is over, the engine thinks on while the move is being made
+    }
+  }
+}
+
+void Chessboard::startPonder()
+{
+  if (chessEngine && !engineMove.empty() && maxDepth > 0) {
+    auto expected = chessMachine->SlightClone();
+    if (expected->Move(engineMove) && chessEngine->Ponder(*expected, maxDepth)) {
+      ponderMove = engineMove;
+    }
   }
 }
 
@@ -468,6 +497,7 @@ void Chessboard::ReadyOk()
 
 void Chessboard::BestMove(std::string notation)
 {
+  engineMove = notation;
   emit bestMove(QString::fromStdString(notation));
 }
 
@@ -47,10 +47,15 @@ protected:
   // Messages sent during the search
   void NodesSearched(size_t nodes) override;
   void NodesPerSecond(int /*nps*/) override {}
+  void SearchDepth(int /*depth*/, int /*seldepth*/) override {}
+  void HashFull(int /*permill*/) override {}
+  void CurrentMove(const std::string& /*notation*/, int /*number*/) override {}
+  void PrincipalVariation(int /*depth*/, float /*score*/, const std::vector<std::string>& /*notations*/, int /*line*/) override {}
   // Messages sent after the search
   void ReadyOk() override;
   void BestMove(std::string notation) override;
   void BestScore(float score) override; // in pawns
+  void SearchStats(const Chai::Chess::SearchStatistics& /*stats*/) override {}
 
 signals:
   void updateLog(QString str);
@@ -76,6 +81,7 @@ private:
   }
   void updateCursor();
   void afterMove(bool shownot);
+  void startPonder();
 
   Ui::chessboardClass ui;
   
@@ -97,6 +103,8 @@ private:
 
   int engineTimer;
   int maxDepth;
+  std::string engineMove; // the best move of the last search
+  std::string ponderMove; // the expected move searched on the opponent's time
   BoardLayout boardLayout;
   bool autoRotate;
 };